@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Compare qclient_bench results with a baseline.
+
+Both files are Google Benchmark JSON output (--benchmark_out_format=json).
+With repetitions the median aggregate is used, otherwise the mean of the
+runs of each benchmark. A benchmark slower than the baseline by more than
+the threshold is a regression and the exit status is 1.
+
+  compare.py [--threshold PCT] [--metric real_time|cpu_time] BASELINE RESULTS
+  compare.py --update BASELINE RESULTS    # RESULTS become the baseline
+
+Timings only compare on the same machine and build type: make the baseline
+there, the context of both runs is checked and differences reported.
+"""
+
+import argparse
+import json
+import shutil
+import sys
+from pathlib import Path
+
+UNITS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+CONTEXT_KEYS = ("host_name", "num_cpus", "mhz_per_cpu", "library_build_type")
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def timings(results, metric):
+    """name -> time in ns, medians when there are aggregates"""
+    medians = {}
+    runs = {}
+
+    for b in results.get("benchmarks", []):
+        if b.get("error_occurred"):
+            continue
+
+        name = b.get("run_name", b["name"])
+        value = b[metric] * UNITS[b.get("time_unit", "ns")]
+
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "median":
+                medians[name] = value
+        else:
+            runs.setdefault(name, []).append(value)
+
+    means = {name: sum(values) / len(values) for name, values in runs.items()}
+    means.update(medians)
+    return means
+
+
+def format_ns(ns):
+    for unit in ("s", "ms", "us"):
+        if ns >= UNITS[unit]:
+            return f"{ns / UNITS[unit]:.2f} {unit}"
+    return f"{ns:.1f} ns"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", type=Path)
+    parser.add_argument("results", type=Path)
+    parser.add_argument("--threshold", type=float, default=10.0, help="regression threshold, percent (default 10)")
+    parser.add_argument("--metric", choices=("real_time", "cpu_time"), default="real_time")
+    parser.add_argument("--update", action="store_true", help="store the results as the baseline")
+    args = parser.parse_args()
+
+    results = load(args.results)
+
+    if args.update:
+        shutil.copyfile(args.results, args.baseline)
+        print(f"{args.baseline} updated, {len(timings(results, args.metric))} benchmarks")
+        return 0
+
+    if not args.baseline.exists():
+        print(f"No baseline at {args.baseline}, create one on this machine with --update", file=sys.stderr)
+        return 2
+
+    baseline = load(args.baseline)
+
+    for key in CONTEXT_KEYS:
+        old = baseline.get("context", {}).get(key)
+        new = results.get("context", {}).get(key)
+        if old != new:
+            print(f"warning: {key} differs, baseline {old}, results {new}", file=sys.stderr)
+
+    old = timings(baseline, args.metric)
+    new = timings(results, args.metric)
+    limit = 1.0 + args.threshold / 100.0
+    regressions = []
+
+    width = max((len(name) for name in new), default=10)
+    print(f"{'benchmark':<{width}}  {'baseline':>12}  {'results':>12}  {'change':>8}")
+
+    for name, value in new.items():
+        if name not in old:
+            print(f"{name:<{width}}  {'-':>12}  {format_ns(value):>12}  {'new':>8}")
+            continue
+
+        ratio = value / old[name] if old[name] > 0 else float("inf")
+        flag = ""
+        if ratio > limit:
+            regressions.append(name)
+            flag = "  REGRESSION"
+
+        print(f"{name:<{width}}  {format_ns(old[name]):>12}  {format_ns(value):>12}  {(ratio - 1) * 100:>+7.1f}%{flag}")
+
+    for name in old.keys() - new.keys():
+        print(f"{name:<{width}}  {format_ns(old[name]):>12}  {'-':>12}  {'gone':>8}")
+
+    if regressions:
+        print(f"\n{len(regressions)} benchmark(s) more than {args.threshold:g}% slower than the baseline")
+        return 1
+
+    print(f"\nNo regression over {args.threshold:g}%")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
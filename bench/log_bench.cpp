@@ -0,0 +1,58 @@
+#include <iostream>
+#include <streambuf>
+
+#include <benchmark/benchmark.h>
+
+#include "tunnel_loggin.h"
+
+namespace
+{
+
+// Where the log writer thread ends up while a benchmark logs for real
+class NullBuffer : public std::streambuf
+{
+protected:
+  int overflow(int c) override { return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+}
+
+// A message below the minimum severity : the check, nothing formatted
+static void BM_LogFiltered(benchmark::State& state)
+{
+  TunnelLogging::set_min_severity(TunnelLogging::Severity::INFO);
+  int i = 0;
+
+  for(auto _ : state) {
+    TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::upload_stats seq " << i++ << " [" << 1200 << ", " << 1500 << ")";
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogFiltered);
+
+// A logged message : formatting and the enqueue on the caller's thread. The
+// writer formats and writes to a null stdout meanwhile, and like in the
+// client the ring drops what it can not keep up with.
+static void BM_LogUnfiltered(benchmark::State& state)
+{
+  // Nothing else must be writing while stdout is swapped
+  TunnelLogging::flush();
+
+  NullBuffer null;
+  auto* cout = std::cout.rdbuf(&null);
+
+  TunnelLogging::set_min_severity(TunnelLogging::Severity::INFO);
+  int i = 0;
+
+  for(auto _ : state) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "TunnelMgr::upload_stats seq " << i++ << " [" << 1200 << ", " << 1500 << ")";
+  }
+
+  TunnelLogging::flush();
+  std::cout.rdbuf(cout);
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LogUnfiltered)->UseRealTime();
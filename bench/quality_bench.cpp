@@ -0,0 +1,63 @@
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include "quality_metrics.h"
+#include "quality_scorer.h"
+#include "reference_video.h"
+#include "workloads.h"
+
+// SSIM of one luma plane, the bulk of a frame's scoring
+static void BM_QualitySsim(benchmark::State& state)
+{
+  int height = static_cast<int>(state.range(0));
+  int width = workloads::width_for(height);
+  auto a = workloads::i420_frame(width, height).video_frame_buffer()->ToI420();
+  auto b = workloads::i420_frame(width, height, workloads::SEED + 1).video_frame_buffer()->ToI420();
+
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(plane_ssim(a->DataY(), a->StrideY(), b->DataY(), b->StrideY(), width, height));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * width * height * 2);
+}
+BENCHMARK(BM_QualitySsim)->ArgName("height")->Arg(720)->Arg(1080)->Arg(2160)->Unit(benchmark::kMicrosecond);
+
+// QualityScorer end to end, against a Y4M reference : a batch of one
+// decoded frame per worker queued by OnFrame, then waited for. The frames
+// per second it reports have to stay above the stream's for the scoring to
+// keep up in real time.
+static void BM_QualityScorer(benchmark::State& state)
+{
+  int height = static_cast<int>(state.range(0));
+  int width = workloads::width_for(height);
+  int threads = static_cast<int>(state.range(1));
+
+  auto path = workloads::y4m_file(width, height, 1);
+  auto reference = std::make_shared<ReferenceVideo>();
+  if(!reference->open(path)) {
+    state.SkipWithError("reference not readable");
+    return;
+  }
+
+  QualityScorer::Config config;
+  config.match = QualityScorer::Match::RTP;
+  config.threads = threads;
+  config.queue = static_cast<size_t>(threads);
+  config.per_frame = false;
+
+  QualityScorer scorer(reference, config);
+  auto frame = workloads::i420_frame(width, height, workloads::SEED + 1);
+
+  for(auto _ : state) {
+    for(int i = 0; i < threads; ++i) scorer.OnFrame(frame);
+    scorer.drain();
+  }
+
+  state.SetItemsProcessed(state.iterations() * threads);
+
+  std::filesystem::remove(path);
+}
+BENCHMARK(BM_QualityScorer)->ArgNames({ "height", "threads" })
+  ->ArgsProduct({ { 720, 1080 }, { 1, 2, 4 } })->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,54 @@
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "argb_frame.h"
+#include "frame_mailbox.h"
+#include "frame_scaler.h"
+#include "workloads.h"
+
+// WindowRenderer::OnFrame on the decoder thread : I420 to ARGB into the
+// mailbox back slot, then publish
+static void BM_RenderOnFrame(benchmark::State& state)
+{
+  int height = static_cast<int>(state.range(0));
+  int width = workloads::width_for(height);
+  auto frame = workloads::i420_frame(width, height);
+
+  FrameMailbox<ArgbFrame> mailbox;
+
+  for(auto _ : state) {
+    mailbox.back().assign(frame);
+    mailbox.publish();
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * width * height * 3 / 2);
+}
+BENCHMARK(BM_RenderOnFrame)->ArgName("height")->Arg(480)->Arg(720)->Arg(1080)->Arg(2160)->Unit(benchmark::kMicrosecond);
+
+// WindowRenderer::on_redraw on the GTK thread : the latest ARGB frame
+// scaled into the window surface
+static void BM_RenderRedraw(benchmark::State& state)
+{
+  int height = static_cast<int>(state.range(0));
+  int width = workloads::width_for(height);
+  int window_height = static_cast<int>(state.range(1));
+  int window_width = workloads::width_for(window_height);
+
+  ArgbFrame argb;
+  argb.assign(workloads::i420_frame(width, height));
+
+  FrameScaler scaler;
+  std::vector<uint8_t> surface(static_cast<size_t>(window_width) * window_height * 4);
+
+  for(auto _ : state) {
+    benchmark::DoNotOptimize(scaler.scale(argb, surface.data(), window_width * 4, window_width, window_height));
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RenderRedraw)->ArgNames({ "height", "window" })
+  ->ArgsProduct({ { 480, 720, 1080, 2160 }, { 720, 1080 } })->Unit(benchmark::kMicrosecond);
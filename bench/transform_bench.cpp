@@ -0,0 +1,95 @@
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <api/frame_transformer_interface.h>
+#include <api/make_ref_counted.h>
+
+#include "peerconnection.h"
+#include "workloads.h"
+
+namespace
+{
+
+// What the depacketizer hands to the transformer, over a shared payload
+class BenchFrame : public webrtc::TransformableVideoFrameInterface
+{
+  rtc::ArrayView<const uint8_t> _data;
+  uint32_t _ssrc;
+  uint32_t _timestamp;
+  bool     _key;
+  webrtc::VideoFrameMetadata _metadata;
+
+public:
+  BenchFrame(rtc::ArrayView<const uint8_t> data, uint32_t ssrc, uint32_t timestamp, bool key)
+    : _data(data), _ssrc(ssrc), _timestamp(timestamp), _key(key)
+  {
+    _metadata.SetCodec(webrtc::VideoCodecType::kVideoCodecH264);
+  }
+
+  rtc::ArrayView<const uint8_t> GetData() const override { return _data; }
+  void SetData(rtc::ArrayView<const uint8_t> data) override { _data = data; }
+  uint8_t GetPayloadType() const override { return 96; }
+  uint32_t GetSsrc() const override { return _ssrc; }
+  uint32_t GetTimestamp() const override { return _timestamp; }
+  void SetRTPTimestamp(uint32_t timestamp) override { _timestamp = timestamp; }
+  Direction GetDirection() const override { return Direction::kReceiver; }
+  std::string GetMimeType() const override { return "video/H264"; }
+
+  bool IsKeyFrame() const override { return _key; }
+  webrtc::VideoFrameMetadata GetMetadata() const override { return _metadata; }
+  void SetMetadata(const webrtc::VideoFrameMetadata& metadata) override { _metadata = metadata; }
+};
+
+// The decoder side, drops the frame
+class NullCallback : public webrtc::TransformedFrameCallback
+{
+public:
+  void OnTransformedFrame(std::unique_ptr<webrtc::TransformableFrameInterface> frame) override
+  {
+    benchmark::DoNotOptimize(frame.get());
+  }
+};
+
+}
+
+// PeerconnectionMgr::Transform per encoded frame : tracer marks, key frame
+// accounting and the copy into the bitstream recorder ring, whose writer
+// thread writes to a temporary file meanwhile. A key frame every 60 frames.
+// Past what the disk takes the ring drops frames, as it would in the client.
+static void BM_Transform(benchmark::State& state)
+{
+  constexpr uint32_t SSRC = 1234;
+  constexpr int KEY_FRAME_INTERVAL = 60;
+
+  auto data = workloads::payload(static_cast<size_t>(state.range(0)));
+  auto path = std::filesystem::temp_directory_path() / "qclient_bench.264";
+
+  PeerconnectionMgr pc;
+  pc.bitstream_path = path;
+  pc.start();
+
+  auto callback = rtc::make_ref_counted<NullCallback>();
+  pc.RegisterTransformedFrameSinkCallback(callback, SSRC);
+
+  uint32_t timestamp = 0;
+  int frame = 0;
+
+  for(auto _ : state) {
+    bool key = frame++ % KEY_FRAME_INTERVAL == 0;
+    pc.Transform(std::make_unique<BenchFrame>(data, SSRC, timestamp, key));
+    timestamp += 3000;
+  }
+
+  pc.UnregisterTransformedFrameSinkCallback(SSRC);
+  pc.stop();
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(path.string() + ".idx");
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+}
+BENCHMARK(BM_Transform)->ArgName("bytes")->Arg(1 << 10)->Arg(16 << 10)->Arg(128 << 10)->UseRealTime();
@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+
+#include "tunnel_mgr.h"
+#include "messages.h"
+#include "workloads.h"
+
+// TunnelMgr::upload_stats for one chunk of n samples : the samples to
+// json, the uploadstats message, then the frame as the websocket sends it
+// (0 JSON text, 1 MessagePack)
+static void BM_UploadStats(benchmark::State& state)
+{
+  using json = nlohmann::json;
+
+  auto samples = static_cast<size_t>(state.range(0));
+  bool binary = state.range(1) != 0;
+
+  StatsSeries stats(samples);
+  workloads::fill_stats(stats, samples);
+
+  size_t bytes = 0;
+
+  for(auto _ : state) {
+    messages::UploadStats data{
+      .seq = 0,
+      .offset = 0,
+      .final = false,
+      .stats = TunnelMgr::stats_to_json(stats, stats.begin(), stats.end())
+    };
+
+    json request{ { "cmd", messages::UploadStats::cmd }, { "transId", 1 }, { "data", data } };
+
+    if(binary) {
+      auto bin = json::to_msgpack(request);
+      bytes = bin.size();
+      benchmark::DoNotOptimize(bin.data());
+    }
+    else {
+      auto text = request.dump();
+      bytes = text.size();
+      benchmark::DoNotOptimize(text.data());
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(samples));
+  state.counters["frame_bytes"] = static_cast<double>(bytes);
+}
+BENCHMARK(BM_UploadStats)->ArgNames({ "samples", "msgpack" })
+  ->ArgsProduct({ { 60, 600, 6000 }, { 0, 1 } })->Unit(benchmark::kMicrosecond);
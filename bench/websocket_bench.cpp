@@ -0,0 +1,109 @@
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "websocket.h"
+#include "rpc.h"
+#include "messages.h"
+
+namespace
+{
+
+using json = nlohmann::json;
+using Message = websocketpp::config::asio_client::message_type;
+
+// Gives the benchmarks the frame handler, nothing is connected
+class BenchSocket : public WebSocket
+{
+public:
+  using WebSocket::WebSocket;
+  using WebSocketBase::on_message;
+};
+
+// A frame as the peer sends it in the given encoding
+MessagePtr make_frame(const json& msg, Encoding encoding)
+{
+  std::string payload;
+  auto opcode = websocketpp::frame::opcode::binary;
+
+  switch(encoding) {
+  case Encoding::CBOR: {
+    auto bin = json::to_cbor(msg);
+    payload.assign(bin.begin(), bin.end());
+    break;
+  }
+  case Encoding::MSGPACK: {
+    auto bin = json::to_msgpack(msg);
+    payload.assign(bin.begin(), bin.end());
+    break;
+  }
+  default:
+    payload = msg.dump();
+    opcode = websocketpp::frame::opcode::text;
+  }
+
+  auto frame = std::make_shared<Message>(nullptr, opcode, payload.size());
+  frame->set_payload(payload);
+  return frame;
+}
+
+json capabilities_reply(int trans_id)
+{
+  messages::CapabilitiesReply reply;
+
+  for(const char* impl : { "mvfst", "quicgo", "quiche", "lsquic", "udp" }) {
+    reply.in_impls.push_back({ impl, true, true, { "newreno", "cubic", "bbr", "bbr2", "copa" } });
+  }
+
+  return json{ { "type", "response" }, { "transId", trans_id }, { "data", reply } };
+}
+
+}
+
+// WebSocketBase::on_message decoding a reply, 0 JSON, 1 CBOR, 2 MessagePack,
+// for an ack and a capabilities reply
+static void BM_WebSocketDecode(benchmark::State& state)
+{
+  auto encoding = static_cast<Encoding>(state.range(0));
+  json msg = state.range(1) ? capabilities_reply(1) : json{ { "type", "response" }, { "transId", 1 }, { "data", json::object() } };
+
+  BenchSocket socket;
+  socket.set_encoding(encoding);
+  socket.onmessage = [](const json& msg) { benchmark::DoNotOptimize(&msg); };
+
+  auto frame = make_frame(msg, encoding);
+
+  for(auto _ : state) socket.on_message({}, frame);
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(frame->get_payload().size()));
+}
+BENCHMARK(BM_WebSocketDecode)->ArgNames({ "encoding", "caps" })->ArgsProduct({ { 0, 1, 2 }, { 0, 1 } });
+
+// A whole request round trip as TunnelSocket wires it : call, reply frame
+// decoded by on_message, dispatched to the pending call by transId and its
+// future completed. The reply frame is built in the loop too, its transId
+// is only known once the request is sent.
+static void BM_RpcDispatch(benchmark::State& state)
+{
+  auto encoding = static_cast<Encoding>(state.range(0));
+
+  BenchSocket socket;
+  RpcChannel rpc;
+  int trans_id = 0;
+
+  socket.set_encoding(encoding);
+  socket.onmessage = [&rpc](const json& msg) { rpc.on_message(msg); };
+  rpc.sender = [&trans_id](const json& request) { trans_id = request["transId"].get<int>(); };
+
+  for(auto _ : state) {
+    auto reply = rpc.call(messages::Link{ 2500, 0, 0 });
+    socket.on_message({}, make_frame(json{ { "type", "response" }, { "transId", trans_id }, { "data", json::object() } }, encoding));
+    auto ack = reply.get();
+    benchmark::DoNotOptimize(ack);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RpcDispatch)->ArgName("encoding")->DenseRange(0, 2)->UseRealTime();
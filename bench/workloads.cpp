@@ -0,0 +1,103 @@
+#include "workloads.h"
+
+#include <fstream>
+#include <random>
+#include <string>
+
+#include <api/video/i420_buffer.h>
+
+namespace workloads
+{
+
+webrtc::VideoFrame i420_frame(int width, int height, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  auto buffer = webrtc::I420Buffer::Create(width, height);
+
+  auto fill = [&rng](uint8_t* data, int stride, int w, int h) {
+    for(int y = 0; y < h; ++y) {
+      for(int x = 0; x < w; ++x) data[y * stride + x] = static_cast<uint8_t>(rng());
+    }
+  };
+
+  fill(buffer->MutableDataY(), buffer->StrideY(), width, height);
+  fill(buffer->MutableDataU(), buffer->StrideU(), buffer->ChromaWidth(), buffer->ChromaHeight());
+  fill(buffer->MutableDataV(), buffer->StrideV(), buffer->ChromaWidth(), buffer->ChromaHeight());
+
+  return webrtc::VideoFrame::Builder()
+    .set_video_frame_buffer(buffer)
+    .set_timestamp_rtp(90000)
+    .set_rotation(webrtc::kVideoRotation_0)
+    .build();
+}
+
+std::vector<uint8_t> payload(size_t size, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> data(size);
+
+  for(auto& b : data) b = static_cast<uint8_t>(rng());
+
+  return data;
+}
+
+std::filesystem::path y4m_file(int width, int height, size_t frames, uint32_t seed)
+{
+  auto path = std::filesystem::temp_directory_path() / ("qclient_bench_" + std::to_string(width) + "x" + std::to_string(height) + ".y4m");
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+  out << "YUV4MPEG2 W" << width << " H" << height << " F30:1 Ip A1:1 C420\n";
+
+  auto plane = [&out](const uint8_t* data, int stride, int w, int h) {
+    for(int y = 0; y < h; ++y) out.write(reinterpret_cast<const char*>(data + static_cast<size_t>(y) * stride), w);
+  };
+
+  for(size_t i = 0; i < frames; ++i) {
+    auto buffer = i420_frame(width, height, seed + static_cast<uint32_t>(i)).video_frame_buffer()->ToI420();
+
+    out << "FRAME\n";
+    plane(buffer->DataY(), buffer->StrideY(), width, height);
+    plane(buffer->DataU(), buffer->StrideU(), buffer->ChromaWidth(), buffer->ChromaHeight());
+    plane(buffer->DataV(), buffer->StrideV(), buffer->ChromaWidth(), buffer->ChromaHeight());
+  }
+
+  return path;
+}
+
+void fill_stats(StatsSeries& stats, size_t n, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0., 1.);
+
+  stats.reset(n);
+
+  for(size_t i = 0; i < n; ++i) {
+    StatsSeries::Sample s;
+
+    s.x = static_cast<int64_t>(i);
+    s.time = i * 0.1;
+    s.bitrate = 2000 + static_cast<int>(1000 * unit(rng));
+    s.link = 2500;
+    s.fps = 28. + 4. * unit(rng);
+    s.frame_dropped = static_cast<int64_t>(i / 50);
+    s.frame_decoded = static_cast<int64_t>(i * 3);
+    s.frame_key_decoded = static_cast<int64_t>(i / 100);
+    s.jitter = 10. * unit(rng);
+    s.jitter_buffer_delay = 40. + 20. * unit(rng);
+    s.jitter_buffer_target_delay = 50. + 10. * unit(rng);
+    s.jitter_buffer_minimum_delay = 30. + 10. * unit(rng);
+    s.nack_count = static_cast<int64_t>(i / 10);
+    s.pli_count = static_cast<int64_t>(i / 300);
+    s.fir_count = 0;
+    s.fec_packets_received = 0;
+    s.rtx_packets_received = static_cast<int64_t>(i / 10);
+    s.packets_lost = static_cast<int64_t>(i / 20);
+    s.freeze_count = static_cast<int64_t>(i / 600);
+    s.pause_count = 0;
+    s.available_incoming_bitrate = 2.5e6 + 1e6 * unit(rng);
+
+    stats.push(s);
+  }
+}
+
+}
@@ -0,0 +1,36 @@
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+#include <api/video/video_frame.h>
+
+#include "stats_series.h"
+
+// Inputs of the benchmarks, generated from a fixed seed so every run and
+// every machine measures the same work
+namespace workloads
+{
+  constexpr uint32_t SEED = 0x5eed;
+
+  // 16:9, even
+  inline int width_for(int height) { return (height * 16 / 9 + 1) & ~1; }
+
+  // Noise, the worst case for the scalers
+  webrtc::VideoFrame i420_frame(int width, int height, uint32_t seed = SEED);
+
+  // Encoded frame data
+  std::vector<uint8_t> payload(size_t size, uint32_t seed = SEED);
+
+  // Y4M of n noise frames in the temp directory, the quality scorer's
+  // reference
+  std::filesystem::path y4m_file(int width, int height, size_t frames, uint32_t seed = SEED);
+
+  // n samples at 100 ms with values in the ranges of a real run
+  void fill_stats(StatsSeries& stats, size_t n, uint32_t seed = SEED);
+}
+
+#endif /* WORKLOADS_H */
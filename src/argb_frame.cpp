@@ -0,0 +1,29 @@
+#include "argb_frame.h"
+
+#include "api/video/i420_buffer.h"
+#include "api/video/video_frame_buffer.h"
+#include "api/video/video_rotation.h"
+#include "libyuv/convert_from.h"
+
+void ArgbFrame::assign(const webrtc::VideoFrame& frame)
+{
+  rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(
+      frame.video_frame_buffer()->ToI420());
+  if (frame.rotation() != webrtc::kVideoRotation_0) {
+    buffer = webrtc::I420Buffer::Rotate(*buffer, frame.rotation());
+  }
+
+  width = buffer->width();
+  height = buffer->height();
+  rtp_timestamp = frame.timestamp();
+
+  size_t size = static_cast<size_t>(width) * height * 4;
+  if(size > capacity) {
+    data.reset(new uint8_t[size]);
+    capacity = size;
+  }
+
+  libyuv::I420ToARGB(buffer->DataY(), buffer->StrideY(), buffer->DataU(),
+		     buffer->StrideU(), buffer->DataV(), buffer->StrideV(),
+		     data.get(), stride(), width, height);
+}
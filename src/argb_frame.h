@@ -0,0 +1,25 @@
+#ifndef ARGB_FRAME_H
+#define ARGB_FRAME_H
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include <api/video/video_frame.h>
+
+// Decoded frame converted to ARGB, reusing its allocation between frames.
+struct ArgbFrame
+{
+  std::unique_ptr<uint8_t[]> data;
+  size_t   capacity = 0;
+  int      width = 0;
+  int      height = 0;
+  uint32_t rtp_timestamp = 0;
+
+  int stride() const { return width * 4; }
+
+  // Rotate if needed and convert to ARGB
+  void assign(const webrtc::VideoFrame& frame);
+};
+
+#endif /* ARGB_FRAME_H */
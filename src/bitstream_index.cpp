@@ -0,0 +1,66 @@
+#include "bitstream_index.h"
+
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tunnel_loggin.h"
+
+bool BitstreamIndexView::open(const std::filesystem::path& path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << path.string() << " : " << std::strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(BitstreamIndexHeader)) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Invalid bitstream index " << path.string();
+    ::close(fd);
+    return false;
+  }
+
+  _map_size = st.st_size;
+  _map = mmap(nullptr, _map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(_map == MAP_FAILED) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not map " << path.string() << " : " << std::strerror(errno);
+    _map = nullptr;
+    return false;
+  }
+
+  auto header = static_cast<const BitstreamIndexHeader*>(_map);
+  if(std::memcmp(header->magic, BitstreamIndexHeader::MAGIC, sizeof(header->magic)) != 0
+     || header->version != BitstreamIndexHeader::VERSION
+     || header->record_size != sizeof(BitstreamIndexRecord)) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Unsupported bitstream index " << path.string();
+    close();
+    return false;
+  }
+
+  // Sequential scan is the common case
+  madvise(_map, _map_size, MADV_SEQUENTIAL);
+
+  _records = reinterpret_cast<const BitstreamIndexRecord*>(static_cast<const uint8_t*>(_map) + sizeof(BitstreamIndexHeader));
+  _count = (_map_size - sizeof(BitstreamIndexHeader)) / sizeof(BitstreamIndexRecord);
+
+  return true;
+}
+
+void BitstreamIndexView::close()
+{
+  if(_map) munmap(_map, _map_size);
+
+  _map = nullptr;
+  _map_size = 0;
+  _records = nullptr;
+  _count = 0;
+}
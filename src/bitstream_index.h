@@ -0,0 +1,70 @@
+#ifndef BITSTREAM_INDEX_H
+#define BITSTREAM_INDEX_H
+
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+// Binary index written next to a recorded bitstream (<bitstream>.idx): a
+// header followed by fixed size little endian records, one per frame, so the
+// file can be mmap'ed and any frame found without scanning the bitstream.
+// The structs below are that layout, written and read in place : only
+// little endian targets can, which is checked at build time.
+struct BitstreamIndexHeader
+{
+  static constexpr char     MAGIC[4] = { 'Q', 'T', 'B', 'I' };
+  static constexpr uint16_t VERSION = 1;
+
+  char     magic[4];
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t reserved[2];
+};
+
+struct BitstreamIndexRecord
+{
+  uint64_t offset;        // in the bitstream file
+  uint64_t arrival_ns;    // steady clock, when the frame reached the transformer
+  int64_t  frame_id;      // -1 if unknown
+  uint32_t size;
+  uint32_t rtp_timestamp;
+  uint32_t ssrc;
+  uint8_t  key_frame;
+  uint8_t  codec;         // webrtc::VideoCodecType
+  uint8_t  reserved[2];
+};
+
+static_assert(std::endian::native == std::endian::little, "the bitstream index is little endian, written and mmap'ed as is");
+static_assert(sizeof(BitstreamIndexHeader) == 16);
+static_assert(sizeof(BitstreamIndexRecord) == 40);
+static_assert(offsetof(BitstreamIndexHeader, version) == 4 && offsetof(BitstreamIndexHeader, record_size) == 6);
+static_assert(offsetof(BitstreamIndexRecord, arrival_ns) == 8 && offsetof(BitstreamIndexRecord, frame_id) == 16
+	      && offsetof(BitstreamIndexRecord, size) == 24 && offsetof(BitstreamIndexRecord, rtp_timestamp) == 28
+	      && offsetof(BitstreamIndexRecord, ssrc) == 32 && offsetof(BitstreamIndexRecord, key_frame) == 36
+	      && offsetof(BitstreamIndexRecord, codec) == 37);
+
+// Read only mmap'ed view of an index file
+class BitstreamIndexView
+{
+  void*                       _map = nullptr;
+  size_t                      _map_size = 0;
+  const BitstreamIndexRecord* _records = nullptr;
+  size_t                      _count = 0;
+
+public:
+  BitstreamIndexView() = default;
+  BitstreamIndexView(const BitstreamIndexView&) = delete;
+  BitstreamIndexView& operator=(const BitstreamIndexView&) = delete;
+  ~BitstreamIndexView() { close(); }
+
+  bool open(const std::filesystem::path& path);
+  void close();
+
+  size_t size() const { return _count; }
+  const BitstreamIndexRecord& operator[](size_t i) const { return _records[i]; }
+  const BitstreamIndexRecord* begin() const { return _records; }
+  const BitstreamIndexRecord* end() const { return _records + _count; }
+};
+
+#endif /* BITSTREAM_INDEX_H */
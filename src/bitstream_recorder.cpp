@@ -0,0 +1,211 @@
+#include "bitstream_recorder.h"
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <array>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "tunnel_loggin.h"
+
+namespace
+{
+
+constexpr size_t MAX_BATCH = 64;
+
+}
+
+BitstreamRecorder::BitstreamRecorder() : BitstreamRecorder(Config{})
+{
+}
+
+BitstreamRecorder::BitstreamRecorder(Config config) : _config(config), _slots(config.slots)
+{
+  for(auto& slot : _slots) {
+    slot.data.reset(new uint8_t[_config.slot_size]);
+    slot.capacity = _config.slot_size;
+  }
+}
+
+BitstreamRecorder::~BitstreamRecorder()
+{
+  close();
+}
+
+bool BitstreamRecorder::open(const std::filesystem::path& path)
+{
+  close();
+
+  _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(_fd < 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << path.string() << " : " << std::strerror(errno);
+    return false;
+  }
+
+  auto index_path = path;
+  index_path += ".idx";
+
+  _index_fd = ::open(index_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(_index_fd < 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << index_path.string() << " : " << std::strerror(errno);
+    ::close(_fd);
+    _fd = -1;
+    return false;
+  }
+
+  BitstreamIndexHeader header{};
+  std::memcpy(header.magic, BitstreamIndexHeader::MAGIC, sizeof(header.magic));
+  header.version = BitstreamIndexHeader::VERSION;
+  header.record_size = sizeof(BitstreamIndexRecord);
+
+  if(::write(_index_fd, &header, sizeof(header)) != sizeof(header)) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not write index header : " << std::strerror(errno);
+  }
+
+  _head = 0;
+  _tail = 0;
+  _frames_written = 0;
+  _bytes_written = 0;
+  _frames_dropped = 0;
+  _frames_truncated = 0;
+
+  _running = true;
+  _writer = std::thread([this]() { write_loop(); });
+
+  return true;
+}
+
+void BitstreamRecorder::close()
+{
+  if(_fd < 0) return;
+
+  _running = false;
+  _wake.fetch_add(1, std::memory_order_release);
+  _wake.notify_one();
+
+  if(_writer.joinable()) _writer.join();
+
+  ::close(_fd);
+  ::close(_index_fd);
+  _fd = -1;
+  _index_fd = -1;
+}
+
+bool BitstreamRecorder::push(const uint8_t* data, size_t size, const BitstreamIndexRecord& record)
+{
+  if(!_running) return false;
+
+  uint64_t head = _head.load(std::memory_order_relaxed);
+  if(head - _tail.load(std::memory_order_acquire) >= _slots.size()) {
+    _frames_dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  Slot& slot = _slots[head % _slots.size()];
+  if(size > slot.capacity) {
+    slot.data.reset(new uint8_t[size]);
+    slot.capacity = size;
+  }
+
+  std::memcpy(slot.data.get(), data, size);
+  slot.size = size;
+  slot.record = record;
+
+  _head.store(head + 1, std::memory_order_release);
+  _wake.fetch_add(1, std::memory_order_release);
+  _wake.notify_one();
+
+  return true;
+}
+
+void BitstreamRecorder::write_loop()
+{
+  std::array<iovec, MAX_BATCH> iov;
+  std::array<BitstreamIndexRecord, MAX_BATCH> records;
+  uint64_t file_size = 0;
+  // Once a frame did not fit, none after it is written : the recording
+  // stops there rather than go on with a hole the decoder can not cross
+  bool full = false;
+
+  while(true) {
+    uint32_t wake = _wake.load(std::memory_order_acquire);
+    uint64_t tail = _tail.load(std::memory_order_relaxed);
+    uint64_t head = _head.load(std::memory_order_acquire);
+
+    if(head == tail) {
+      if(!_running) break;
+      _wake.wait(wake, std::memory_order_acquire);
+      continue;
+    }
+
+    size_t count = std::min<uint64_t>(head - tail, MAX_BATCH);
+    size_t batch = 0;
+    size_t bytes = 0;
+
+    for(size_t i = 0; i < count; ++i) {
+      Slot& slot = _slots[(tail + i) % _slots.size()];
+
+      if(full || (_config.max_file_size && file_size + bytes + slot.size > _config.max_file_size)) {
+	full = true;
+	_frames_truncated.fetch_add(1, std::memory_order_relaxed);
+	continue;
+      }
+
+      records[batch] = slot.record;
+      records[batch].offset = file_size + bytes;
+      records[batch].size = static_cast<uint32_t>(slot.size);
+
+      iov[batch++] = iovec{ slot.data.get(), slot.size };
+      bytes += slot.size;
+    }
+
+    // Partial writes: advance through the iovec array until everything is out
+    size_t first = 0;
+    size_t written = 0;
+    while(first < batch) {
+      ssize_t n = ::writev(_fd, iov.data() + first, static_cast<int>(batch - first));
+      if(n < 0) {
+	if(errno == EINTR) continue;
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Bitstream write failed : " << std::strerror(errno);
+	break;
+      }
+
+      auto left = static_cast<size_t>(n);
+      written += left;
+      while(first < batch && left >= iov[first].iov_len) left -= iov[first++].iov_len;
+      if(first < batch) {
+	iov[first].iov_base = static_cast<uint8_t*>(iov[first].iov_base) + left;
+	iov[first].iov_len -= left;
+      }
+    }
+
+    // Index only the frames that made it completely to the bitstream
+    if(first > 0) {
+      size_t len = first * sizeof(BitstreamIndexRecord);
+      if(::write(_index_fd, records.data(), len) != static_cast<ssize_t>(len)) {
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Bitstream index write failed : " << std::strerror(errno);
+      }
+    }
+
+    file_size += written;
+    _frames_written.fetch_add(first, std::memory_order_relaxed);
+    _frames_dropped.fetch_add(batch - first, std::memory_order_relaxed);
+    _bytes_written.fetch_add(written, std::memory_order_relaxed);
+
+    // Give the slots back to the producer
+    _tail.store(tail + count, std::memory_order_release);
+  }
+}
+
+BitstreamRecorder::Counters BitstreamRecorder::counters() const
+{
+  return {
+    _frames_written.load(std::memory_order_relaxed),
+    _bytes_written.load(std::memory_order_relaxed),
+    _frames_dropped.load(std::memory_order_relaxed),
+    _frames_truncated.load(std::memory_order_relaxed)
+  };
+}
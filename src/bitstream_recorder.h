@@ -0,0 +1,83 @@
+#ifndef BITSTREAM_RECORDER_H
+#define BITSTREAM_RECORDER_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+
+#include "bitstream_index.h"
+
+// Records encoded frames to disk without blocking the thread delivering them.
+// Frames are copied into a preallocated ring of buffers (single producer) and
+// a background thread writes them in batches with writev. When the ring is
+// full frames are dropped and accounted, once a frame would go past the max
+// file size the recording stops there and every later frame is truncated.
+// Each written frame also gets a record in the <path>.idx binary index.
+class BitstreamRecorder
+{
+public:
+  struct Config
+  {
+    size_t slots = 256;
+    size_t slot_size = 256 * 1024; // grows for bigger frames, then reused
+    size_t max_file_size = 0;      // 0 is unlimited
+  };
+
+  struct Counters
+  {
+    uint64_t frames_written;
+    uint64_t bytes_written;
+    uint64_t frames_dropped;    // ring full
+    uint64_t frames_truncated;  // from the first frame past the max file size
+  };
+
+  BitstreamRecorder();
+  explicit BitstreamRecorder(Config config);
+  ~BitstreamRecorder();
+
+  bool open(const std::filesystem::path& path);
+  // Writes everything still queued and stops the writer
+  void close();
+  bool is_open() const { return _fd >= 0; }
+
+  // Applies from the next open()
+  void set_max_file_size(size_t size) { _config.max_file_size = size; }
+
+  // Producer side, never blocks. Returns false if the frame was dropped.
+  // offset and size of the record are filled by the writer.
+  bool push(const uint8_t* data, size_t size, const BitstreamIndexRecord& record);
+
+  Counters counters() const;
+
+private:
+  struct Slot
+  {
+    std::unique_ptr<uint8_t[]> data;
+    size_t capacity = 0;
+    size_t size = 0;
+    BitstreamIndexRecord record;
+  };
+
+  Config            _config;
+  std::vector<Slot> _slots;
+  int               _fd = -1;
+  int               _index_fd = -1;
+  std::thread       _writer;
+  std::atomic_bool  _running = false;
+
+  std::atomic<uint64_t> _head{0}; // next slot to fill, producer
+  std::atomic<uint64_t> _tail{0}; // next slot to write, writer
+  std::atomic<uint32_t> _wake{0};
+
+  std::atomic<uint64_t> _frames_written{0};
+  std::atomic<uint64_t> _bytes_written{0};
+  std::atomic<uint64_t> _frames_dropped{0};
+  std::atomic<uint64_t> _frames_truncated{0};
+
+  void write_loop();
+};
+
+#endif /* BITSTREAM_RECORDER_H */
@@ -0,0 +1,202 @@
+#include "bitstream_replay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <api/video/encoded_image.h>
+#include <api/video/video_codec_type.h>
+#include <api/video_codecs/builtin_video_decoder_factory.h>
+#include <api/video_codecs/sdp_video_format.h>
+#include <api/video_codecs/video_codec.h>
+#include <modules/video_coding/include/video_error_codes.h>
+#include <rtc_base/time_utils.h>
+
+#include "nlohmann/json.hpp"
+
+#include "tunnel_loggin.h"
+
+BitstreamReplay::BitstreamReplay(std::filesystem::path bitstream)
+  : _bitstream(std::move(bitstream)), _factory(webrtc::CreateBuiltinVideoDecoderFactory())
+{
+}
+
+BitstreamReplay::~BitstreamReplay()
+{
+  if(_decoder) _decoder->Release();
+  if(_fd >= 0) ::close(_fd);
+}
+
+bool BitstreamReplay::open()
+{
+  auto index_path = _bitstream;
+  index_path += ".idx";
+
+  if(!_index.open(index_path)) return false;
+
+  _fd = ::open(_bitstream.c_str(), O_RDONLY | O_CLOEXEC);
+  if(_fd < 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << _bitstream.string() << " : " << std::strerror(errno);
+    return false;
+  }
+
+  if(_index.size() == 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "No frame recorded in " << _bitstream.string();
+    return false;
+  }
+
+  return true;
+}
+
+bool BitstreamReplay::create_decoder(uint8_t codec)
+{
+  auto type = static_cast<webrtc::VideoCodecType>(codec);
+  webrtc::SdpVideoFormat format(webrtc::CodecTypeToPayloadString(type));
+
+  _decoder = _factory->CreateVideoDecoder(format);
+  if(!_decoder) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "No decoder for " << format.name;
+    return false;
+  }
+
+  webrtc::VideoDecoder::Settings settings;
+  settings.set_codec_type(type);
+  settings.set_number_of_cores(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+
+  if(!_decoder->Configure(settings)) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not configure the " << format.name << " decoder";
+    _decoder = nullptr;
+    return false;
+  }
+
+  _decoder->RegisterDecodeCompleteCallback(this);
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Replay decoder : " << _decoder->GetDecoderInfo().implementation_name;
+  return true;
+}
+
+bool BitstreamReplay::run(Timing timing)
+{
+  if(!open() || !create_decoder(_index[0].codec)) return false;
+
+  _report = Report{};
+  _decode_time.reset();
+  tracer.reset();
+  if(quality) quality->reset();
+
+  // The first stream only, like the single video track of a live session
+  uint32_t ssrc = _index[0].ssrc;
+  uint64_t first_arrival = _index[0].arrival_ns;
+  bool waiting_key_frame = false;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for(auto& record : _index) {
+    if(record.ssrc != ssrc) {
+      ++_report.ignored;
+      continue;
+    }
+
+    // A decoder that failed can only start again from a key frame
+    if(waiting_key_frame && !record.key_frame) {
+      ++_report.skipped;
+      continue;
+    }
+
+    if(timing == Timing::ORIGINAL) {
+      std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.arrival_ns - first_arrival));
+    }
+
+    _buffer.resize(record.size);
+    if(::pread(_fd, _buffer.data(), record.size, static_cast<off_t>(record.offset)) != static_cast<ssize_t>(record.size)) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Truncated bitstream " << _bitstream.string() << " at frame " << _report.frames;
+      break;
+    }
+
+    webrtc::EncodedImage image;
+    image.SetEncodedData(webrtc::EncodedImageBuffer::Create(_buffer.data(), _buffer.size()));
+    image.SetRtpTimestamp(record.rtp_timestamp);
+    image._frameType = record.key_frame ? webrtc::VideoFrameType::kVideoFrameKey : webrtc::VideoFrameType::kVideoFrameDelta;
+
+    tracer.mark(FrameTracer::Stage::RECEIVED, record.rtp_timestamp);
+    ++_report.frames;
+
+    _decode_start_us = rtc::TimeMicros();
+    int32_t result = _decoder->Decode(image, false, 0);
+
+    if(result < WEBRTC_VIDEO_CODEC_OK) {
+      ++_report.errors;
+      waiting_key_frame = true;
+      TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "Decode error " << result << " on frame " << record.frame_id;
+    }
+    else {
+      waiting_key_frame = false;
+    }
+  }
+
+  _report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  _report.fps = _report.seconds > 0. ? _report.decoded / _report.seconds : 0.;
+  _report.decode_p50 = _decode_time.percentile(0.5);
+  _report.decode_p95 = _decode_time.percentile(0.95);
+  _report.decode_p99 = _decode_time.percentile(0.99);
+  _report.decode_max = _decode_time.max();
+
+  if(quality) quality->drain();
+
+  return true;
+}
+
+int32_t BitstreamReplay::Decoded(webrtc::VideoFrame& frame)
+{
+  _decode_time.record(rtc::TimeMicros() - _decode_start_us);
+  ++_report.decoded;
+
+  tracer.OnFrame(frame);
+  if(quality) quality->OnFrame(frame);
+  if(video_sink) video_sink->OnFrame(frame);
+
+  return WEBRTC_VIDEO_CODEC_OK;
+}
+
+void BitstreamReplay::log() const
+{
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Replay " << _bitstream.string() << " : " << _report.decoded << "/" << _report.frames
+					    << " frames decoded in " << _report.seconds << " s, " << _report.fps << " fps, errors : "
+					    << _report.errors << ", skipped : " << _report.skipped << ", other streams : " << _report.ignored;
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Replay decode time (us) : p50=" << _report.decode_p50 << " p95=" << _report.decode_p95
+					    << " p99=" << _report.decode_p99 << " max=" << _report.decode_max;
+  tracer.log();
+  if(quality) quality->log();
+}
+
+bool BitstreamReplay::write_report(const std::filesystem::path& path) const
+{
+  nlohmann::json report{
+    { "bitstream", _bitstream.string() },
+    { "frames", _report.frames },
+    { "decoded", _report.decoded },
+    { "errors", _report.errors },
+    { "skipped", _report.skipped },
+    { "ignored", _report.ignored },
+    { "seconds", _report.seconds },
+    { "fps", _report.fps },
+    { "decode", { { "p50", _report.decode_p50 }, { "p95", _report.decode_p95 }, { "p99", _report.decode_p99 }, { "max", _report.decode_max } } }
+  };
+
+  if(quality) report["quality"] = quality->to_json();
+
+  std::ofstream out(path);
+  if(!out.is_open()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << path.string();
+    return false;
+  }
+
+  out << report.dump(2) << "\n";
+  return true;
+}
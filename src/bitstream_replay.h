@@ -0,0 +1,83 @@
+#ifndef BITSTREAM_REPLAY_H
+#define BITSTREAM_REPLAY_H
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+#include <api/video_codecs/video_decoder.h>
+#include <api/video_codecs/video_decoder_factory.h>
+
+#include "bitstream_index.h"
+#include "frame_tracer.h"
+#include "latency_histogram.h"
+#include "quality_scorer.h"
+
+// Decodes a bitstream recorded by PeerconnectionMgr (see BitstreamRecorder)
+// with the builtin decoder factory, the one of the live peerconnection, and
+// hands the frames to the same sinks : the frame tracer and video_sink.
+// Frames go either at their recorded arrival times or as fast as the
+// decoder takes them, so decoder cost can be measured without the network
+// and a problem session replayed as it was received.
+class BitstreamReplay : public webrtc::DecodedImageCallback
+{
+public:
+  enum class Timing : uint8_t { ORIGINAL, FAST };
+
+  struct Report
+  {
+    uint64_t frames = 0;    // handed to the decoder
+    uint64_t decoded = 0;
+    uint64_t errors = 0;    // Decode() failures
+    uint64_t skipped = 0;   // delta frames after an error, until the next key frame
+    uint64_t ignored = 0;   // other streams of the recording
+    double   seconds = 0.;
+    double   fps = 0.;      // decoded frames per second of replay
+    uint64_t decode_p50 = 0; // Decode() call to decoded frame, us
+    uint64_t decode_p95 = 0;
+    uint64_t decode_p99 = 0;
+    uint64_t decode_max = 0;
+  };
+
+  rtc::VideoSinkInterface<webrtc::VideoFrame>* video_sink = nullptr;
+  // Scores the decoded frames too if set, its result goes in the report
+  QualityScorer* quality = nullptr;
+
+  // Decoded and presented stages of the replay
+  FrameTracer tracer;
+
+  // Index at <bitstream>.idx
+  explicit BitstreamReplay(std::filesystem::path bitstream);
+  ~BitstreamReplay();
+
+  // False if the recording can not be read or has no decoder
+  bool run(Timing timing);
+
+  const Report& report() const { return _report; }
+  void log() const;
+  bool write_report(const std::filesystem::path& path) const;
+
+  int32_t Decoded(webrtc::VideoFrame& frame) override;
+
+private:
+  std::filesystem::path _bitstream;
+  int                   _fd = -1;
+  BitstreamIndexView    _index;
+  std::vector<uint8_t>  _buffer;
+
+  std::unique_ptr<webrtc::VideoDecoderFactory> _factory;
+  std::unique_ptr<webrtc::VideoDecoder>        _decoder;
+
+  // Decode() start of the frame being decoded, the builtin decoders call back before returning
+  int64_t          _decode_start_us = 0;
+  LatencyHistogram _decode_time;
+  Report           _report;
+
+  bool open();
+  bool create_decoder(uint8_t codec);
+};
+
+#endif /* BITSTREAM_REPLAY_H */
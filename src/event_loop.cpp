@@ -0,0 +1,48 @@
+#include "event_loop.h"
+
+#include "tunnel_loggin.h"
+
+size_t EventLoop::_default_threads = 2;
+
+EventLoop::EventLoop(size_t threads) : _work(asio::make_work_guard(_context))
+{
+  if(threads == 0) threads = 1;
+
+  for(size_t i = 0; i < threads; ++i) {
+    _threads.emplace_back([this]() {
+      // Handlers should not throw, but do not let one kill the loop
+      while(true) {
+	try {
+	  _context.run();
+	  break;
+	}
+	catch(const std::exception& e) {
+	  TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Event loop handler exception : " << e.what();
+	}
+      }
+    });
+  }
+}
+
+EventLoop::~EventLoop()
+{
+  stop();
+}
+
+void EventLoop::stop()
+{
+  _work.reset();
+  _context.stop();
+
+  for(auto& th : _threads) {
+    if(th.joinable()) th.join();
+  }
+
+  _threads.clear();
+}
+
+EventLoop& EventLoop::get()
+{
+  static EventLoop loop(_default_threads);
+  return loop;
+}
@@ -0,0 +1,42 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <thread>
+#include <vector>
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <asio/io_context.hpp>
+#include <asio/executor_work_guard.hpp>
+
+// asio io_context served by a small pool of threads, shared by every
+// websocket connection instead of one io thread per connection.
+class EventLoop
+{
+  asio::io_context                                          _context;
+  asio::executor_work_guard<asio::io_context::executor_type> _work;
+  std::vector<std::thread>                                  _threads;
+
+  static size_t _default_threads;
+
+public:
+  explicit EventLoop(size_t threads = 2);
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  asio::io_context& context() { return _context; }
+  bool in_loop_thread() { return _context.get_executor().running_in_this_thread(); }
+
+  void stop();
+
+  // Process wide loop used by default, created on first use
+  static EventLoop& get();
+  // Pool size of the default loop, before its first use
+  static void set_default_threads(size_t threads) { _default_threads = threads; }
+};
+
+#endif /* EVENT_LOOP_H */
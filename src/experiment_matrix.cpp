@@ -0,0 +1,201 @@
+#include "experiment_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+  using json = nlohmann::json;
+
+  const char* mode_name(bool datagrams) { return datagrams ? "dgram" : "stream"; }
+
+  bool listed(const std::vector<std::string>& list, const std::string& value)
+  {
+    return list.empty() || std::ranges::find(list, value) != list.end();
+  }
+
+  ExperimentMatrix::Endpoint endpoint(const json& j, const char* name)
+  {
+    ExperimentMatrix::Endpoint e;
+    if(auto it = j.find(name); it != j.end()) {
+      e.host = it->at("host").get<std::string>();
+      e.port = it->at("port").get<int>();
+    }
+    return e;
+  }
+
+  std::optional<std::string> optional_string(const json& j, const char* key)
+  {
+    if(auto it = j.find(key); it != j.end()) return it->get<std::string>();
+    return std::nullopt;
+  }
+}
+
+bool ExperimentMatrix::Exclusion::matches(const ExperimentJob& job) const
+{
+  return (!impl || *impl == job.impl)
+    && (!cc || *cc == job.cc)
+    && (!mode || *mode == mode_name(job.datagrams))
+    && (!schedule || *schedule == job.schedule);
+}
+
+ExperimentMatrix ExperimentMatrix::load(const std::filesystem::path& path)
+{
+  std::ifstream file(path);
+  if(!file) throw std::runtime_error("can not open " + path.string());
+
+  try {
+    auto m = from_json(json::parse(file, nullptr, true, true));
+
+    for(auto& schedule : m.schedules) {
+      if(schedule.trace.empty()) continue;
+
+      if(schedule.trace.is_relative()) schedule.trace = path.parent_path() / schedule.trace;
+      if(!std::filesystem::is_regular_file(schedule.trace)) throw std::runtime_error("no trace " + schedule.trace.string());
+    }
+
+    return m;
+  }
+  catch(const std::exception& e) {
+    throw std::runtime_error(path.string() + " : " + e.what());
+  }
+}
+
+ExperimentMatrix ExperimentMatrix::from_json(const json& j)
+{
+  try {
+    return parse(j);
+  }
+  catch(const json::exception& e) {
+    throw std::runtime_error(std::string("invalid experiment matrix : ") + e.what());
+  }
+}
+
+ExperimentMatrix ExperimentMatrix::parse(const json& j)
+{
+  ExperimentMatrix m;
+
+  if(auto endpoints = j.find("endpoints"); endpoints != j.end()) {
+    m.medooze = endpoint(*endpoints, "medooze");
+    m.client = endpoint(*endpoints, "client");
+    m.server = endpoint(*endpoints, "server");
+
+    if(auto medooze = endpoints->find("medooze"); medooze != endpoints->end()) {
+      if(medooze->contains("probing")) m.probing = medooze->at("probing").get<bool>();
+      if(medooze->contains("probing_bitrate")) m.probing_bitrate = medooze->at("probing_bitrate").get<int>();
+    }
+
+    if(auto quic = endpoints->find("quic"); quic != endpoints->end()) {
+      m.quic_host = quic->at("host").get<std::string>();
+      m.quic_in_port = quic->at("in_port").get<int>();
+      m.quic_out_port = quic->value("out_port", m.quic_in_port);
+    }
+  }
+
+  m.impls = j.value("impls", std::vector<std::string>{});
+  m.cc = j.value("cc", std::vector<std::string>{});
+  m.modes = j.value("modes", std::vector<std::string>{});
+  m.repetitions = j.value("repetitions", 1);
+
+  if(j.contains("bitstream_max_size")) m.bitstream_max_size = j.at("bitstream_max_size").get<size_t>();
+  if(j.contains("stats_interval_ms")) {
+    m.stats_interval = std::chrono::milliseconds(j.at("stats_interval_ms").get<int>());
+    if(m.stats_interval->count() < 10) throw std::runtime_error("stats_interval_ms below 10");
+  }
+
+  for(auto& mode : m.modes) {
+    if(mode != "dgram" && mode != "stream") throw std::runtime_error("unknown mode " + mode);
+  }
+
+  for(auto& js : j.at("schedules")) {
+    Schedule schedule;
+    schedule.name = js.at("name").get<std::string>();
+
+    if(auto trace = js.find("trace"); trace != js.end()) {
+      schedule.trace = trace->get<std::string>();
+      schedule.trace_options.bin = std::chrono::milliseconds(js.value("bin_ms", schedule.trace_options.bin.count()));
+      schedule.trace_options.delay = js.value("delay", 0);
+      schedule.trace_options.loss = js.value("loss", 0);
+
+      if(schedule.trace_options.bin.count() <= 0) throw std::runtime_error("invalid bin_ms in " + schedule.name);
+
+      m.schedules.push_back(std::move(schedule));
+      continue;
+    }
+
+    for(auto& step : js.at("steps")) {
+      if(step.is_null()) {
+	schedule.steps.push_back(std::nullopt);
+	continue;
+      }
+
+      auto [seconds, bitrate, delay, loss] = step.get<std::tuple<double, int, int, int>>();
+      auto time = std::chrono::milliseconds(std::llround(seconds * 1000));
+
+      if(time.count() <= 0 || bitrate < 0 || delay < 0 || loss < 0 || loss > 100) {
+	throw std::runtime_error("invalid step " + step.dump() + " in " + schedule.name);
+      }
+      schedule.steps.push_back(std::make_tuple(time, bitrate, delay, loss));
+    }
+
+    m.schedules.push_back(std::move(schedule));
+  }
+
+  if(m.schedules.empty()) throw std::runtime_error("no schedule");
+
+  if(auto exclude = j.find("exclude"); exclude != j.end()) {
+    for(auto& je : *exclude) {
+      m.exclusions.push_back(Exclusion{
+	  optional_string(je, "impl"),
+	  optional_string(je, "cc"),
+	  optional_string(je, "mode"),
+	  optional_string(je, "schedule")
+	});
+    }
+  }
+
+  return m;
+}
+
+std::vector<ExperimentJob> ExperimentMatrix::expand(const std::vector<messages::Capabilities>& caps) const
+{
+  std::vector<ExperimentJob> jobs;
+
+  for(int r = 0; r < repetitions; ++r) {
+    for(auto& schedule : schedules) {
+      for(auto& cap : caps) {
+	if(!listed(impls, cap.impl)) continue;
+
+	for(bool datagrams : { true, false }) {
+	  if((datagrams && !cap.datagrams) || (!datagrams && !cap.streams)) continue;
+	  if(!listed(modes, mode_name(datagrams))) continue;
+
+	  for(auto& cc_name : cap.cc) {
+	    if(!listed(cc, cc_name)) continue;
+
+	    ExperimentJob job{
+		      0, schedule.name, r, cap.impl, cc_name, datagrams, schedule.steps, schedule.trace, schedule.trace_options
+		    };
+	    if(std::ranges::any_of(exclusions, [&job](auto& e) { return e.matches(job); })) continue;
+
+	    job.index = jobs.size();
+	    jobs.push_back(std::move(job));
+	  }
+	}
+      }
+    }
+  }
+
+  return jobs;
+}
+
+std::vector<ExperimentJob> ExperimentMatrix::shard(const std::vector<ExperimentJob>& jobs, size_t index, size_t count)
+{
+  std::vector<ExperimentJob> shard;
+  if(count == 0) return shard;
+
+  std::ranges::copy_if(jobs, std::back_inserter(shard), [index, count](auto& job) { return job.index % count == index; });
+  return shard;
+}
@@ -0,0 +1,130 @@
+#ifndef EXPERIMENT_MATRIX_H
+#define EXPERIMENT_MATRIX_H
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <filesystem>
+
+#include "nlohmann/json.hpp"
+
+#include "messages.h"
+#include "link_trace.h"
+
+// One configuration to run : a schedule over an impl/cc/mode, as many
+// start/run as the schedule has runs.
+struct ExperimentJob
+{
+  size_t                      index;      // in the full matrix
+  std::string                 schedule;   // experiment name
+  int                         repetition;
+  std::string                 impl;
+  std::string                 cc;
+  bool                        datagrams;
+  std::vector<LinkConstraint> steps;
+  // Instead of steps when not empty, a single run
+  std::filesystem::path       trace;
+  LinkTrace::Options          trace_options;
+};
+
+// Campaign description, loaded from a file like :
+//
+// {
+//   "endpoints": {
+//     "medooze": { "host": "192.168.1.30", "port": 8084, "probing": true, "probing_bitrate": 2000 },
+//     "client":  { "host": "192.168.1.30", "port": 3333 },
+//     "server":  { "host": "192.168.1.47", "port": 3334 },
+//     "quic":    { "host": "192.168.1.47", "in_port": 8888, "out_port": 8888 }
+//   },
+//   "impls": [ "mvfst", "quicgo" ],     // optional, every capability otherwise
+//   "cc": [ "newreno", "bbr" ],        // optional, idem
+//   "modes": [ "dgram", "stream" ],    // optional, idem
+//   "schedules": [
+//     { "name": "stats_line_bitrate", "steps": [ [30, 1000, 0, 0], [30, 500, 0, 0], null, [30, 2500, 0, 0] ] },
+//     { "name": "burst", "steps": [ [10, 2500, 0, 0], [0.25, 300, 0, 0], [10, 2500, 0, 0] ] },
+//     { "name": "lte_drive", "trace": "traces/lte_drive.csv" },
+//     { "name": "wifi", "trace": "traces/wifi.mahi", "bin_ms": 50, "delay": 20, "loss": 0 }
+//   ],
+//   "repetitions": 10,
+//   "bitstream_max_size": 500000000,   // optional, bytes per run, 0 unlimited
+//   "stats_interval_ms": 100,          // optional, GetStats period
+//   "exclude": [ { "impl": "quiche" }, { "impl": "udp", "mode": "stream" } ]
+// }
+//
+// Steps are [seconds, kbps, delay ms, loss %], seconds with a millisecond
+// resolution. A null step ends a run, the next steps are a new run. A trace
+// schedule is one run streaming the file, see link_trace.h, its path
+// relative to the description file. An exclusion
+// removes the jobs matching all of its fields (impl, cc, mode, schedule).
+//
+// Jobs are expanded in a fixed order (repetition, schedule, then impl, mode
+// and cc in the order of the capabilities) so every process given the same
+// file and talking to the same tunnel ends gets the same list, and can run
+// its shard of it.
+class ExperimentMatrix
+{
+public:
+  using json = nlohmann::json;
+
+  struct Endpoint
+  {
+    std::string host;
+    int         port = 0;
+  };
+
+  struct Schedule
+  {
+    std::string                 name;
+    std::vector<LinkConstraint> steps;
+    std::filesystem::path       trace;
+    LinkTrace::Options          trace_options;
+  };
+
+  struct Exclusion
+  {
+    std::optional<std::string> impl;
+    std::optional<std::string> cc;
+    std::optional<std::string> mode;
+    std::optional<std::string> schedule;
+
+    bool matches(const ExperimentJob& job) const;
+  };
+
+  // Empty host : not set in the file
+  Endpoint    medooze;
+  Endpoint    client;
+  Endpoint    server;
+  std::string quic_host;
+  int         quic_in_port = 0;
+  int         quic_out_port = 0;
+
+  std::optional<bool> probing;
+  std::optional<int>  probing_bitrate;
+
+  // Receiver settings, the command line's take precedence
+  std::optional<size_t>                    bitstream_max_size;
+  std::optional<std::chrono::milliseconds> stats_interval;
+
+  std::vector<std::string> impls;
+  std::vector<std::string> cc;
+  std::vector<std::string> modes;
+  std::vector<Schedule>    schedules;
+  int                      repetitions = 1;
+  std::vector<Exclusion>   exclusions;
+
+  // Throw std::runtime_error on an unreadable or invalid description
+  static ExperimentMatrix load(const std::filesystem::path& path);
+  static ExperimentMatrix from_json(const json& j);
+
+  std::vector<ExperimentJob> expand(const std::vector<messages::Capabilities>& caps) const;
+
+  // Jobs index % count == index
+  static std::vector<ExperimentJob> shard(const std::vector<ExperimentJob>& jobs, size_t index, size_t count);
+
+private:
+  static ExperimentMatrix parse(const json& j);
+};
+
+#endif /* EXPERIMENT_MATRIX_H */
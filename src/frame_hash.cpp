@@ -0,0 +1,18 @@
+#include "frame_hash.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+uint64_t hash_plane(const uint8_t* data, int stride, int width, int height)
+{
+  if(stride == width) return XXH3_64bits(data, static_cast<size_t>(width) * height);
+
+  XXH3_state_t state;
+  XXH3_64bits_reset(&state);
+
+  for(int r = 0; r < height; ++r) {
+    XXH3_64bits_update(&state, data + static_cast<size_t>(r) * stride, width);
+  }
+
+  return XXH3_64bits_digest(&state);
+}
@@ -0,0 +1,10 @@
+#ifndef FRAME_HASH_H
+#define FRAME_HASH_H
+
+#include <cstdint>
+
+// Fast 64 bit hash of an image plane, row by row so the stride padding is
+// ignored. XXH3, from the xxhash.h vendored in external/xxhash.
+uint64_t hash_plane(const uint8_t* data, int stride, int width, int height);
+
+#endif /* FRAME_HASH_H */
@@ -0,0 +1,80 @@
+#ifndef FRAME_MAILBOX_H
+#define FRAME_MAILBOX_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer triple buffer.
+// The producer always owns one slot to write into and the consumer one slot to
+// read from, the third one is swapped atomically between them. Publishing a new
+// frame before the previous one was taken overwrites (coalesces) it, so the
+// consumer always gets the latest frame and nothing is ever queued.
+template<typename T>
+class FrameMailbox
+{
+  static constexpr uint8_t INDEX_MASK = 0x3;
+  static constexpr uint8_t FRESH = 0x4;
+
+  std::array<T, 3>     _slots;
+  uint8_t              _back = 0;   // producer side only
+  uint8_t              _front = 1;  // consumer side only
+  std::atomic<uint8_t> _middle{2};
+
+  std::atomic<uint64_t> _published{0};
+  std::atomic<uint64_t> _coalesced{0};
+  std::atomic<uint64_t> _presented{0};
+
+public:
+  struct Counters
+  {
+    uint64_t published;
+    uint64_t coalesced;
+    uint64_t presented;
+  };
+
+  // Producer: slot to fill before calling publish()
+  T& back() { return _slots[_back]; }
+
+  // Producer: make the back slot the latest frame.
+  // Returns false if it replaced a frame the consumer never took.
+  bool publish()
+  {
+    uint8_t prev = _middle.exchange(_back | FRESH, std::memory_order_acq_rel);
+    _back = prev & INDEX_MASK;
+    _published.fetch_add(1, std::memory_order_relaxed);
+
+    if(prev & FRESH) {
+      _coalesced.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    return true;
+  }
+
+  // Consumer: grab the latest published frame if there is a new one.
+  bool take()
+  {
+    if(!(_middle.load(std::memory_order_acquire) & FRESH)) return false;
+
+    uint8_t prev = _middle.exchange(_front, std::memory_order_acq_rel);
+    _front = prev & INDEX_MASK;
+    _presented.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+  }
+
+  // Consumer: last taken frame
+  const T& front() const { return _slots[_front]; }
+
+  Counters counters() const
+  {
+    return {
+      _published.load(std::memory_order_relaxed),
+      _coalesced.load(std::memory_order_relaxed),
+      _presented.load(std::memory_order_relaxed)
+    };
+  }
+};
+
+#endif /* FRAME_MAILBOX_H */
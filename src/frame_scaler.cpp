@@ -0,0 +1,58 @@
+#include "frame_scaler.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "libyuv/planar_functions.h"
+#include "libyuv/scale_argb.h"
+
+FrameScaler::Rect FrameScaler::fit(int src_width, int src_height, int dst_width, int dst_height)
+{
+  Rect rect;
+
+  if(src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0) return rect;
+
+  // Compare aspect ratios without floating point
+  if(static_cast<int64_t>(dst_width) * src_height <= static_cast<int64_t>(dst_height) * src_width) {
+    rect.width = dst_width;
+    rect.height = static_cast<int>(static_cast<int64_t>(dst_width) * src_height / src_width);
+  }
+  else {
+    rect.width = static_cast<int>(static_cast<int64_t>(dst_height) * src_width / src_height);
+    rect.height = dst_height;
+  }
+
+  rect.width = std::max(rect.width, 1);
+  rect.height = std::max(rect.height, 1);
+  rect.x = (dst_width - rect.width) / 2;
+  rect.y = (dst_height - rect.height) / 2;
+
+  return rect;
+}
+
+bool FrameScaler::scale(const ArgbFrame& frame, uint8_t* dst, int dst_stride, int dst_width, int dst_height)
+{
+  if(!frame.data || !dst) return false;
+
+  Rect rect = fit(frame.width, frame.height, dst_width, dst_height);
+  if(rect.width == 0) return false;
+
+  // Borders only need to be cleared when the picture moved
+  if(rect != _last) {
+    std::memset(dst, 0, static_cast<size_t>(dst_stride) * dst_height);
+    _last = rect;
+  }
+
+  uint8_t* origin = dst + rect.y * dst_stride + rect.x * 4;
+
+  if(rect.width == frame.width && rect.height == frame.height) {
+    libyuv::ARGBCopy(frame.data.get(), frame.stride(), origin, dst_stride, rect.width, rect.height);
+  }
+  else {
+    libyuv::ARGBScale(frame.data.get(), frame.stride(), frame.width, frame.height,
+		      origin, dst_stride, rect.width, rect.height,
+		      libyuv::kFilterBilinear);
+  }
+
+  return true;
+}
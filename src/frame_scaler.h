@@ -0,0 +1,35 @@
+#ifndef FRAME_SCALER_H
+#define FRAME_SCALER_H
+
+#include <cstdint>
+
+#include "argb_frame.h"
+
+// Scales ARGB frames into a destination surface with libyuv, keeping the
+// aspect ratio and centering the picture (letterbox / pillarbox).
+class FrameScaler
+{
+public:
+  struct Rect
+  {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool operator==(const Rect&) const = default;
+  };
+
+  static Rect fit(int src_width, int src_height, int dst_width, int dst_height);
+
+  // Returns false if nothing was drawn (empty frame or destination)
+  bool scale(const ArgbFrame& frame, uint8_t* dst, int dst_stride, int dst_width, int dst_height);
+
+  // Force clearing the borders on next scale, i.e. the destination was reallocated
+  void invalidate() { _last = Rect{}; }
+
+private:
+  Rect _last;
+};
+
+#endif /* FRAME_SCALER_H */
@@ -0,0 +1,84 @@
+#include "frame_tracer.h"
+
+#include <rtc_base/time_utils.h>
+
+#include "tunnel_loggin.h"
+
+void FrameTracer::mark(Stage stage, uint32_t rtp_timestamp)
+{
+  int64_t now = rtc::TimeMicros();
+  Entry& entry = _entries[slot(rtp_timestamp)];
+  auto s = static_cast<size_t>(stage);
+
+  if(stage == Stage::RECEIVED) {
+    // New frame takes over the slot
+    for(size_t i = 1; i < STAGES; ++i) entry.time_us[i].store(0, std::memory_order_relaxed);
+    entry.time_us[0].store(now, std::memory_order_relaxed);
+    entry.rtp_timestamp.store(rtp_timestamp, std::memory_order_release);
+    return;
+  }
+
+  // Overwritten slot or frame seen only at a later stage
+  if(entry.rtp_timestamp.load(std::memory_order_acquire) != rtp_timestamp) return;
+
+  // First time only, e.g. the renderer can present a frame twice
+  int64_t expected = 0;
+  if(!entry.time_us[s].compare_exchange_strong(expected, now, std::memory_order_relaxed)) return;
+
+  int64_t received = entry.time_us[0].load(std::memory_order_relaxed);
+  int64_t previous = entry.time_us[s - 1].load(std::memory_order_relaxed);
+
+  switch(stage) {
+  case Stage::TRANSFORMED:
+    _histograms[TRANSFORM].record(now - received);
+    break;
+  case Stage::DECODED:
+    if(previous) _histograms[DECODE].record(now - previous);
+    _histograms[RECEIVE_TO_DECODED].record(now - received);
+    break;
+  case Stage::PRESENTED:
+    if(previous) _histograms[RENDER].record(now - previous);
+    _histograms[RECEIVE_TO_PRESENTED].record(now - received);
+    break;
+  default:
+    break;
+  }
+}
+
+void FrameTracer::reset()
+{
+  for(auto& entry : _entries) {
+    entry.rtp_timestamp = 0;
+    for(auto& t : entry.time_us) t = 0;
+  }
+
+  for(auto& h : _histograms) h.reset();
+}
+
+std::vector<FrameTracer::Summary> FrameTracer::summary() const
+{
+  std::vector<Summary> result;
+  result.reserve(HISTOGRAMS);
+
+  for(size_t i = 0; i < HISTOGRAMS; ++i) {
+    const auto& h = _histograms[i];
+    result.push_back({ _names[i], h.count(), h.percentile(0.5), h.percentile(0.95), h.percentile(0.99), h.max() });
+  }
+
+  return result;
+}
+
+void FrameTracer::log() const
+{
+  for(auto&& s : summary()) {
+    if(s.count == 0) continue;
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Latency " << s.name << " (us) : n=" << s.count
+					      << " p50=" << s.p50 << " p95=" << s.p95
+					      << " p99=" << s.p99 << " max=" << s.max;
+  }
+}
+
+void FrameTracer::OnFrame(const webrtc::VideoFrame& frame)
+{
+  mark(Stage::DECODED, frame.timestamp());
+}
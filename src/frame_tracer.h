@@ -0,0 +1,63 @@
+#ifndef FRAME_TRACER_H
+#define FRAME_TRACER_H
+
+#include <array>
+#include <atomic>
+#include <string_view>
+#include <vector>
+
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+
+#include "latency_histogram.h"
+
+// Per frame timestamps along the receive pipeline, keyed by RTP timestamp:
+// encoded frame in the transformer, handed back to the decoder, decoded and
+// presented. Each stage to stage delay is aggregated per run in a histogram.
+// Also a video sink so it can be attached to the track to see decoded frames.
+class FrameTracer : public rtc::VideoSinkInterface<webrtc::VideoFrame>
+{
+public:
+  enum class Stage : uint8_t { RECEIVED, TRANSFORMED, DECODED, PRESENTED };
+
+  struct Summary
+  {
+    std::string_view name;
+    uint64_t         count;
+    uint64_t         p50;
+    uint64_t         p95;
+    uint64_t         p99;
+    uint64_t         max;
+  };
+
+  void mark(Stage stage, uint32_t rtp_timestamp);
+  void reset();
+
+  // One entry per histogram, in microseconds
+  std::vector<Summary> summary() const;
+  void log() const;
+
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+private:
+  static constexpr size_t STAGES = 4;
+  static constexpr size_t SLOTS = 1024; // a bit more than 30s at 30fps
+
+  struct Entry
+  {
+    std::atomic<uint32_t> rtp_timestamp{0};
+    std::array<std::atomic<int64_t>, STAGES> time_us{};
+  };
+
+  enum Histogram { TRANSFORM, DECODE, RENDER, RECEIVE_TO_DECODED, RECEIVE_TO_PRESENTED, HISTOGRAMS };
+  static constexpr std::array<std::string_view, HISTOGRAMS> _names = {
+    "transform", "decode", "render", "receive_to_decoded", "receive_to_presented"
+  };
+
+  std::array<Entry, SLOTS>                  _entries;
+  std::array<LatencyHistogram, HISTOGRAMS>  _histograms;
+
+  static size_t slot(uint32_t rtp_timestamp) { return (rtp_timestamp * 2654435761u) % SLOTS; }
+};
+
+#endif /* FRAME_TRACER_H */
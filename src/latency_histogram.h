@@ -0,0 +1,89 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+// Online log-linear histogram of microseconds values: 16 linear sub buckets
+// per power of two, so any percentile is within ~6% of the recorded value,
+// in constant memory and with one relaxed increment per sample.
+class LatencyHistogram
+{
+  static constexpr int SUB_BITS = 4;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+  static constexpr int GROUPS = 40 - SUB_BITS + 1; // up to 2^40 us
+  static constexpr int BUCKETS = GROUPS * SUB_BUCKETS;
+
+  std::array<std::atomic<uint64_t>, BUCKETS> _buckets{};
+  std::atomic<uint64_t> _count{0};
+  std::atomic<uint64_t> _max{0};
+
+  static int index(uint64_t value)
+  {
+    if(value < SUB_BUCKETS) return static_cast<int>(value);
+
+    int msb = std::bit_width(value) - 1;
+    int group = msb - SUB_BITS + 1;
+    int sub = static_cast<int>((value >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+
+    if(group >= GROUPS) return BUCKETS - 1;
+    return group * SUB_BUCKETS + sub;
+  }
+
+  // middle of the bucket
+  static uint64_t value(int index)
+  {
+    int group = index / SUB_BUCKETS;
+    uint64_t sub = index % SUB_BUCKETS;
+
+    if(group == 0) return sub;
+
+    uint64_t width = uint64_t{1} << (group - 1);
+    return ((SUB_BUCKETS + sub) << (group - 1)) + width / 2;
+  }
+
+public:
+  void record(int64_t us)
+  {
+    uint64_t v = us > 0 ? static_cast<uint64_t>(us) : 0;
+
+    _buckets[index(v)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while(v > max && !_max.compare_exchange_weak(max, v, std::memory_order_relaxed));
+  }
+
+  // p in [0, 1]
+  uint64_t percentile(double p) const
+  {
+    uint64_t count = _count.load(std::memory_order_relaxed);
+    if(count == 0) return 0;
+
+    uint64_t target = static_cast<uint64_t>(p * count);
+    if(target == 0) target = 1;
+
+    uint64_t cumul = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+      cumul += _buckets[i].load(std::memory_order_relaxed);
+      if(cumul >= target) return std::min(value(i), max());
+    }
+
+    return max();
+  }
+
+  uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+  uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+
+  void reset()
+  {
+    for(auto& b : _buckets) b.store(0, std::memory_order_relaxed);
+    _count = 0;
+    _max = 0;
+  }
+};
+
+#endif /* LATENCY_HISTOGRAM_H */
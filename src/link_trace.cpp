@@ -0,0 +1,191 @@
+#include "link_trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+  // Bits of one Mahimahi delivery opportunity, a 1500 bytes packet
+  constexpr int64_t OPPORTUNITY_BITS = 1500 * 8;
+
+  std::optional<double> parse_number(const std::string& text)
+  {
+    const char* begin = text.c_str();
+    char* end = nullptr;
+    double value = std::strtod(begin, &end);
+
+    while(end && (*end == ' ' || *end == '\t')) ++end;
+    if(end == begin || (end && *end != '\0')) return std::nullopt;
+
+    return value;
+  }
+
+  std::vector<std::string> split(const std::string& line, char separator)
+  {
+    std::vector<std::string> fields;
+    size_t begin = 0;
+
+    while(true) {
+      auto end = line.find(separator, begin);
+      fields.push_back(line.substr(begin, end - begin));
+      if(end == std::string::npos) break;
+      begin = end + 1;
+    }
+
+    return fields;
+  }
+}
+
+LinkTrace::LinkTrace(const std::filesystem::path& path, Options options)
+  : _path(path), _file(path), _options(options)
+{
+  if(!_file) throw std::runtime_error("can not open trace " + path.string());
+  if(_options.bin.count() <= 0) throw std::runtime_error("trace bin must be positive");
+
+  std::string line;
+  if(!read_line(line)) throw std::runtime_error("empty trace " + path.string());
+
+  if(line.find(',') != std::string::npos) {
+    _format = Format::CSV;
+    // Not a number : header
+    if(parse_number(split(line, ',').front())) _pending_line = std::move(line);
+  }
+  else {
+    _format = Format::MAHIMAHI;
+    _pending_line = std::move(line);
+    _next_time = read_timestamp();
+  }
+}
+
+LinkTrace::LinkTrace(const std::filesystem::path& path) : LinkTrace(path, Options{})
+{
+}
+
+bool LinkTrace::read_line(std::string& line)
+{
+  if(!_pending_line.empty()) {
+    line = std::move(_pending_line);
+    _pending_line.clear();
+    return true;
+  }
+
+  while(std::getline(_file, line)) {
+    ++_line;
+
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    if(line.empty() || line.front() == '#') continue;
+
+    return true;
+  }
+
+  if(_file.bad()) throw std::runtime_error("error reading " + _path.string());
+  return false;
+}
+
+std::optional<LinkTrace::Row> LinkTrace::next_csv_row()
+{
+  std::string line;
+  if(!read_line(line)) return std::nullopt;
+
+  auto fields = split(line, ',');
+  std::vector<double> values;
+
+  for(auto& field : fields) {
+    auto value = parse_number(field);
+    if(!value) break;
+    values.push_back(*value);
+  }
+
+  if(fields.size() != 4 || values.size() != 4 || values[0] < 0 || values[1] < 0 || values[2] < 0
+     || values[3] < 0 || values[3] > 100) {
+    throw std::runtime_error(_path.string() + ":" + std::to_string(_line) + " : invalid row " + line);
+  }
+
+  return Row{
+    std::llround(values[0]),
+    static_cast<int>(std::lround(values[1])),
+    static_cast<int>(std::lround(values[2])),
+    static_cast<int>(std::lround(values[3]))
+  };
+}
+
+std::optional<int64_t> LinkTrace::read_timestamp()
+{
+  std::string line;
+  if(!read_line(line)) return std::nullopt;
+
+  auto time = parse_number(line);
+  if(!time || *time < 0) throw std::runtime_error(_path.string() + ":" + std::to_string(_line) + " : invalid timestamp " + line);
+
+  return static_cast<int64_t>(*time);
+}
+
+std::optional<LinkTrace::Row> LinkTrace::next_mahimahi_row()
+{
+  if(!_next_time) return std::nullopt;
+
+  auto bin = _options.bin.count();
+  int64_t bin_start = _bin_index * bin;
+  int64_t bin_end = bin_start + bin;
+  int64_t opportunities = 0;
+
+  for(; _next_time && *_next_time < bin_end; _next_time = read_timestamp()) {
+    if(*_next_time < bin_start) {
+      throw std::runtime_error(_path.string() + ":" + std::to_string(_line) + " : timestamps not sorted");
+    }
+    ++opportunities;
+  }
+
+  ++_bin_index;
+
+  // bits per ms : kbps
+  int bitrate = static_cast<int>(std::max<int64_t>(1, opportunities * OPPORTUNITY_BITS / bin));
+  return Row{ bin_start, bitrate, _options.delay, _options.loss };
+}
+
+std::optional<LinkTrace::Row> LinkTrace::next_row()
+{
+  auto row = _format == Format::CSV ? next_csv_row() : next_mahimahi_row();
+  if(!row) return std::nullopt;
+
+  if(_previous_time) {
+    if(row->time <= *_previous_time) {
+      throw std::runtime_error(_path.string() + ":" + std::to_string(_line) + " : time not increasing");
+    }
+    _last_duration = row->time - *_previous_time;
+  }
+  _previous_time = row->time;
+
+  return row;
+}
+
+std::optional<LinkStep> LinkTrace::next()
+{
+  if(!_current) _current = next_row();
+  if(!_current) return std::nullopt;
+
+  Row row = *_current;
+  int64_t end;
+
+  while(true) {
+    auto following = next_row();
+
+    if(!following) {
+      _current.reset();
+      // The last row as long as the one before it
+      end = *_previous_time + (_last_duration > 0 ? _last_duration : _options.bin.count());
+      break;
+    }
+
+    if(following->bitrate == row.bitrate && following->delay == row.delay && following->loss == row.loss) continue;
+
+    _current = following;
+    end = following->time;
+    break;
+  }
+
+  return LinkStep{ std::chrono::milliseconds(end - row.time), row.bitrate, row.delay, row.loss };
+}
@@ -0,0 +1,88 @@
+#ifndef LINK_TRACE_H
+#define LINK_TRACE_H
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <tuple>
+
+// (duration, bitrate kbps, delay ms, loss %) link step
+using LinkStep = std::tuple<std::chrono::milliseconds, int, int, int>;
+// nullopt ends a run
+using LinkConstraint = std::optional<LinkStep>;
+
+// Streams the steps of a link trace file, read line by line so hours long
+// traces are not loaded in memory. Two formats, told apart by the first
+// data line :
+//
+// CSV, one row per change, the row applies until the next one and the last
+// row as long as the one before it. A header line and # comments are
+// skipped.
+//
+//   time_ms,bitrate_kbps,delay_ms,loss_pct
+//   0,2500,40,0
+//   120,1800,45,0.5
+//
+// Mahimahi, one millisecond timestamp per line at which a 1500 bytes packet
+// can be delivered. Opportunities are counted over bins of `bin` to get the
+// bitrate, delay and loss come from the options. A bin without any
+// opportunity is a 1 kbps outage, 0 would mean no limit to the server.
+//
+// Consecutive steps with the same parameters are merged, in both formats.
+class LinkTrace
+{
+public:
+  struct Options
+  {
+    std::chrono::milliseconds bin{100}; // Mahimahi only
+    int                       delay = 0;
+    int                       loss = 0;
+  };
+
+  enum class Format { CSV, MAHIMAHI };
+
+  // Throw std::runtime_error if the file can not be read
+  LinkTrace(const std::filesystem::path& path, Options options);
+  explicit LinkTrace(const std::filesystem::path& path);
+
+  Format format() const { return _format; }
+
+  // Next step, nullopt at the end of the trace. Throw std::runtime_error on
+  // a malformed line
+  std::optional<LinkStep> next();
+
+private:
+  // bitrate, delay, loss starting at time ms
+  struct Row
+  {
+    int64_t time;
+    int     bitrate;
+    int     delay;
+    int     loss;
+  };
+
+  std::filesystem::path _path;
+  std::ifstream         _file;
+  Options               _options;
+  Format                _format;
+  size_t                _line = 0;
+  std::string           _pending_line; // first data line, read to detect the format
+
+  std::optional<Row>     _current;       // not returned yet
+  std::optional<int64_t> _previous_time;  // of the last row read
+  int64_t                _last_duration = 0;
+
+  // Mahimahi : bin being counted, next delivery opportunity
+  int64_t                _bin_index = 0;
+  std::optional<int64_t> _next_time;
+
+  bool read_line(std::string& line);
+  std::optional<int64_t> read_timestamp();
+  std::optional<Row> next_csv_row();
+  std::optional<Row> next_mahimahi_row();
+  std::optional<Row> next_row();
+};
+
+#endif /* LINK_TRACE_H */
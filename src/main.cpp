@@ -4,17 +4,28 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <array>
+#include <string_view>
+#include <algorithm>
+#include <optional>
+#include <cstdio>
 
+#ifndef QCLIENT_HEADLESS
 #include <gtk/gtk.h>
+#include "main_wnd.h"
+#endif
 
 #include "tunnel_loggin.h"
-#include "tunnel_mgr.h"
-#include "main_wnd.h"
+#include "session_group.h"
+#include "event_loop.h"
+#include "synthetic_sender.h"
+#include "bitstream_replay.h"
+#include "null_sink.h"
+#include "quality_scorer.h"
 
 #define FMT_HEADER_ONLY
 #include <fmt/format.h>
 
-#define T(TIME,BITRATE,DELAY,LOSS) std::make_tuple(TIME,BITRATE,DELAY,LOSS)
+#define T(TIME,BITRATE,DELAY,LOSS) std::make_tuple(std::chrono::seconds(TIME),BITRATE,DELAY,LOSS)
 
 namespace config
 {
@@ -42,68 +53,413 @@ constexpr const int WS_SERVER_PORT = 3334;
 
 }
 
+#ifndef QCLIENT_HEADLESS
+// Window of the standalone modes below, served by its own GTK thread
+static bool open_window(WindowRenderer& window, FrameTracer* tracer)
+{
+  if(!window.create()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not create window";
+    return false;
+  }
+
+  window.tracer = tracer;
+  std::thread([](){ gtk_main(); }).detach();
+
+  return true;
+}
+
+static void close_window(WindowRenderer& window)
+{
+  gtk_main_quit();
+  window.destroy();
+}
+#endif
+
+// Receiver settings of the command line, over the experiment file's
+struct ReceiverOptions
+{
+  std::optional<size_t>                    bitstream_max_size;
+  std::optional<std::chrono::milliseconds> stats_interval;
+
+  void apply(PeerconnectionMgr& pc) const
+  {
+    if(bitstream_max_size) pc.bitstream_max_size = *bitstream_max_size;
+    if(stats_interval) pc.stats_interval = *stats_interval;
+  }
+};
+
+// Receiver fed by in-process synthetic senders, one load after the other,
+// scored against references of the synthetic frames if quality is set
+static int run_synthetic(const std::vector<SyntheticConfig>& loads, std::chrono::seconds duration, bool headless,
+			 const std::optional<SyntheticSender::Quality>& quality, const ReceiverOptions& options)
+{
+  PeerconnectionMgr::set_loopback(true);
+
+  PeerconnectionMgr pc;
+  options.apply(pc);
+  SyntheticProbe probe;
+  NullSink sink;
+
+  probe.next = &sink;
+  pc.video_sink = &probe;
+
+#ifndef QCLIENT_HEADLESS
+  WindowRenderer window;
+
+  if(!headless) {
+    if(!open_window(window, &pc.tracer)) return EXIT_FAILURE;
+    probe.next = &window;
+  }
+#endif
+
+  auto results = SyntheticSender::run_ladder(pc, probe, loads, duration, quality);
+
+  PeerconnectionMgr::clean();
+
+#ifndef QCLIENT_HEADLESS
+  if(!headless) close_window(window);
+#endif
+
+  TunnelLogging::flush();
+
+  return results.size() == loads.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Recorded bitstream through the decoder and the sinks, no peerconnection.
+// The report goes to <bitstream>.replay.json, and headless the decoded
+// frames to <bitstream>.frames.csv to compare with the live run's
+static int run_replay(const std::filesystem::path& bitstream, BitstreamReplay::Timing timing, bool headless, QualityScorer* quality)
+{
+  BitstreamReplay replay(bitstream);
+  NullSink sink;
+
+  replay.video_sink = &sink;
+  replay.quality = quality;
+
+#ifndef QCLIENT_HEADLESS
+  WindowRenderer window;
+
+  if(!headless) {
+    if(!open_window(window, &replay.tracer)) return EXIT_FAILURE;
+    replay.video_sink = &window;
+  }
+#endif
+
+  bool ok = replay.run(timing);
+
+  if(ok) {
+    replay.log();
+    replay.write_report(bitstream.string() + ".replay.json");
+    if(headless) sink.dump(bitstream.string() + ".frames.csv");
+  }
+
+#ifndef QCLIENT_HEADLESS
+  if(!headless) close_window(window);
+#endif
+
+  TunnelLogging::flush();
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Y4M, or raw I420 if its size is given as WxH@fps
+static std::shared_ptr<ReferenceVideo> open_reference(const std::filesystem::path& path, const std::string& size)
+{
+  auto reference = std::make_shared<ReferenceVideo>();
+  bool ok;
+
+  if(size.empty()) {
+    ok = reference->open(path);
+  }
+  else {
+    int width = 0, height = 0;
+    double fps = 0.;
+
+    if(std::sscanf(size.c_str(), "%dx%d@%lf", &width, &height, &fps) != 3) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "--quality-size expects WxH@fps";
+      return nullptr;
+    }
+
+    ok = reference->open(path, width, height, fps);
+  }
+
+  return ok ? reference : nullptr;
+}
+
 int main(int argc, char *argv[])
 {
-  gtk_init(&argc, &argv);
+#ifdef QCLIENT_HEADLESS
+  bool headless = true;
+#else
+  bool headless = false;
+#endif
+  int sessions = 1;
+  int port_stride = 2;
+  std::optional<ExperimentMatrix> matrix;
+  size_t shard_index = 0;
+  size_t shard_count = 1;
+  bool sharded = false;
+  std::vector<SyntheticConfig> synthetic;
+  std::chrono::seconds synthetic_duration{20};
+  std::optional<std::filesystem::path> replay;
+  auto replay_timing = BitstreamReplay::Timing::FAST;
+  std::optional<std::filesystem::path> quality_ref;
+  std::string quality_size;
+  QualityScorer::Config quality_config;
+  std::optional<std::filesystem::path> synthetic_reference;
+  ReceiverOptions receiver;
+
+  for(int i = 1; i < argc; ++i) {
+    std::string_view arg{argv[i]};
+
+    if(arg == "--headless") headless = true;
+    // Threads serving every websocket connection
+    else if(arg == "--io-threads" && i + 1 < argc) EventLoop::set_default_threads(std::atoi(argv[++i]));
+    // Concurrent receive sessions, session i uses the tunnel ports + i * stride
+    else if(arg == "--sessions" && i + 1 < argc) sessions = std::max(1, std::atoi(argv[++i]));
+    else if(arg == "--port-stride" && i + 1 < argc) port_stride = std::atoi(argv[++i]);
+    // Experiments from a file rather than the ones below, see experiment_matrix.h
+    else if(arg == "--matrix" && i + 1 < argc) {
+      try {
+	matrix = ExperimentMatrix::load(argv[++i]);
+      }
+      catch(const std::exception& e) {
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not load experiments : " << e.what();
+	TunnelLogging::flush();
+	return EXIT_FAILURE;
+      }
+    }
+    // Only run jobs index % n == i of the matrix
+    else if(arg == "--shard" && i + 1 < argc) {
+      if(std::sscanf(argv[++i], "%zu/%zu", &shard_index, &shard_count) != 2 || shard_index >= shard_count) {
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "--shard expects i/n with i < n";
+	TunnelLogging::flush();
+	return EXIT_FAILURE;
+      }
+      sharded = true;
+    }
+    // Bytes recorded per run, the bitstream is cut at the first frame past it
+    else if(arg == "--bitstream-max-size" && i + 1 < argc) receiver.bitstream_max_size = std::strtoull(argv[++i], nullptr, 10);
+    // GetStats period in ms, one sample each
+    else if(arg == "--stats-interval" && i + 1 < argc) receiver.stats_interval = std::chrono::milliseconds(std::max(10, std::atoi(argv[++i])));
+    // In-process sender instead of medooze and the tunnels, repeat for a load ladder
+    else if(arg == "--synthetic" && i + 1 < argc) {
+      auto load = SyntheticConfig::parse(argv[++i]);
+      if(!load) {
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "--synthetic expects WxH@fps:kbps[:codec[:keyint[:complexity]]]";
+	TunnelLogging::flush();
+	return EXIT_FAILURE;
+      }
+      synthetic.push_back(*load);
+    }
+    // Seconds per synthetic load
+    else if(arg == "--synthetic-duration" && i + 1 < argc) synthetic_duration = std::chrono::seconds(std::max(1, std::atoi(argv[++i])));
+    // Write the synthetic frames there as Y4M references and score each load against its own
+    else if(arg == "--synthetic-reference" && i + 1 < argc) synthetic_reference = argv[++i];
+    // Decode a recorded bitstream offline, as fast as possible unless --replay-original
+    else if(arg == "--replay" && i + 1 < argc) replay = argv[++i];
+    // Frames at their recorded arrival times
+    else if(arg == "--replay-original") replay_timing = BitstreamReplay::Timing::ORIGINAL;
+    // Score the decoded frames against a reference sequence, uploaded with the stats
+    else if(arg == "--quality-ref" && i + 1 < argc) quality_ref = argv[++i];
+    // Size of a raw I420 reference, WxH@fps
+    else if(arg == "--quality-size" && i + 1 < argc) quality_size = argv[++i];
+    // Reference frame of a decoded frame : RTP timestamp (default) or the stamp
+    // of a sender drawing it like SyntheticVideoSource, see --synthetic-reference
+    else if(arg == "--quality-match" && i + 1 < argc) {
+      auto match = QualityScorer::parse_match(argv[++i]);
+      if(!match) {
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "--quality-match expects stamp or rtp";
+	TunnelLogging::flush();
+	return EXIT_FAILURE;
+      }
+      quality_config.match = *match;
+    }
+    else if(arg == "--quality-threads" && i + 1 < argc) quality_config.threads = std::max(1, std::atoi(argv[++i]));
+    // RTP matching : reference frame of the first decoded frame, searched otherwise
+    else if(arg == "--quality-offset" && i + 1 < argc) quality_config.offset = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    // RTP matching : reference frames the offset is searched among
+    else if(arg == "--quality-search" && i + 1 < argc) quality_config.align_search = std::max(1, std::atoi(argv[++i]));
+  }
+
+  // Every shard would run the built-in experiments in full
+  if(sharded && !matrix) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "--shard needs --matrix";
+    TunnelLogging::flush();
+    return EXIT_FAILURE;
+  }
+
+#ifndef QCLIENT_HEADLESS
+  if(!headless) {
+    gtk_init(&argc, &argv);
 
 #if !GLIB_CHECK_VERSION(2, 35, 0)
-  g_type_init();
+    g_type_init();
 #endif
-  // g_thread_init API is deprecated since glib 2.31.0, see release note:
-  // http://mail.gnome.org/archives/gnome-announce-list/2011-October/msg00041.html
+    // g_thread_init API is deprecated since glib 2.31.0, see release note:
+    // http://mail.gnome.org/archives/gnome-announce-list/2011-October/msg00041.html
 #if !GLIB_CHECK_VERSION(2, 31, 0)
-  g_thread_init(NULL);
+    g_thread_init(NULL);
+#endif
+  }
 #endif
 
   // rtc::LogMessage::LogToDebug(rtc::LoggingSeverity::TunnelLogging::Severity::INFO);
   
   TunnelLogging::set_min_severity(TunnelLogging::Severity::INFO);
+
+  if(!synthetic.empty() && !replay) {
+    std::optional<SyntheticSender::Quality> quality;
+
+    // What is sent is generated, a reference file given for the live runs does not apply
+    if(quality_ref) {
+      TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "--quality-ref is ignored by --synthetic, use --synthetic-reference DIR";
+    }
+
+    if(synthetic_reference) {
+      std::error_code ec;
+      std::filesystem::create_directories(*synthetic_reference, ec);
+      if(ec) {
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not create " << synthetic_reference->string() << " : " << ec.message();
+	TunnelLogging::flush();
+	return EXIT_FAILURE;
+      }
+
+      quality = SyntheticSender::Quality{ *synthetic_reference, quality_config };
+    }
+
+    return run_synthetic(synthetic, synthetic_duration, headless, quality, receiver);
+  }
+
+  std::shared_ptr<ReferenceVideo> reference;
+  if(quality_ref) {
+    reference = open_reference(*quality_ref, quality_size);
+    if(!reference) {
+      TunnelLogging::flush();
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(replay) {
+    std::optional<QualityScorer> quality;
+    if(reference) quality.emplace(reference, quality_config);
+
+    return run_replay(*replay, replay_timing, headless, quality ? &*quality : nullptr);
+  }
   
-  MedoozeMgr        medooze;
-  PeerconnectionMgr pc;
-  
-  medooze.host = config::medooze_host;
-  medooze.port = config::medooze_port;
-  medooze.probing = config::enable_medooze_bwe;
-  medooze.probing_bitrate = config::medooze_probing;
+  SessionGroup group(sessions, [sessions, port_stride, &matrix](Session& s) {
+    int offset = s.index * port_stride;
+    auto& medooze = s.medooze;
+    auto& tunnel = s.tunnel;
+
+    medooze.host = config::medooze_host;
+    medooze.port = config::medooze_port;
+    medooze.probing = config::enable_medooze_bwe;
+    medooze.probing_bitrate = config::medooze_probing;
   
-  TunnelMgr tunnel(medooze, pc);
-  tunnel.exp_name = "stats_line_loss";
+    tunnel.exp_name = "stats_line_loss";
+    if(sessions > 1) tunnel.tag = fmt::format("s{}", s.index);
   
-  tunnel.in_config.impl = "mvfst";
-  tunnel.in_config.cc = "newreno";
-  tunnel.in_config.datagrams = false;
-  tunnel.in_config.quic_port = config::quic_server_port;
-  tunnel.in_config.quic_host = config::quic_server_host;
-  tunnel.in_config.external_file_transfer = false;
-
-  tunnel.out_config = tunnel.in_config;
-  tunnel.out_config.quic_port = 8888;
-  // tunnel.out_config.impl = "quicgo";
-
-  tunnel.client.host = config::WS_CLIENT_HOST;
-  tunnel.client.port = config::WS_CLIENT_PORT;
-
-  tunnel.server.host = config::WS_SERVER_HOST;
-  tunnel.server.port = config::WS_SERVER_PORT;
+    tunnel.in_config.impl = "mvfst";
+    tunnel.in_config.cc = "newreno";
+    tunnel.in_config.datagrams = false;
+    tunnel.in_config.quic_port = config::quic_server_port + offset;
+    tunnel.in_config.quic_host = config::quic_server_host;
+    tunnel.in_config.external_file_transfer = false;
+
+    tunnel.out_config = tunnel.in_config;
+    tunnel.out_config.quic_port = 8888 + offset;
+    // tunnel.out_config.impl = "quicgo";
+
+    tunnel.client.host = config::WS_CLIENT_HOST;
+    tunnel.client.port = config::WS_CLIENT_PORT + offset;
+
+    tunnel.server.host = config::WS_SERVER_HOST;
+    tunnel.server.port = config::WS_SERVER_PORT + offset;
+
+    if(!matrix) return;
+
+    // Endpoints of the experiment file take precedence
+    if(!matrix->medooze.host.empty()) {
+      medooze.host = matrix->medooze.host;
+      medooze.port = matrix->medooze.port;
+    }
+    if(matrix->probing) medooze.probing = *matrix->probing;
+    if(matrix->probing_bitrate) medooze.probing_bitrate = *matrix->probing_bitrate;
+
+    if(!matrix->client.host.empty()) {
+      tunnel.client.host = matrix->client.host;
+      tunnel.client.port = matrix->client.port + offset;
+    }
+    if(!matrix->server.host.empty()) {
+      tunnel.server.host = matrix->server.host;
+      tunnel.server.port = matrix->server.port + offset;
+    }
+    if(!matrix->quic_host.empty()) {
+      tunnel.in_config.quic_host = matrix->quic_host;
+      tunnel.out_config.quic_host = matrix->quic_host;
+      tunnel.in_config.quic_port = matrix->quic_in_port + offset;
+      tunnel.out_config.quic_port = matrix->quic_out_port + offset;
+    }
+  });
   
-  tunnel.connect();
-  tunnel.query_capabilities();
+  if(!group.connect()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not connect to the tunnel ends";
+    TunnelLogging::flush();
+    return EXIT_FAILURE;
+  }
 
   // tunnel.reset_link();
   // return 0;
   
+#ifndef QCLIENT_HEADLESS
   WindowRenderer window;
-  auto res = window.create();
+#endif
 
-  if(!res) {
-    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not create window";
-    std::exit(EXIT_FAILURE);
+  for(auto& session : group) {
+    auto& s = *session;
+
+    if(matrix && matrix->bitstream_max_size) s.pc.bitstream_max_size = *matrix->bitstream_max_size;
+    if(matrix && matrix->stats_interval) s.pc.stats_interval = *matrix->stats_interval;
+    receiver.apply(s.pc);
+
+    // Every session against the same mapped reference
+    if(reference) {
+      s.quality = std::make_unique<QualityScorer>(reference, quality_config);
+      s.pc.quality = s.quality.get();
+    }
+    
+#ifndef QCLIENT_HEADLESS
+    // The first session is shown, the others are only hashed
+    if(!headless && s.index == 0) continue;
+#endif
+    s.pc.video_sink = &s.sink;
+
+    // One frame record file per run
+    s.tunnel.onstop = [&s]() {
+      s.sink.dump(fmt::format("frames_{}.csv", s.tunnel.run_name()));
+      s.sink.reset();
+    };
   }
 
-  pc.video_sink = &window;
+  if(headless) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Headless mode, frames are only hashed";
+  }
+#ifndef QCLIENT_HEADLESS
+  else {
+    auto res = window.create();
 
-  std::thread([](){ gtk_main(); }).detach();
+    if(!res) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not create window";
+      std::exit(EXIT_FAILURE);
+    }
+
+    group[0].pc.video_sink = &window;
+    window.tracer = &group[0].pc.tracer;
+
+    std::thread([](){ gtk_main(); }).detach();
+  }
+#endif
   
   // std::deque<TunnelMgr::Constraints> constraints_init{T(60, 2500, 50, 5)};
   /*std::deque<TunnelMgr::Constraints> constraints_init{
@@ -159,19 +515,44 @@ int main(int argc, char *argv[])
   //   }
   // }
 
-  tunnel.exp_name = "stats_line_bitrate_2";
-  std::queue<TunnelMgr::Constraints> bitrate_constraints(bitrate_init);
-  tunnel.run_all(repet, bitrate_constraints);
+  if(matrix) {
+    auto jobs = matrix->expand(group[0].tunnel.capabilities());
+    auto shard = ExperimentMatrix::shard(jobs, shard_index, shard_count);
+
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Experiment matrix : " << jobs.size() << " jobs, shard "
+					      << shard_index << "/" << shard_count << " runs " << shard.size();
+    group.run_jobs(shard);
+  }
+  else {
+    for(auto& session : group) session->tunnel.exp_name = "stats_line_bitrate_2";
+    std::queue<TunnelMgr::Constraints> bitrate_constraints(bitrate_init);
+    group.run_all(repet, bitrate_constraints);
+  }
   
-  tunnel.reset_link();
+  group.reset_link();
   std::this_thread::sleep_for(std::chrono::seconds{1});
     
-  tunnel.disconnect();
+  group.disconnect();
+
+#ifndef QCLIENT_HEADLESS
+  if(!headless) {
+    auto counters = window.counters();
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Renderer frames published : " << counters.published
+					      << ", coalesced : " << counters.coalesced
+					      << ", presented : " << counters.presented;
+  }
+#endif
 
   PeerconnectionMgr::clean();
-  
-  gtk_main_quit();
-  window.destroy();
+
+#ifndef QCLIENT_HEADLESS
+  if(!headless) {
+    gtk_main_quit();
+    window.destroy();
+  }
+#endif
+
+  TunnelLogging::flush();
   
   return 0;
 }
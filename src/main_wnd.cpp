@@ -14,14 +14,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "api/video/i420_buffer.h"
-#include "api/video/video_frame_buffer.h"
-#include "api/video/video_rotation.h"
 #include "api/video/video_source_interface.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
-#include "libyuv/convert.h"
-#include "libyuv/convert_from.h"
 
 
 gboolean on_destroyed_callback(GtkWidget* widget,
@@ -52,7 +47,7 @@ WindowRenderer::WindowRenderer()
 
 WindowRenderer::~WindowRenderer()
 {
-
+  if(_surface) cairo_surface_destroy(_surface);
 }
 
 bool WindowRenderer::create()
@@ -85,6 +80,9 @@ bool WindowRenderer::destroy()
   gtk_widget_destroy(_window);
   _window = NULL;
 
+  if(_surface) cairo_surface_destroy(_surface);
+  _surface = nullptr;
+
   return true;
 
 }
@@ -97,74 +95,65 @@ void WindowRenderer::on_destroyed(GtkWidget* widget, GdkEvent* event)
 
 void WindowRenderer::on_redraw()
 {
+  // Clear first so a frame published while we draw schedules a new redraw
+  _redraw_pending = false;
+
+  if(!_mailbox.take()) return;
+
   gdk_threads_enter();
 
-  if (_image != NULL && _draw_area != NULL) {
+  const ArgbFrame& frame = _mailbox.front();
 
-    if (!_draw_buffer.get()) {
-      _draw_buffer_size = (_width * _height * 4) * 4;
-      _draw_buffer.reset(new uint8_t[_draw_buffer_size]);
-      gtk_widget_set_size_request(_draw_area, _width * 2, _height * 2);
-    }
+  if (frame.data != NULL && _draw_area != NULL) {
+    int width = gtk_widget_get_allocated_width(_draw_area);
+    int height = gtk_widget_get_allocated_height(_draw_area);
 
-    const uint32_t* image =
-      reinterpret_cast<const uint32_t*>(_image.get());
-    uint32_t* scaled = reinterpret_cast<uint32_t*>(_draw_buffer.get());
-    for (int r = 0; r < _height; ++r) {
-      for (int c = 0; c < _width; ++c) {
-        int x = c * 2;
-        scaled[x] = scaled[x + 1] = image[c];
-      }
-
-      uint32_t* prev_line = scaled;
-      scaled += _width * 2;
-      memcpy(scaled, prev_line, (_width * 2) * 4);
-
-      image += _width;
-      scaled += _width * 2;
+    if (!_surface || _surface_width != width || _surface_height != height) {
+      if(_surface) cairo_surface_destroy(_surface);
+
+      _surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+      _surface_width = width;
+      _surface_height = height;
+      _scaler.invalidate();
     }
 
-    gtk_widget_queue_draw(_draw_area);
+    cairo_surface_flush(_surface);
+
+    bool drawn = _scaler.scale(frame,
+			       cairo_image_surface_get_data(_surface),
+			       cairo_image_surface_get_stride(_surface),
+			       _surface_width, _surface_height);
+
+    if(drawn) {
+      _surface_rtp_timestamp = frame.rtp_timestamp;
+      cairo_surface_mark_dirty(_surface);
+      gtk_widget_queue_draw(_draw_area);
+    }
   }
 
   gdk_threads_leave();
 }
 
 void WindowRenderer::draw(GtkWidget* widget, cairo_t* cr)
-{  
-  cairo_format_t format = CAIRO_FORMAT_ARGB32;
-  cairo_surface_t* surface = cairo_image_surface_create_for_data(
-								 _draw_buffer.get(), format, _width * 2, _height * 2,
-								 cairo_format_stride_for_width(format, _width * 2));
-  cairo_set_source_surface(cr, surface, 0, 0);
-  cairo_rectangle(cr, 0, 0, _width * 2, _height * 2);
-  cairo_fill(cr);
-  cairo_surface_destroy(surface);
-}
-
-void WindowRenderer::OnFrame(const webrtc::VideoFrame& frame)
 {
-  gdk_threads_enter();
-  
-  rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(
-      frame.video_frame_buffer()->ToI420());
-  if (frame.rotation() != webrtc::kVideoRotation_0) {
-    buffer = webrtc::I420Buffer::Rotate(*buffer, frame.rotation());
-  }
-
-  if (_width != frame.width() || _height != frame.height()) {
-    _width = frame.width();
-    _height = frame.height();
-    _image.reset(new uint8_t[_width * _height * 4]);
+  if(!_surface) {
+    cairo_set_source_rgb(cr, 0., 0., 0.);
+    cairo_paint(cr);
+    return;
   }
 
+  cairo_set_source_surface(cr, _surface, 0, 0);
+  cairo_paint(cr);
 
-  libyuv::I420ToARGB(buffer->DataY(), buffer->StrideY(), buffer->DataU(),
-                     buffer->StrideU(), buffer->DataV(), buffer->StrideV(),
-                     _image.get(), _width * 4, buffer->width(),
-                     buffer->height());
+  if(tracer) tracer->mark(FrameTracer::Stage::PRESENTED, _surface_rtp_timestamp);
+}
 
-  gdk_threads_leave();
+void WindowRenderer::OnFrame(const webrtc::VideoFrame& frame)
+{
+  // Runs on the decoder thread: convert into our private slot, no GTK lock
+  _mailbox.back().assign(frame);
+  _mailbox.publish();
 
-  g_idle_add(redraw, this);
+  // Only one pending redraw at a time, stale frames are coalesced in the mailbox
+  if(!_redraw_pending.exchange(true)) g_idle_add(redraw, this);
 }
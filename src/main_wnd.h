@@ -4,6 +4,13 @@
 #include <api/video/video_frame.h>
 #include <api/video/video_sink_interface.h>
 
+#include <atomic>
+
+#include "argb_frame.h"
+#include "frame_mailbox.h"
+#include "frame_scaler.h"
+#include "frame_tracer.h"
+
 // Forward declarations.
 typedef struct _GtkWidget GtkWidget;
 typedef union _GdkEvent GdkEvent;
@@ -12,22 +19,30 @@ typedef struct _GtkTreeView GtkTreeView;
 typedef struct _GtkTreePath GtkTreePath;
 typedef struct _GtkTreeViewColumn GtkTreeViewColumn;
 typedef struct _cairo cairo_t;
+typedef struct _cairo_surface cairo_surface_t;
 
 class WindowRenderer : public rtc::VideoSinkInterface<webrtc::VideoFrame>
 {
-  GtkWidget* _window;     // Our main window.
-  GtkWidget* _draw_area;  // The drawing surface for rendering video streams.
+  GtkWidget* _window = nullptr;     // Our main window.
+  GtkWidget* _draw_area = nullptr;  // The drawing surface for rendering video streams.
 
   // std::unique_ptr<VideoRenderer> remote_renderer_;
   
-  int _width;
-  int _height;
+  // Window sized surface, only rebuilt when the allocation changes
+  cairo_surface_t* _surface = nullptr;
+  int _surface_width = 0;
+  int _surface_height = 0;
+  FrameScaler _scaler;
+  uint32_t    _surface_rtp_timestamp = 0;
 
-  std::unique_ptr<uint8_t[]> _draw_buffer;
-  std::unique_ptr<uint8_t[]> _image;
-  int _draw_buffer_size;
+  // Decoder thread publishes, GTK thread takes the latest
+  FrameMailbox<ArgbFrame> _mailbox;
+  std::atomic_bool        _redraw_pending = false;
 
 public:
+  // Marks the presented stage when set
+  FrameTracer* tracer = nullptr;
+
   WindowRenderer();
   ~WindowRenderer();
 
@@ -45,6 +60,8 @@ public:
 
   void draw(GtkWidget* widget, cairo_t* cr);
 
+  FrameMailbox<ArgbFrame>::Counters counters() const { return _mailbox.counters(); }
+
 protected:
   void OnFrame(const webrtc::VideoFrame& frame) override;
 };
@@ -1,67 +1,225 @@
 #include <iostream>
+#include <memory>
+#include <algorithm>
 #include "medooze_mgr.h"
 
 #include "tunnel_loggin.h"
+#include "messages.h"
 
-MedoozeMgr::MedoozeMgr()
+MedoozeMgr::MedoozeMgr(EventLoop& loop)
+  : _loop(loop), _ws(loop), _reconnect_timer(loop.context()), _backoff(reconnect_min)
 {
-  _ws.onopen = []() { TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "medooze ws opened"; };
-  _ws.onclose = []() { TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "medooze ws closed"; };
+  _ws.onopen = [this]() {
+    TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "medooze ws opened";
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    _connected = true;
+    _connecting = false;
+    _backoff = reconnect_min;
+    _cv.notify_all();
+  };
+  _ws.onclose = [this]() {
+    TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "medooze ws closed";
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    _connected = false;
+    _connecting = false;
+    _cv.notify_all();
+
+    if(!_closing) schedule_reconnect();
+  };
+  _ws.onmessage = [this](auto&& msg) {
+    using namespace messages;
+
+    bool valid = dispatch<ViewAnswer, DumpUrl, PortReply>(msg, overloaded{
+	[this](const ViewAnswer& m) { if(onanswer) onanswer(m.answer); },
+	[this](const DumpUrl& m) { csv_url = m.url; },
+	[this](const PortReply& m) {
+	  std::lock_guard<std::mutex> lck(_cv_mutex);
+	  if(_port) {
+	    _port->set_value(m.port);
+	    _port.reset();
+	  }
+	}
+      });
+
+    if(!valid) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Unexpected medooze message : " << msg.dump();
+  };
 }
 
-void MedoozeMgr::start()
+MedoozeMgr::~MedoozeMgr()
 {
-  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "Start connection medooze manager";
-  
+  disconnect();
+}
+
+void MedoozeMgr::open()
+{
+  {
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    if(_connected || _connecting) return;
+    _connecting = true;
+  }
+
+  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "Open medooze control channel";
   _ws.connect(host, port , "quic-relay-loopback");
-  _ws.onmessage = [this](auto&& msg) {
-    if(auto answer = msg.find("answer"); answer != msg.end()) {
-      if(onanswer) onanswer(*answer);
-    }
-    if(auto url = msg.find("url"); url != msg.end()) {
-      csv_url = url->template get<std::string>();
-    }
-  };
 }
 
-void MedoozeMgr::stop()
+// Called with _cv_mutex held, from the loop
+void MedoozeMgr::schedule_reconnect()
+{
+  TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Medooze control channel lost, reconnecting in " << _backoff.count() << " ms";
+
+  _reconnect_timer.expires_after(_backoff);
+  _reconnect_timer.async_wait([this](const std::error_code& ec) {
+    if(ec) return; // cancelled by disconnect
+    open();
+  });
+
+  _backoff = std::min(_backoff * 2, reconnect_max);
+}
+
+bool MedoozeMgr::connect()
 {
+  {
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    _closing = false;
+  }
+
+  open();
+
+  std::unique_lock<std::mutex> lck(_cv_mutex);
+  if(!_cv.wait_for(lck, timeout, [this]() { return _connected; })) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not connect to medooze " << host << ":" << port;
+    return false;
+  }
+
+  return true;
+}
+
+void MedoozeMgr::disconnect()
+{
+  {
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    _closing = true;
+    _reconnect_timer.cancel();
+  }
+
   _ws.disconnect();
 }
 
+bool MedoozeMgr::start()
+{
+  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "Start connection medooze manager";
+  return connect();
+}
+
+void MedoozeMgr::stop()
+{
+  bool legacy;
+  {
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    legacy = _legacy;
+  }
+
+  // The view ends with its connection
+  if(legacy) {
+    disconnect();
+    return;
+  }
+
+  try {
+    _ws.send_json(messages::command(messages::Stop{}));
+  }
+  catch(const std::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not stop medooze view : " << e.what();
+  }
+}
+
 void MedoozeMgr::view(const std::string& sdp)
 {
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "MedoozeManager::view";
-  
-  json cmd = {
-    { "cmd", "view" },
-    { "offer", sdp },
-    { "probing", ((probing) ? probing_bitrate : 0) },
-    { "constant_probing", probing_bitrate }
+
+  messages::View cmd{
+    .offer = sdp,
+    .probing = ((probing) ? probing_bitrate : 0),
+    .constant_probing = probing_bitrate
   };
 
-  _ws.send(cmd.dump());
+  _ws.send_json(messages::command(cmd));
 }
 
 int MedoozeMgr::get_rtp_port()
 {
-  int rtp_port;
-  WebSocketSecure ws;
-  
-  ws.onmessage = [this, &rtp_port, &ws](auto&& msg) {
-    if(auto port = msg.find("port"); port != msg.end()) {
-      rtp_port = port->template get<int>();
-    }
+  std::future<int> reply;
+
+  {
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    if(_legacy) return legacy_rtp_port();
+  }
+
+  if(!connect()) return -1;
+
+  {
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    _port.emplace();
+    reply = _port->get_future();
+  }
+
+  try {
+    _ws.send_json(messages::command(messages::Port{}));
+  }
+  catch(const std::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not query medooze port : " << e.what();
+  }
+
+  if(reply.wait_for(port_timeout) == std::future_status::ready) return reply.get();
+
+  {
+    std::lock_guard<std::mutex> lck(_cv_mutex);
+    _port.reset();
+    _legacy = true;
+  }
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Medooze does not answer the port command, using a connection per request";
+  return legacy_rtp_port();
+}
+
+int MedoozeMgr::legacy_rtp_port()
+{
+  // Local to the query so it can run concurrently with start, shared with
+  // the handler in case it fires after a timeout
+  struct Reply
+  {
+    std::mutex              mutex;
+    std::condition_variable cv;
+    int                     rtp_port = -1;
+    bool                    answered = false;
+    bool                    abandoned = false; // the query returned, ws is going away
+  };
+
+  auto reply = std::make_shared<Reply>();
+  WebSocketSecure ws(_loop);
+
+  // ws is only touched under the lock and until the query returns, its
+  // destructor then waits for the connection to terminate
+  ws.onmessage = [reply, &ws](auto&& msg) {
+    std::lock_guard<std::mutex> lck(reply->mutex);
+    if(reply->abandoned || reply->answered) return;
+
+    messages::dispatch<messages::PortReply>(msg, [&reply](const messages::PortReply& m) { reply->rtp_port = m.port; });
+    reply->answered = true;
+    reply->cv.notify_all();
 
     ws.disconnect();
-    _cv.notify_all();
   };
 
   ws.onclose = []() { ; };
   ws.connect(host, port, "port");
 
-  std::unique_lock<std::mutex> lck(_cv_mutex);
-  _cv.wait(lck);
-  
-  return rtp_port;
+  std::unique_lock<std::mutex> lck(reply->mutex);
+  if(!reply->cv.wait_for(lck, timeout, [&reply]() { return reply->answered; })) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "No rtp port from medooze " << host << ":" << port;
+  }
+
+  reply->abandoned = true;
+
+  return reply->rtp_port;
 }
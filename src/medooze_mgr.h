@@ -2,20 +2,44 @@
 #define MEDOOZE_MGR_H
 
 #include <condition_variable>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
 
 #include "websocket.h"
 
+#include <asio/steady_timer.hpp>
+
+// Control channel to medooze, kept open across runs and reopened with a
+// backoff if it drops. Servers that do not answer the port command only
+// speak the connection per request protocols, they get a connection per
+// run and a "port" connection per query as before.
 class MedoozeMgr
 {
+  EventLoop&      _loop;
   WebSocketSecure _ws;
 
   std::condition_variable _cv;
   std::mutex              _cv_mutex;
-  
+  bool                    _connected = false;
+  bool                    _connecting = false;
+  bool                    _closing = false; // closed by us, no reconnect
+  bool                    _legacy = false;
+
+  std::optional<std::promise<int>> _port; // port command in flight
+
+  asio::steady_timer        _reconnect_timer;
+  std::chrono::milliseconds _backoff;
+
+  void open();
+  void schedule_reconnect();
+  int legacy_rtp_port();
+
 public:
 
   using json = nlohmann::json;
-  
+
   size_t probing_bitrate = 2000z;
   bool   probing = true;
 
@@ -23,17 +47,34 @@ public:
   std::string host;
 
   int port;
-  std::function<void(const json&)> onanswer;
-  
+  std::function<void(const std::string&)> onanswer;
+
+  // Connection and port query deadline
+  std::chrono::milliseconds timeout{5000};
+  // Wait for an answer to the port command before using the legacy protocol
+  std::chrono::milliseconds port_timeout{1000};
+  // Reconnect delay, doubled on each attempt up to the max
+  std::chrono::milliseconds reconnect_min{250};
+  std::chrono::milliseconds reconnect_max{8000};
+
 public:
-  
-  MedoozeMgr();
 
-  void start();
+  explicit MedoozeMgr(EventLoop& loop = EventLoop::get());
+  ~MedoozeMgr();
+
+  // Opens the channel if needed, false if it could not connect in time
+  bool connect();
+  // Closes the channel for good
+  void disconnect();
+
+  // Returns once connected, false if it could not connect in time
+  bool start();
+  // Ends the current view
   void stop();
   void view(const std::string& sdp);
+  // Safe to call while start is in progress. -1 on failure
   int get_rtp_port();
-  
+
 };
 
 #endif /* MEDOOZE_MGR_H */
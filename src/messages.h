@@ -0,0 +1,278 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "nlohmann/json.hpp"
+
+// Schema of the messages exchanged with the tunnel ends and medooze.
+//
+// Tunnel requests are sent as { cmd, transId, data } with the struct as
+// data, cmd naming the command and Reply the type the response data is
+// decoded into. Medooze commands are flat, cmd is a member of the message,
+// and what it sends back is recognised by its key.
+//
+// Decoding a message that does not match its struct throws a
+// json::exception, callers turn it into an error, never into a crash.
+namespace messages
+{
+  using json = nlohmann::json;
+
+  template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
+
+  // Reply without content
+  struct Ack {};
+  inline void to_json(json& j, const Ack&) { j = json::object(); }
+  inline void from_json(const json&, Ack&) {}
+
+  // tunnel ///////////////////////////////////////////////////////////////////
+
+  struct StartReply
+  {
+    int id;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(StartReply, id)
+
+  struct StartServer
+  {
+    static constexpr const char* cmd = "startserver";
+    using Reply = StartReply;
+
+    std::string impl;
+    bool        datagrams;
+    std::string cc;
+    int         port_out;
+    std::string addr_out;
+    int         quic_port;
+    std::string quic_host;
+    bool        external_file_transfer;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(StartServer, impl, datagrams, cc, port_out, addr_out, quic_port, quic_host,
+				     external_file_transfer)
+
+  struct StartClient
+  {
+    static constexpr const char* cmd = "startclient";
+    using Reply = StartReply;
+
+    std::string impl;
+    bool        datagrams;
+    std::string cc;
+    int         quic_port;
+    std::string quic_host;
+    bool        external_file_transfer;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(StartClient, impl, datagrams, cc, quic_port, quic_host, external_file_transfer)
+
+  struct StopServer
+  {
+    static constexpr const char* cmd = "stopserver";
+    using Reply = Ack;
+
+    int id;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(StopServer, id)
+
+  struct StopClient
+  {
+    static constexpr const char* cmd = "stopclient";
+    using Reply = Ack;
+
+    int id;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(StopClient, id)
+
+  struct Link
+  {
+    static constexpr const char* cmd = "link";
+    using Reply = Ack;
+
+    int bitrate;
+    int delay;
+    int loss;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Link, bitrate, delay, loss)
+
+  // Link without constraints
+  struct ResetLink
+  {
+    static constexpr const char* cmd = "link";
+    using Reply = Ack;
+  };
+  // null like the untyped reset always sent, not an empty object
+  inline void to_json(json& j, const ResetLink&) { j = nullptr; }
+
+  struct GetStatsReply
+  {
+    std::string url;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(GetStatsReply, url)
+
+  struct GetStats
+  {
+    static constexpr const char* cmd = "getstats";
+    using Reply = GetStatsReply;
+
+    std::string exp_name;
+    std::string transport;
+    std::string medooze_dump_url;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(GetStats, exp_name, transport, medooze_dump_url)
+
+  // Samples are already columns of json, latency and setup only come with
+  // the final chunk
+  struct UploadStats
+  {
+    static constexpr const char* cmd = "uploadstats";
+    using Reply = Ack;
+
+    int    seq;
+    size_t offset;
+    bool   final;
+    json   stats;
+    json   latency;
+    json   setup;
+    json   link;
+    json   quality;
+  };
+
+  inline void to_json(json& j, const UploadStats& m)
+  {
+    j = json{ { "seq", m.seq }, { "offset", m.offset }, { "final", m.final }, { "stats", m.stats } };
+    if(!m.latency.is_null()) j["latency"] = m.latency;
+    if(!m.setup.is_null()) j["setup"] = m.setup;
+    if(!m.link.is_null()) j["link"] = m.link;
+    if(!m.quality.is_null()) j["quality"] = m.quality;
+  }
+
+  struct Capabilities
+  {
+    std::string              impl;
+    bool                     datagrams;
+    bool                     streams;
+    std::vector<std::string> cc;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Capabilities, impl, datagrams, streams, cc)
+
+  struct CapabilitiesReply
+  {
+    std::vector<Capabilities> in_impls;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(CapabilitiesReply, in_impls)
+
+  struct CapabilitiesQuery
+  {
+    static constexpr const char* cmd = "capabilities";
+    using Reply = CapabilitiesReply;
+
+    bool out_requested;
+    bool in_requested;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(CapabilitiesQuery, out_requested, in_requested)
+
+  struct EncodingReply
+  {
+    std::string encoding = "json";
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(EncodingReply, encoding)
+
+  struct EncodingQuery
+  {
+    static constexpr const char* cmd = "encoding";
+    using Reply = EncodingReply;
+
+    std::vector<std::string> accept;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(EncodingQuery, accept)
+
+  // medooze //////////////////////////////////////////////////////////////////
+
+  struct View
+  {
+    static constexpr const char* cmd = "view";
+
+    std::string offer;
+    size_t      probing;
+    size_t      constant_probing;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(View, offer, probing, constant_probing)
+
+  struct Port
+  {
+    static constexpr const char* cmd = "port";
+  };
+  inline void to_json(json& j, const Port&) { j = json::object(); }
+
+  struct Stop
+  {
+    static constexpr const char* cmd = "stop";
+  };
+  inline void to_json(json& j, const Stop&) { j = json::object(); }
+
+  struct ViewAnswer
+  {
+    static constexpr const char* key = "answer";
+
+    std::string answer;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(ViewAnswer, answer)
+
+  struct DumpUrl
+  {
+    static constexpr const char* key = "url";
+
+    std::string url;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(DumpUrl, url)
+
+  struct PortReply
+  {
+    static constexpr const char* key = "port";
+
+    int port;
+  };
+  NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(PortReply, port)
+
+  // Flat command, { cmd, ...members }
+  template<typename Command>
+  json command(const Command& c)
+  {
+    json j = c;
+    j["cmd"] = Command::cmd;
+    return j;
+  }
+
+  // Compile time table of the messages sent without a transId : handler is
+  // called with each of Messages whose key is in msg. Returns false if none
+  // matched or one of them did not decode.
+  template<typename... Messages, typename Handler>
+  bool dispatch(const json& msg, Handler&& handler)
+  {
+    if(!msg.is_object()) return false;
+
+    bool handled = false;
+    bool valid = true;
+
+    ([&]() {
+      if(!msg.contains(Messages::key)) return;
+
+      Messages m;
+      try {
+	from_json(msg, m);
+      }
+      catch(const json::exception&) {
+	valid = false;
+	return;
+      }
+
+      handler(m);
+      handled = true;
+    }(), ...);
+
+    return handled && valid;
+  }
+}
+
+#endif /* MESSAGES_H */
@@ -0,0 +1,57 @@
+#include "null_sink.h"
+
+#include <fstream>
+
+#include <api/video/video_frame_buffer.h>
+#include <rtc_base/time_utils.h>
+
+#include "frame_hash.h"
+#include "tunnel_loggin.h"
+
+NullSink::NullSink(size_t capacity) : _records(capacity)
+{
+}
+
+void NullSink::OnFrame(const webrtc::VideoFrame& frame)
+{
+  size_t i = _count.fetch_add(1, std::memory_order_relaxed);
+  if(i >= _records.size()) return;
+
+  Record& record = _records[i];
+  record.arrival_us = rtc::TimeMicros();
+  record.rtp_timestamp = frame.timestamp();
+  record.width = static_cast<uint16_t>(frame.width());
+  record.height = static_cast<uint16_t>(frame.height());
+
+  // No copy for I420 buffers, which is what the builtin decoders output
+  auto i420 = frame.video_frame_buffer()->ToI420();
+  record.y_hash = hash_plane(i420->DataY(), i420->StrideY(), i420->width(), i420->height());
+}
+
+void NullSink::reset()
+{
+  _count = 0;
+}
+
+bool NullSink::dump(const std::filesystem::path& path) const
+{
+  std::ofstream out(path);
+  if(!out.is_open()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << path.string();
+    return false;
+  }
+
+  out << "arrival_us,rtp_timestamp,width,height,y_hash\n";
+
+  for(size_t i = 0; i < size(); ++i) {
+    const Record& r = _records[i];
+    out << r.arrival_us << "," << r.rtp_timestamp << "," << r.width << "," << r.height << ","
+	<< std::hex << r.y_hash << std::dec << "\n";
+  }
+
+  if(overflow() > 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Null sink dropped " << overflow() << " records";
+  }
+
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef NULL_SINK_H
+#define NULL_SINK_H
+
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+
+// Headless video sink: no conversion nor rendering, only records when each
+// frame arrived, its resolution and a hash of its Y plane.
+class NullSink : public rtc::VideoSinkInterface<webrtc::VideoFrame>
+{
+public:
+  struct Record
+  {
+    int64_t  arrival_us;
+    uint32_t rtp_timestamp;
+    uint16_t width;
+    uint16_t height;
+    uint64_t y_hash;
+  };
+
+  // Records are preallocated, frames beyond capacity are only counted
+  explicit NullSink(size_t capacity = 1 << 18);
+
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+  // Not thread safe with OnFrame, call once the peerconnection is stopped
+  void reset();
+  bool dump(const std::filesystem::path& path) const;
+
+  size_t size() const { return std::min(_count.load(), _records.size()); }
+  size_t overflow() const { return _count.load() - size(); }
+
+private:
+  std::vector<Record> _records;
+  std::atomic<size_t> _count = 0;
+};
+
+#endif /* NULL_SINK_H */
@@ -23,8 +23,22 @@
 rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> PeerconnectionMgr::_pcf = nullptr;
 std::unique_ptr<rtc::Thread> PeerconnectionMgr::_signaling_th = nullptr;
 
+std::mutex PeerconnectionMgr::_pcf_mutex;
+bool PeerconnectionMgr::_loopback = false;
+
+webrtc::PeerConnectionFactoryInterface::Options PeerconnectionMgr::factory_options()
+{
+  webrtc::PeerConnectionFactoryInterface::Options options;
+  options.crypto_options.srtp.enable_gcm_crypto_suites = true;
+  if(_loopback) options.network_ignore_mask = 0;
+
+  return options;
+}
+
 rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> PeerconnectionMgr::get_pcf()
 {
+  // Sessions start concurrently, the first one creates the factory
+  std::lock_guard<std::mutex> lock(_pcf_mutex);
   if(_pcf != nullptr) return _pcf;
 
   rtc::InitRandom((int)rtc::Time());
@@ -41,15 +55,22 @@ rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> PeerconnectionMgr::ge
 					     webrtc::CreateBuiltinVideoDecoderFactory(),
 					     nullptr, nullptr);
 
-  webrtc::PeerConnectionFactoryInterface::Options options;
-  options.crypto_options.srtp.enable_gcm_crypto_suites = true;
-  _pcf->SetOptions(options);
+  _pcf->SetOptions(factory_options());
   
   return _pcf;
 }
 
+void PeerconnectionMgr::set_loopback(bool enabled)
+{
+  std::lock_guard<std::mutex> lock(_pcf_mutex);
+  _loopback = enabled;
+
+  if(_pcf) _pcf->SetOptions(factory_options());
+}
+
 void PeerconnectionMgr::clean()
 {
+  std::lock_guard<std::mutex> lock(_pcf_mutex);
   _pcf = nullptr;
   rtc::CleanupSSL();
 }
@@ -86,15 +107,21 @@ void PeerconnectionMgr::start()
 
   _pc = res.value();
 
-  _stats_th_running = false;
-  stats.erase(stats.begin(), stats.end());
-  _count = 0;
+  stats.reset(stats_capacity);
+  _first_ts = 0.;
   _prev_ts = 0.;
   _prev_bytes = 0.;
+  _prev_jb_delay = 0.;
+  _prev_jb_target_delay = 0.;
+  _prev_jb_minimum_delay = 0.;
+  _prev_jb_emitted = 0.;
   _key_frame = 0;
   _frames = 0;
+  tracer.reset();
+  if(quality) quality->reset();
 
-  _file_bitstream.open("bitstream.264", std::ios::binary);
+  _recorder.set_max_file_size(bitstream_max_size);
+  _recorder.open(bitstream_path);
 
   // auto receiver_cap = pcf->GetRtpReceiverCapabilities(cricket::MediaType::MEDIA_TYPE_VIDEO);
 
@@ -169,15 +196,24 @@ void PeerconnectionMgr::OnSetRemoteDescriptionComplete(webrtc::RTCError error)
 void PeerconnectionMgr::stop()
 {
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "PeerConnection::Stop" << "\n";
-  _stats_th_running = false;
-  if(_stats_th.joinable()) _stats_th.join();
+  // Pending stats task sees a new generation and does nothing
+  _signaling_th->BlockingCall([this]() { ++_stats_generation; });
+
+  if(!_pc) return;
 
-  _file_bitstream.close();
-  
   _pc->Close();
   _pc = nullptr;
 
+  _recorder.close();
+
+  auto recorded = _recorder.counters();
+
   TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Received transformable frame : " << _frames;
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Recorded " << recorded.frames_written << " frames (" << recorded.bytes_written
+					    << " bytes) to " << bitstream_path.string() << ", dropped : " << recorded.frames_dropped
+					    << ", truncated : " << recorded.frames_truncated;
+  tracer.log();
+  if(quality) quality->log();
 }
 
 void PeerconnectionMgr::set_remote_description(const std::string &sdp)
@@ -193,9 +229,28 @@ void PeerconnectionMgr::set_remote_description(const std::string &sdp)
   _pc->SetRemoteDescription(std::move(desc), _me);
 }
 
+void PeerconnectionMgr::add_ice_candidate(std::unique_ptr<webrtc::IceCandidateInterface> candidate)
+{
+  if(!_pc) return;
+
+  _pc->AddIceCandidate(std::move(candidate), [](webrtc::RTCError error) {
+    if(!error.ok()) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Could not add ice candidate : " << error.message();
+  });
+}
+
+void PeerconnectionMgr::schedule_stats(rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver, int generation)
+{
+  _signaling_th->PostDelayedTask([this, receiver, generation]() {
+    if(generation != _stats_generation || !_pc) return;
+
+    _pc->GetStats(receiver, _me);
+    schedule_stats(receiver, generation);
+  }, webrtc::TimeDelta::Millis(stats_interval.count()));
+}
+
 void PeerconnectionMgr::OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report)
 {  
-  RTCStats rtc_stats;
+  StatsSeries::Sample sample;
 
   auto inbound_stats = report->GetStatsOfType<webrtc::RTCInboundRTPStreamStats>();
   
@@ -203,60 +258,98 @@ void PeerconnectionMgr::OnStatsDelivered(const rtc::scoped_refptr<const webrtc::
     if(*s->kind == webrtc::RTCMediaStreamTrackKind::kVideo) {
       auto ts = s->timestamp();
       auto ts_ms = ts.ms();
+      if(_prev_ts == 0.) _first_ts = _prev_ts = ts_ms;
+      
       auto delta = ts_ms - _prev_ts;
       auto bytes = *s->bytes_received - _prev_bytes;
       
-      rtc_stats.x = _count;
-      rtc_stats.link = link;
-      rtc_stats.bitrate = static_cast<int>(8. * bytes / delta);
-      rtc_stats.fps = s->frames_per_second.ValueOrDefault(0.);
-      rtc_stats.frame_dropped = s->frames_dropped.ValueOrDefault(0.);
-      rtc_stats.frame_decoded = s->frames_decoded.ValueOrDefault(0.);
-      rtc_stats.frame_key_decoded = s->key_frames_decoded.ValueOrDefault(0.);
-
-      /*std::cout << "jitter : " << s->jitter_buffer_delay.ValueOrDefault(0.) << "\n"
-		<< "jitter target : " << s->jitter_buffer_target_delay.ValueOrDefault(0.) << "\n"
-		<< "jitter min : " << s->jitter_buffer_minimum_delay.ValueOrDefault(0.) << "\n"
-		<< "jitter flush : " << s->jitter_buffer_flushes.ValueOrDefault(0.) << "\n"
-		<< "packet fec : " << s->fec_packets_received.ValueOrDefault(0.) << "\n"
-	// << "packet rtx : " << s->retransmitted_bytes_received.ValueOrDefault(0.) << "\n"
-		<< "frame dropped : " << s->frames_dropped.ValueOrDefault(0.) << "\n"
-		<< "\n";*/
+      sample.x = static_cast<int64_t>(stats.end());
+      sample.time = (ts_ms - _first_ts) / 1000.;
+      sample.link = link;
+      sample.bitrate = delta > 0. ? static_cast<int>(8. * bytes / delta) : 0;
+      sample.fps = s->frames_per_second.ValueOrDefault(0.);
+      sample.frame_dropped = s->frames_dropped.ValueOrDefault(0);
+      sample.frame_decoded = s->frames_decoded.ValueOrDefault(0);
+      sample.frame_key_decoded = s->key_frames_decoded.ValueOrDefault(0);
+
+      sample.jitter = s->jitter.ValueOrDefault(0.) * 1000.;
+
+      // Cumulative seconds, averaged over the frames emitted during this interval (ms)
+      double emitted = s->jitter_buffer_emitted_count.ValueOrDefault(0);
+      double jb_delay = s->jitter_buffer_delay.ValueOrDefault(0.);
+      double jb_target_delay = s->jitter_buffer_target_delay.ValueOrDefault(0.);
+      double jb_minimum_delay = s->jitter_buffer_minimum_delay.ValueOrDefault(0.);
+
+      if(emitted > _prev_jb_emitted) {
+	double frames = emitted - _prev_jb_emitted;
+	sample.jitter_buffer_delay = 1000. * (jb_delay - _prev_jb_delay) / frames;
+	sample.jitter_buffer_target_delay = 1000. * (jb_target_delay - _prev_jb_target_delay) / frames;
+	sample.jitter_buffer_minimum_delay = 1000. * (jb_minimum_delay - _prev_jb_minimum_delay) / frames;
+      }
+
+      sample.nack_count = s->nack_count.ValueOrDefault(0);
+      sample.pli_count = s->pli_count.ValueOrDefault(0);
+      sample.fir_count = s->fir_count.ValueOrDefault(0);
+      sample.fec_packets_received = s->fec_packets_received.ValueOrDefault(0);
+      sample.rtx_packets_received = s->retransmitted_packets_received.ValueOrDefault(0);
+      sample.packets_lost = s->packets_lost.ValueOrDefault(0);
+      sample.freeze_count = s->freeze_count.ValueOrDefault(0);
+      sample.pause_count = s->pause_count.ValueOrDefault(0);
       
       _prev_ts = ts_ms;
       _prev_bytes = *s->bytes_received;
+      _prev_jb_emitted = emitted;
+      _prev_jb_delay = jb_delay;
+      _prev_jb_target_delay = jb_target_delay;
+      _prev_jb_minimum_delay = jb_minimum_delay;
+    }
+  }
+
+  // The receiver report also references the transport and its candidate pair
+  for(const auto& pair : report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>()) {
+    if(pair->available_incoming_bitrate.is_defined()) {
+      sample.available_incoming_bitrate = *pair->available_incoming_bitrate;
     }
   }
   
-  stats.push_back(std::move(rtc_stats));
+  stats.push(sample);
+
+  if(onstats) onstats();
 }
 
 void PeerconnectionMgr::Transform(std::unique_ptr<webrtc::TransformableFrameInterface> transformable_frame)
 {
   auto ssrc = transformable_frame->GetSsrc();
+  auto rtp_timestamp = transformable_frame->GetTimestamp();
+
+  tracer.mark(FrameTracer::Stage::RECEIVED, rtp_timestamp);
 
   if(auto it = _callbacks.find(ssrc); it != _callbacks.end()) {
     auto video_frame = static_cast<webrtc::TransformableVideoFrameInterface*>(transformable_frame.get());
-    if(video_frame->IsKeyFrame()) {
-      // std::cout << "Received new key frame: " << ++_key_frame << " num " << _frames << " size " << transformable_frame->GetData().size() << "\n";
-    }
-    else {
-      // std::cout << "Received p frame: " << " size " << transformable_frame->GetData().size() << "\n";
-    }
-
+    if(video_frame->IsKeyFrame()) ++_key_frame;
 
-    ++_frames;
+    if(++_frames == 1 && onfirstframe) onfirstframe();
 
     // std::cout << "Frame num " << _frames << " : " << video_frame->GetData().size() << "\n";
 
     /*std::cout << video_frame->GetMetadata().GetFrameId().value_or(-1) << " " << video_frame->GetMetadata().GetCodec() << " "
       << video_frame->GetTimestamp() << " " << webrtc::ToString(video_frame->GetCaptureTimeIdentifier().value_or(webrtc::Timestamp::Seconds(0))) << "\n";*/
     
-    if(_file_bitstream.is_open() && _key_frame >= 1) {
-      _file_bitstream.write((const char*)video_frame->GetData().data(), video_frame->GetData().size());
+    // Copied into the recorder ring, written to disk by its own thread
+    if(_recorder.is_open() && _key_frame >= 1) {
+      BitstreamIndexRecord record{};
+      record.arrival_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      record.frame_id = video_frame->GetMetadata().GetFrameId().value_or(-1);
+      record.rtp_timestamp = rtp_timestamp;
+      record.ssrc = ssrc;
+      record.key_frame = video_frame->IsKeyFrame();
+      record.codec = static_cast<uint8_t>(video_frame->GetMetadata().GetCodec());
+
+      _recorder.push(video_frame->GetData().data(), video_frame->GetData().size(), record);
     }
     
     it->second->OnTransformedFrame(std::move(transformable_frame));
+    tracer.mark(FrameTracer::Stage::TRANSFORMED, rtp_timestamp);
   }
 }
 
@@ -296,21 +389,21 @@ void PeerconnectionMgr::OnTrack(rtc::scoped_refptr<webrtc::RtpTransceiverInterfa
 {
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "PeerconnectionMgr::OnTrack";
   
-  _stats_th = std::thread([this, transceiver]() {
-    _stats_th_running = true;
-    _count = 0;
-    
-    while(_stats_th_running) {
-      _pc->GetStats(transceiver->receiver(), _me);
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      ++_count;
-    }
+  // Sample on the signaling thread, the first one right away
+  _signaling_th->PostTask([this, receiver = transceiver->receiver(), generation = _stats_generation.load()]() {
+    if(generation != _stats_generation || !_pc) return;
+
+    _pc->GetStats(receiver, _me);
+    schedule_stats(receiver, generation);
   });
 
   transceiver->receiver()->SetDepacketizerToDecoderFrameTransformer(_me);
 
+  auto track = static_cast<webrtc::VideoTrackInterface*>(transceiver->receiver()->track().get());
+  track->AddOrUpdateSink(&tracer, rtc::VideoSinkWants{});
+  if(quality) track->AddOrUpdateSink(quality, rtc::VideoSinkWants{});
+
   if(video_sink) {
-    auto track = static_cast<webrtc::VideoTrackInterface*>(transceiver->receiver()->track().get());
     track->AddOrUpdateSink(video_sink, rtc::VideoSinkWants{});
   }
 }
@@ -331,7 +424,9 @@ void PeerconnectionMgr::OnIceGatheringChange(webrtc::PeerConnectionInterface::Ic
 {}
 
 void PeerconnectionMgr::OnIceCandidate(const webrtc::IceCandidateInterface* candidate) 
-{}
+{
+  if(onicecandidate) onicecandidate(candidate);
+}
 
 void PeerconnectionMgr::OnIceConnectionReceivingChange(bool receiving) 
 {}
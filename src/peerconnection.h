@@ -3,10 +3,10 @@
 
 #include <memory>
 #include <string>
-#include <thread>
-#include <list>
+#include <chrono>
 #include <unordered_map>
-#include <fstream>
+#include <filesystem>
+#include <mutex>
 
 #include <api/peer_connection_interface.h>
 #include <api/scoped_refptr.h>
@@ -15,6 +15,11 @@
 #include <api/set_remote_description_observer_interface.h>
 #include <api/frame_transformer_interface.h>
 
+#include "frame_tracer.h"
+#include "quality_scorer.h"
+#include "bitstream_recorder.h"
+#include "stats_series.h"
+
 class PeerconnectionMgr : public webrtc::PeerConnectionObserver,
 			  public webrtc::CreateSessionDescriptionObserver,
 			  public webrtc::SetLocalDescriptionObserverInterface,
@@ -24,45 +29,60 @@ class PeerconnectionMgr : public webrtc::PeerConnectionObserver,
 {
   static rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> _pcf;
   static std::unique_ptr<rtc::Thread> _signaling_th;
+  static std::mutex _pcf_mutex;
+  static bool _loopback;
 
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> _pc;
   rtc::scoped_refptr<PeerconnectionMgr> _me;
 
-  std::atomic_bool _stats_th_running = false; // std::jthread where are you ? :'(
-  std::thread      _stats_th;
-  
-  int    _count;
+  // Bumped on stop so stats tasks of a previous run stop rescheduling
+  std::atomic<int> _stats_generation = 0;
+
+  double _first_ts = 0.;
   double _prev_ts = 0.;
   double _prev_bytes = 0.;
+  double _prev_jb_delay = 0.;
+  double _prev_jb_target_delay = 0.;
+  double _prev_jb_minimum_delay = 0.;
+  double _prev_jb_emitted = 0.;
 
   int _key_frame;
   int _frames;
 
   std::unordered_map<int, rtc::scoped_refptr<webrtc::TransformedFrameCallback>> _callbacks;
-  std::ofstream _file_bitstream;
+  BitstreamRecorder _recorder;
   
 public:
 
   rtc::VideoSinkInterface<webrtc::VideoFrame> * video_sink = nullptr;
 
-  struct RTCStats
-  {
-    int x;
-    int bitrate;
-    int link;
-    int fps;    
-    int frame_dropped = 0;
-    int frame_decoded = 0;
-    int frame_key_decoded = 0;
-    int frame_rendered = 0;
-  };
-  
+  // Receive pipeline latencies of the current run
+  FrameTracer tracer;
+  // PSNR / SSIM of the decoded frames against a reference, if set
+  QualityScorer* quality = nullptr;
+
+  // Encoded frames of the next run, from the first key frame
+  std::filesystem::path bitstream_path = "bitstream.264";
+  size_t                bitstream_max_size = 0;
+
   static rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> get_pcf();
+  // The factory's, once get_pcf() has created it
+  static rtc::Thread* signaling_thread() { return _signaling_th.get(); }
   static void clean();
+  // Gather loopback candidates too, for peers in the same process. Applies
+  // to the peerconnections created afterwards
+  static void set_loopback(bool enabled);
 
   std::function<void(const std::string&)> onlocaldesc;
-  std::list<RTCStats> stats;
+  std::function<void(const webrtc::IceCandidateInterface*)> onicecandidate; // signaling thread
+  std::function<void()>                   onstats; // new sample, signaling thread
+  std::function<void()>                   onfirstframe; // worker thread
+  StatsSeries stats;
   int link;
+
+  // GetStats period, and ring size (samples kept per run)
+  std::chrono::milliseconds stats_interval{100};
+  size_t                    stats_capacity = 1 << 16;
   
   PeerconnectionMgr();
   ~PeerconnectionMgr();
@@ -70,6 +90,14 @@ public:
   void start();
   void stop();
   void set_remote_description(const std::string& sdp);
+  // Once the remote description is set
+  void add_ice_candidate(std::unique_ptr<webrtc::IceCandidateInterface> candidate);
+
+private:
+  static webrtc::PeerConnectionFactoryInterface::Options factory_options();
+  void schedule_stats(rtc::scoped_refptr<webrtc::RtpReceiverInterface> receiver, int generation);
+
+public:
 
   void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state) override;
   void OnAddStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) override;
@@ -0,0 +1,243 @@
+#include "quality_metrics.h"
+
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libyuv/compare.h"
+
+namespace
+{
+
+constexpr double C1 = (0.01 * 255) * (0.01 * 255);
+constexpr double C2 = (0.03 * 255) * (0.03 * 255);
+
+// Sums over the 4x4 cells of a row of cells
+struct CellRow
+{
+  std::vector<uint32_t> a, b, aa, bb, ab;
+
+  explicit CellRow(size_t cells) : a(cells), b(cells), aa(cells), bb(cells), ab(cells) {}
+};
+
+// Cells [c, cells) of the 4 rows at pa / pb
+void sum_cells_scalar(const uint8_t* __restrict pa, int stride_a, const uint8_t* __restrict pb, int stride_b, size_t c, CellRow& cells)
+{
+  uint32_t* __restrict a = cells.a.data();
+  uint32_t* __restrict b = cells.b.data();
+  uint32_t* __restrict aa = cells.aa.data();
+  uint32_t* __restrict bb = cells.bb.data();
+  uint32_t* __restrict ab = cells.ab.data();
+  size_t count = cells.a.size();
+
+  for(; c < count; ++c) {
+    uint32_t sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+
+    for(int r = 0; r < 4; ++r) {
+      const uint8_t* ra = pa + static_cast<size_t>(r) * stride_a + c * 4;
+      const uint8_t* rb = pb + static_cast<size_t>(r) * stride_b + c * 4;
+
+      for(int x = 0; x < 4; ++x) {
+	uint32_t va = ra[x];
+	uint32_t vb = rb[x];
+	sa += va;
+	sb += vb;
+	saa += va * va;
+	sbb += vb * vb;
+	sab += va * vb;
+      }
+    }
+
+    a[c] = sa;
+    b[c] = sb;
+    aa[c] = saa;
+    bb[c] = sbb;
+    ab[c] = sab;
+  }
+}
+
+double window_ssim(double sa, double sb, double saa, double sbb, double sab)
+{
+  constexpr double n = 64.;
+
+  double num = (2. * sa * sb + C1 * n * n) * (2. * (n * sab - sa * sb) + C2 * n * n);
+  double den = (sa * sa + sb * sb + C1 * n * n) * (n * saa - sa * sa + n * sbb - sb * sb + C2 * n * n);
+
+  return num / den;
+}
+
+// Windows [cx, cells - 1) of two rows of cells
+double sum_windows_scalar(const CellRow& previous, const CellRow& current, size_t cx)
+{
+  double total = 0.;
+
+  for(; cx + 1 < current.a.size(); ++cx) {
+    auto window = [&](const std::vector<uint32_t> CellRow::* sums) -> double {
+      return static_cast<double>((previous.*sums)[cx] + (previous.*sums)[cx + 1] + (current.*sums)[cx] + (current.*sums)[cx + 1]);
+    };
+
+    total += window_ssim(window(&CellRow::a), window(&CellRow::b), window(&CellRow::aa), window(&CellRow::bb), window(&CellRow::ab));
+  }
+
+  return total;
+}
+
+#if defined(__SSE2__)
+
+// SSE2 is in every x86-64 baseline, no dispatch needed. Other targets use
+// the scalar loops above.
+
+// madd pair sums of 8 pixels to the sums of their 2 cells, in the low half
+inline __m128i fold_pairs(__m128i pairs)
+{
+  __m128i sums = _mm_add_epi32(pairs, _mm_srli_epi64(pairs, 32));
+  return _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// 4 cells (16 pixels) per iteration : the pixels widened to 16 bits, sums
+// and products added in pairs by pmaddwd
+void sum_cells(const uint8_t* pa, int stride_a, const uint8_t* pb, int stride_b, CellRow& cells)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+
+  size_t count = cells.a.size();
+  size_t c = 0;
+
+  for(; c + 4 <= count; c += 4) {
+    __m128i sa[2] = { zero, zero }, sb[2] = { zero, zero };
+    __m128i saa[2] = { zero, zero }, sbb[2] = { zero, zero }, sab[2] = { zero, zero };
+
+    for(int r = 0; r < 4; ++r) {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pa + static_cast<size_t>(r) * stride_a + c * 4));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb + static_cast<size_t>(r) * stride_b + c * 4));
+      __m128i a16[2] = { _mm_unpacklo_epi8(va, zero), _mm_unpackhi_epi8(va, zero) };
+      __m128i b16[2] = { _mm_unpacklo_epi8(vb, zero), _mm_unpackhi_epi8(vb, zero) };
+
+      for(int h = 0; h < 2; ++h) {
+	sa[h] = _mm_add_epi32(sa[h], _mm_madd_epi16(a16[h], ones));
+	sb[h] = _mm_add_epi32(sb[h], _mm_madd_epi16(b16[h], ones));
+	saa[h] = _mm_add_epi32(saa[h], _mm_madd_epi16(a16[h], a16[h]));
+	sbb[h] = _mm_add_epi32(sbb[h], _mm_madd_epi16(b16[h], b16[h]));
+	sab[h] = _mm_add_epi32(sab[h], _mm_madd_epi16(a16[h], b16[h]));
+      }
+    }
+
+    auto store = [c](std::vector<uint32_t>& out, const __m128i (&pairs)[2]) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out.data() + c), _mm_unpacklo_epi64(fold_pairs(pairs[0]), fold_pairs(pairs[1])));
+    };
+
+    store(cells.a, sa);
+    store(cells.b, sb);
+    store(cells.aa, saa);
+    store(cells.bb, sbb);
+    store(cells.ab, sab);
+  }
+
+  sum_cells_scalar(pa, stride_a, pb, stride_b, c, cells);
+}
+
+// 4 windows per iteration. The variance and covariance terms cancel, they
+// are computed exactly in 32 bits integers (x264's bounds : at most 64 *
+// 2 * 64 * 255^2 < 2^31), only the ratio is in float.
+double sum_windows(const CellRow& previous, const CellRow& current)
+{
+  const __m128 c1 = _mm_set1_ps(static_cast<float>(C1 * 64. * 64.));
+  const __m128 c2 = _mm_set1_ps(static_cast<float>(C2 * 64. * 64.));
+  const __m128 two = _mm_set1_ps(2.f);
+
+  size_t count = current.a.size();
+  size_t cx = 0;
+  __m128 total = _mm_setzero_ps();
+
+  for(; cx + 5 <= count; cx += 4) {
+    auto window = [cx, &previous, &current](const std::vector<uint32_t> CellRow::* sums) {
+      auto load = [cx](const std::vector<uint32_t>& cells, size_t offset) {
+	return _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells.data() + cx + offset));
+      };
+      return _mm_add_epi32(_mm_add_epi32(load(previous.*sums, 0), load(previous.*sums, 1)),
+			   _mm_add_epi32(load(current.*sums, 0), load(current.*sums, 1)));
+    };
+
+    __m128i sa = window(&CellRow::a);
+    __m128i sb = window(&CellRow::b);
+    __m128i saa = window(&CellRow::aa);
+    __m128i sbb = window(&CellRow::bb);
+    __m128i sab = window(&CellRow::ab);
+
+    // sa, sb <= 64 * 255 < 2^15 and the high halves are 0 : pmaddwd is a
+    // 32 bits multiply
+    __m128i sasb = _mm_madd_epi16(sa, sb);
+    __m128i squares = _mm_add_epi32(_mm_madd_epi16(sa, sa), _mm_madd_epi16(sb, sb));
+    __m128i vars = _mm_sub_epi32(_mm_slli_epi32(_mm_add_epi32(saa, sbb), 6), squares);
+    __m128i covar = _mm_sub_epi32(_mm_slli_epi32(sab, 6), sasb);
+
+    __m128 num = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, _mm_cvtepi32_ps(sasb)), c1),
+			    _mm_add_ps(_mm_mul_ps(two, _mm_cvtepi32_ps(covar)), c2));
+    __m128 den = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(squares), c1),
+			    _mm_add_ps(_mm_cvtepi32_ps(vars), c2));
+
+    total = _mm_add_ps(total, _mm_div_ps(num, den));
+  }
+
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, total);
+
+  return static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3] + sum_windows_scalar(previous, current, cx);
+}
+
+#else
+
+void sum_cells(const uint8_t* pa, int stride_a, const uint8_t* pb, int stride_b, CellRow& cells)
+{
+  sum_cells_scalar(pa, stride_a, pb, stride_b, 0, cells);
+}
+
+double sum_windows(const CellRow& previous, const CellRow& current)
+{
+  return sum_windows_scalar(previous, current, 0);
+}
+
+#endif
+
+}
+
+uint64_t plane_sse(const uint8_t* a, int stride_a, const uint8_t* b, int stride_b, int width, int height)
+{
+  return libyuv::ComputeSumSquareErrorPlane(a, stride_a, b, stride_b, width, height);
+}
+
+double sse_to_psnr(uint64_t sse, uint64_t samples)
+{
+  return libyuv::SumSquareErrorToPsnr(sse, samples);
+}
+
+double plane_ssim(const uint8_t* a, int stride_a, const uint8_t* b, int stride_b, int width, int height)
+{
+  size_t cells_x = width / 4;
+  size_t cells_y = height / 4;
+
+  if(cells_x < 2 || cells_y < 2) return 0.;
+
+  CellRow previous(cells_x);
+  CellRow current(cells_x);
+
+  sum_cells(a, stride_a, b, stride_b, previous);
+
+  double total = 0.;
+
+  // Each 8x8 window is 2x2 cells, windows overlap by one cell
+  for(size_t cy = 1; cy < cells_y; ++cy) {
+    size_t row = cy * 4;
+    sum_cells(a + row * stride_a, stride_a, b + row * stride_b, stride_b, current);
+
+    total += sum_windows(previous, current);
+
+    std::swap(previous, current);
+  }
+
+  return total / static_cast<double>((cells_x - 1) * (cells_y - 1));
+}
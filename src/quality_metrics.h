@@ -0,0 +1,19 @@
+#ifndef QUALITY_METRICS_H
+#define QUALITY_METRICS_H
+
+#include <cstdint>
+
+// Full reference metrics of one image plane against another of the same size
+
+// Sum of squared differences, libyuv's SSE2 / AVX2 / NEON kernels
+uint64_t plane_sse(const uint8_t* a, int stride_a, const uint8_t* b, int stride_b, int width, int height);
+
+// dB, capped for identical planes
+double sse_to_psnr(uint64_t sse, uint64_t samples);
+
+// Mean SSIM over 8x8 windows on a 4 pixels grid (x264 / libyuv style). The
+// window sums are built from 4x4 cell sums, each pixel read once. SSE2
+// kernels on x86-64, 4 cells and 4 windows at a time, plain loops elsewhere.
+double plane_ssim(const uint8_t* a, int stride_a, const uint8_t* b, int stride_b, int width, int height);
+
+#endif /* QUALITY_METRICS_H */
@@ -0,0 +1,378 @@
+#include "quality_scorer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <api/video/i420_buffer.h>
+#include <rtc_base/time_utils.h>
+
+#include "quality_metrics.h"
+#include "synthetic_source.h"
+#include "tunnel_loggin.h"
+
+namespace
+{
+  constexpr uint32_t RTP_CLOCK = 90000;
+  constexpr int      STAMP_MARGIN = 4;
+
+  struct Aggregate
+  {
+    double mean = 0.;
+    double min = 0.;
+    double p5 = 0.;
+  };
+
+  Aggregate aggregate(std::vector<float> values)
+  {
+    if(values.empty()) return {};
+
+    std::ranges::sort(values);
+
+    double sum = 0.;
+    for(float v : values) sum += v;
+
+    return { sum / values.size(), values.front(), values[values.size() * 5 / 100] };
+  }
+
+  nlohmann::json aggregate_json(const Aggregate& a)
+  {
+    return nlohmann::json{ { "mean", a.mean }, { "min", a.min }, { "p5", a.p5 } };
+  }
+}
+
+QualityScorer::QualityScorer(std::shared_ptr<const ReferenceVideo> reference, Config config)
+  : _reference(std::move(reference)), _config(config)
+{
+  _records.reserve(static_cast<size_t>(_reference->fps() * 600));
+  _offset = _config.offset;
+
+  for(int i = 0; i < std::max(1, _config.threads); ++i) _workers.emplace_back([this]() { work(); });
+}
+
+QualityScorer::~QualityScorer()
+{
+  {
+    std::lock_guard<std::mutex> lock(_queue_mutex);
+    _stopping = true;
+  }
+
+  _queue_cv.notify_all();
+  for(auto& th : _workers) th.join();
+}
+
+std::optional<QualityScorer::Match> QualityScorer::parse_match(std::string_view name)
+{
+  if(name == "stamp") return Match::STAMP;
+  if(name == "rtp") return Match::RTP;
+
+  return std::nullopt;
+}
+
+void QualityScorer::OnFrame(const webrtc::VideoFrame& frame)
+{
+  Job job{ _seq.fetch_add(1, std::memory_order_relaxed), frame.timestamp(), 0, frame.video_frame_buffer() };
+
+  // Frame i of the reference was sent i frame periods after the first one
+  if(_config.match == Match::RTP) {
+    if(!_first_rtp) _first_rtp = job.rtp_timestamp;
+
+    double period = RTP_CLOCK / _reference->fps();
+    job.periods = static_cast<uint64_t>(std::llround((job.rtp_timestamp - *_first_rtp) / period));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_queue_mutex);
+
+    // Until the offset is known the frames wait, a worker searches it once
+    // align_frames are in
+    if(_config.match == Match::RTP && !_offset) {
+      if(_aligning.size() >= _config.align_frames + _config.queue) {
+	_dropped.fetch_add(1, std::memory_order_relaxed);
+	return;
+      }
+
+      _aligning.push_back(std::move(job));
+      if(_aligning.size() >= _config.align_frames && !_align_running) _align_ready = true;
+    }
+    else {
+      if(_queue.size() >= _config.queue) {
+	_dropped.fetch_add(1, std::memory_order_relaxed);
+	return;
+      }
+
+      _queue.push_back(std::move(job));
+    }
+  }
+
+  _queue_cv.notify_one();
+}
+
+void QualityScorer::work()
+{
+  std::unique_lock<std::mutex> lock(_queue_mutex);
+
+  while(true) {
+    _queue_cv.wait(lock, [this]() { return _stopping || _align_ready || !_queue.empty(); });
+    if(_stopping) return;
+
+    if(_align_ready) {
+      _align_ready = false;
+      _align_running = true;
+      std::vector<Job> jobs = _aligning;
+      ++_busy;
+      lock.unlock();
+
+      uint32_t offset = align(jobs);
+      jobs.clear();
+
+      // The frames that came in meanwhile are scored with the same offset
+      lock.lock();
+      _offset = offset;
+      _align_running = false;
+      for(auto& job : _aligning) _queue.push_back(std::move(job));
+      _aligning.clear();
+      --_busy;
+
+      _queue_cv.notify_all();
+      continue;
+    }
+
+    Job job = std::move(_queue.front());
+    _queue.pop_front();
+    std::optional<uint32_t> offset = _offset;
+    ++_busy;
+    lock.unlock();
+
+    int64_t start_us = rtc::TimeMicros();
+    auto buffer = job.buffer->ToI420();
+
+    // The synthetic source counts from 1, like the frames of the reference
+    std::optional<uint32_t> reference;
+    if(_config.match == Match::RTP) {
+      reference = static_cast<uint32_t>((job.periods + *offset) % _reference->size());
+    }
+    else if(buffer) {
+      uint32_t counter = SyntheticVideoSource::read_stamp(*buffer);
+      if(counter != 0) reference = static_cast<uint32_t>((counter - 1) % _reference->size());
+    }
+
+    if(reference && buffer) {
+      auto record = score(job, buffer, *reference);
+      _score_time.record(rtc::TimeMicros() - start_us);
+
+      std::lock_guard<std::mutex> records_lock(_records_mutex);
+      _records.push_back(record);
+    }
+    else {
+      _unmatched.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Released outside of the lock, it goes back to the decoder's pool
+    job.buffer = nullptr;
+    buffer = nullptr;
+
+    lock.lock();
+    --_busy;
+    if(_queue.empty() && _aligning.empty() && _busy == 0) _idle_cv.notify_all();
+  }
+}
+
+uint32_t QualityScorer::align(const std::vector<Job>& jobs) const
+{
+  auto& ref = *_reference;
+
+  struct Sample
+  {
+    uint64_t                                        periods;
+    rtc::scoped_refptr<webrtc::I420BufferInterface> buffer;
+  };
+
+  std::vector<Sample> samples;
+  for(auto& job : jobs) {
+    if(auto buffer = job.buffer->ToI420()) samples.push_back({ job.periods, at_reference_size(buffer) });
+  }
+
+  if(samples.empty()) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Quality : no decoded frame to align on, RTP offset 0";
+    return 0;
+  }
+
+  size_t candidates = std::clamp<size_t>(_config.align_search, 1, ref.size());
+  uint32_t best = 0;
+  uint64_t best_sse = std::numeric_limits<uint64_t>::max();
+
+  // Luma only, a candidate is given up as soon as it is worse than the best
+  for(size_t offset = 0; offset < candidates; ++offset) {
+    uint64_t sse = 0;
+
+    for(auto& s : samples) {
+      auto frame = ref.frame((s.periods + offset) % ref.size());
+      sse += plane_sse(s.buffer->DataY(), s.buffer->StrideY(), frame.y, ref.width(), ref.width(), ref.height());
+      if(sse >= best_sse) break;
+    }
+
+    if(sse < best_sse) {
+      best_sse = sse;
+      best = static_cast<uint32_t>(offset);
+    }
+  }
+
+  uint64_t luma = static_cast<uint64_t>(ref.width()) * ref.height() * samples.size();
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Quality : RTP offset " << best << ", best match of " << samples.size() << " decoded frames among "
+					    << candidates << " reference frames, psnr_y " << sse_to_psnr(best_sse, luma);
+
+  return best;
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> QualityScorer::at_reference_size(rtc::scoped_refptr<webrtc::I420BufferInterface> buffer) const
+{
+  if(buffer->width() == _reference->width() && buffer->height() == _reference->height()) return buffer;
+
+  // Compared at the reference size, as a viewer would see it upscaled
+  auto scaled = webrtc::I420Buffer::Create(_reference->width(), _reference->height());
+  scaled->ScaleFrom(*buffer);
+  return scaled;
+}
+
+QualityScorer::Record QualityScorer::score(const Job& job, const rtc::scoped_refptr<webrtc::I420BufferInterface>& decoded, uint32_t reference) const
+{
+  auto& ref = *_reference;
+  auto frame = ref.frame(reference);
+
+  bool rescaled = decoded->width() != ref.width() || decoded->height() != ref.height();
+  auto buffer = at_reference_size(decoded);
+
+  // The stamp differs from the reference's past the first period, its rows
+  // and the ringing below them are left out of the luma. Chroma is neutral there
+  int top = _config.match == Match::STAMP ? std::min(ref.height() / 2, SyntheticVideoSource::stamp_height(ref.height()) + STAMP_MARGIN) : 0;
+  int height = ref.height() - top;
+  const uint8_t* decoded_y = buffer->DataY() + static_cast<size_t>(top) * buffer->StrideY();
+  const uint8_t* reference_y = frame.y + static_cast<size_t>(top) * ref.width();
+
+  uint64_t luma = static_cast<uint64_t>(ref.width()) * height;
+  uint64_t chroma = static_cast<uint64_t>(ref.chroma_width()) * ref.chroma_height();
+
+  uint64_t sse_y = plane_sse(decoded_y, buffer->StrideY(), reference_y, ref.width(), ref.width(), height);
+  uint64_t sse_u = plane_sse(buffer->DataU(), buffer->StrideU(), frame.u, ref.chroma_width(), ref.chroma_width(), ref.chroma_height());
+  uint64_t sse_v = plane_sse(buffer->DataV(), buffer->StrideV(), frame.v, ref.chroma_width(), ref.chroma_width(), ref.chroma_height());
+
+  return Record{
+    .seq = job.seq,
+    .rtp_timestamp = job.rtp_timestamp,
+    .reference = reference,
+    .psnr_y = static_cast<float>(sse_to_psnr(sse_y, luma)),
+    .psnr = static_cast<float>(sse_to_psnr(sse_y + sse_u + sse_v, luma + 2 * chroma)),
+    .ssim = static_cast<float>(plane_ssim(decoded_y, buffer->StrideY(), reference_y, ref.width(), ref.width(), height)),
+    .scaled = rescaled
+  };
+}
+
+void QualityScorer::drain()
+{
+  std::unique_lock<std::mutex> lock(_queue_mutex);
+
+  // Fewer frames than align_frames in the run, the search makes do
+  if(!_aligning.empty() && !_align_running) {
+    _align_ready = true;
+    _queue_cv.notify_one();
+  }
+
+  _idle_cv.wait(lock, [this]() { return _queue.empty() && _aligning.empty() && _busy == 0; });
+}
+
+void QualityScorer::reset()
+{
+  drain();
+
+  {
+    std::lock_guard<std::mutex> lock(_records_mutex);
+    _records.clear();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_queue_mutex);
+    _offset = _config.offset;
+  }
+
+  _seq = 0;
+  _first_rtp.reset();
+  _dropped = 0;
+  _unmatched = 0;
+  _score_time.reset();
+}
+
+std::vector<QualityScorer::Record> QualityScorer::records() const
+{
+  std::vector<Record> records;
+  {
+    std::lock_guard<std::mutex> lock(_records_mutex);
+    records = _records;
+  }
+
+  // Workers finish out of order
+  std::ranges::sort(records, {}, &Record::seq);
+  return records;
+}
+
+nlohmann::json QualityScorer::summary(const std::vector<Record>& scored) const
+{
+  std::vector<float> psnr_y, psnr, ssim;
+  size_t scaled = 0;
+
+  for(auto& r : scored) {
+    psnr_y.push_back(r.psnr_y);
+    psnr.push_back(r.psnr);
+    ssim.push_back(r.ssim);
+    if(r.scaled) ++scaled;
+  }
+
+  std::optional<uint32_t> offset;
+  {
+    std::lock_guard<std::mutex> lock(_queue_mutex);
+    offset = _offset;
+  }
+
+  return nlohmann::json{
+    { "match", _config.match == Match::STAMP ? "stamp" : "rtp" },
+    { "offset", _config.match == Match::RTP && offset ? nlohmann::json(*offset) : nlohmann::json() },
+    { "reference", { { "width", _reference->width() }, { "height", _reference->height() }, { "fps", _reference->fps() }, { "frames", _reference->size() } } },
+    { "frames", _seq.load() },
+    { "scored", scored.size() },
+    { "dropped", _dropped.load() },
+    { "unmatched", _unmatched.load() },
+    { "scaled", scaled },
+    { "psnr_y", aggregate_json(aggregate(std::move(psnr_y))) },
+    { "psnr", aggregate_json(aggregate(std::move(psnr))) },
+    { "ssim", aggregate_json(aggregate(std::move(ssim))) },
+    { "score_us", { { "p50", _score_time.percentile(0.5) }, { "p95", _score_time.percentile(0.95) }, { "max", _score_time.max() } } }
+  };
+}
+
+nlohmann::json QualityScorer::to_json() const
+{
+  using json = nlohmann::json;
+
+  auto scored = records();
+  if(!_config.per_frame) return json{ { "summary", summary(scored) } };
+
+  // Rows rather than objects, the keys would be most of the upload
+  json frames = json::array();
+  for(auto& r : scored) frames.push_back(json::array({ r.seq, r.rtp_timestamp, r.reference, r.psnr_y, r.psnr, r.ssim, r.scaled }));
+
+  return json{
+    { "summary", summary(scored) },
+    { "columns", { "seq", "rtp_timestamp", "reference", "psnr_y", "psnr", "ssim", "scaled" } },
+    { "frames", std::move(frames) }
+  };
+}
+
+void QualityScorer::log() const
+{
+  auto stats = summary(records());
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Quality : " << stats["scored"] << "/" << stats["frames"] << " frames scored, dropped : "
+					    << stats["dropped"] << ", unmatched : " << stats["unmatched"] << ", scaled : " << stats["scaled"];
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Quality : psnr_y " << stats["psnr_y"].dump() << ", psnr " << stats["psnr"].dump()
+					    << ", ssim " << stats["ssim"].dump() << ", score time (us) " << stats["score_us"].dump();
+}
@@ -0,0 +1,130 @@
+#ifndef QUALITY_SCORER_H
+#define QUALITY_SCORER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+#include <api/scoped_refptr.h>
+#include <api/video/video_frame.h>
+#include <api/video/video_frame_buffer.h>
+#include <api/video/video_sink_interface.h>
+
+#include "nlohmann/json.hpp"
+
+#include "latency_histogram.h"
+#include "reference_video.h"
+
+// Full reference quality of the decoded frames: each one is matched to a
+// frame of a local reference sequence, by the counter the synthetic source
+// stamps in the picture or by RTP timestamp at the reference frame rate,
+// and its PSNR and SSIM computed on a pool of worker threads. OnFrame only
+// queues a reference to the decoded buffer, when the workers fall behind
+// frames are dropped from the scoring, never held back from the decoder.
+// Matched by RTP timestamp, the reference frame of the first decoded one is
+// not known : unless given, it is searched among the first reference
+// frames with the first few decoded frames, those wait for the search.
+// Matched by stamp, the reference is a period written by the synthetic
+// source (SyntheticVideoSource::write_reference) and the stamp rows are
+// not scored.
+class QualityScorer : public rtc::VideoSinkInterface<webrtc::VideoFrame>
+{
+public:
+  enum class Match : uint8_t { STAMP, RTP };
+
+  struct Config
+  {
+    Match  match = Match::RTP;
+    int    threads = 2;
+    size_t queue = 8;         // decoded frames waiting for a worker
+    bool   per_frame = true;  // every frame in to_json(), not only the summary
+
+    // RTP matching : reference frame of the first decoded frame, or searched
+    // among the first align_search reference frames with align_frames
+    // decoded ones
+    std::optional<uint32_t> offset;
+    size_t                  align_search = 60;
+    size_t                  align_frames = 4;
+  };
+
+  struct Record
+  {
+    uint64_t seq;        // decoded frame, from 0
+    uint32_t rtp_timestamp;
+    uint32_t reference;  // frame index in the reference
+    float    psnr_y;     // dB
+    float    psnr;       // dB, the 3 planes
+    float    ssim;       // luma
+    bool     scaled;     // decoded at another size, scaled up to the reference's
+  };
+
+  QualityScorer(std::shared_ptr<const ReferenceVideo> reference, Config config);
+  ~QualityScorer() override;
+
+  static std::optional<Match> parse_match(std::string_view name);
+
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+  // Waits for the queued frames to be scored
+  void drain();
+  // Between runs, while no frame comes in
+  void reset();
+
+  // Summary of the run and the frames, in decode order
+  nlohmann::json to_json() const;
+  void log() const;
+
+private:
+  struct Job
+  {
+    uint64_t                                     seq;
+    uint32_t                                     rtp_timestamp;
+    uint64_t                                     periods;   // RTP mode : frame periods since the first decoded frame
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer;    // converted to I420 by the worker
+  };
+
+  std::shared_ptr<const ReferenceVideo> _reference;
+  Config                                _config;
+
+  mutable std::mutex       _queue_mutex;
+  std::condition_variable  _queue_cv;
+  std::condition_variable  _idle_cv;
+  std::deque<Job>          _queue;
+  size_t                   _busy = 0;
+  std::optional<uint32_t>  _offset;          // RTP mode, once known
+  std::vector<Job>         _aligning;        // waiting for _offset
+  bool                     _align_ready = false;   // for a worker to search
+  bool                     _align_running = false;
+  bool                     _stopping = false;
+  std::vector<std::thread> _workers;
+
+  mutable std::mutex  _records_mutex;
+  std::vector<Record> _records;
+
+  // Decode thread
+  std::atomic<uint64_t>   _seq = 0;
+  std::optional<uint32_t> _first_rtp;
+
+  std::atomic<uint64_t> _dropped = 0;   // queue full
+  std::atomic<uint64_t> _unmatched = 0; // no readable stamp
+  LatencyHistogram      _score_time;
+
+  void work();
+  // Reference frame of the first decoded one, the best luma match of the
+  // first frames
+  uint32_t align(const std::vector<Job>& jobs) const;
+  rtc::scoped_refptr<webrtc::I420BufferInterface> at_reference_size(rtc::scoped_refptr<webrtc::I420BufferInterface> buffer) const;
+  Record score(const Job& job, const rtc::scoped_refptr<webrtc::I420BufferInterface>& decoded, uint32_t reference) const;
+  // Copy sorted by seq
+  std::vector<Record> records() const;
+  nlohmann::json summary(const std::vector<Record>& scored) const;
+};
+
+#endif /* QUALITY_SCORER_H */
@@ -0,0 +1,213 @@
+#include "reference_video.h"
+
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tunnel_loggin.h"
+
+namespace
+{
+  constexpr std::string_view Y4M_MAGIC = "YUV4MPEG2";
+  constexpr std::string_view Y4M_FRAME = "FRAME";
+
+  template<typename T>
+  bool parse_number(std::string_view text, T& value)
+  {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size();
+  }
+}
+
+bool ReferenceVideo::map(const std::filesystem::path& path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << path.string() << " : " << std::strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size == 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Empty reference video " << path.string();
+    ::close(fd);
+    return false;
+  }
+
+  _map_size = st.st_size;
+  _map = mmap(nullptr, _map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if(_map == MAP_FAILED) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not map " << path.string() << " : " << std::strerror(errno);
+    _map = nullptr;
+    return false;
+  }
+
+  // Frames are read in order, from several scoring threads
+  madvise(_map, _map_size, MADV_WILLNEED);
+
+  return true;
+}
+
+bool ReferenceVideo::open(const std::filesystem::path& path)
+{
+  if(!map(path)) return false;
+
+  if(!parse_y4m(path)) {
+    close();
+    return false;
+  }
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Reference " << path.string() << " : " << _width << "x" << _height << "@" << _fps
+					    << ", " << _offsets.size() << " frames";
+  return true;
+}
+
+bool ReferenceVideo::open(const std::filesystem::path& path, int width, int height, double fps)
+{
+  if(width <= 0 || height <= 0 || fps <= 0.) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Invalid size for the reference " << path.string();
+    return false;
+  }
+
+  if(!map(path)) return false;
+
+  _width = width;
+  _height = height;
+  _fps = fps;
+
+  size_t count = _map_size / frame_size();
+  if(count == 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Reference " << path.string() << " is smaller than one " << width << "x" << height << " frame";
+    close();
+    return false;
+  }
+
+  if(_map_size % frame_size() != 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Reference " << path.string() << " does not hold a whole number of frames, is the size right ?";
+  }
+
+  _offsets.resize(count);
+  for(size_t i = 0; i < count; ++i) _offsets[i] = i * frame_size();
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Reference " << path.string() << " : " << _width << "x" << _height << "@" << _fps
+					    << ", " << count << " frames";
+  return true;
+}
+
+bool ReferenceVideo::parse_y4m(const std::filesystem::path& path)
+{
+  std::string_view data(static_cast<const char*>(_map), _map_size);
+
+  auto eol = data.find('\n');
+  if(!data.starts_with(Y4M_MAGIC) || eol == std::string_view::npos) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << path.string() << " is not a Y4M file, give the size of a raw I420 reference";
+    return false;
+  }
+
+  // YUV4MPEG2 W<width> H<height> F<num>:<den> [I.. A.. C.. X..]
+  std::string_view header = data.substr(Y4M_MAGIC.size(), eol - Y4M_MAGIC.size());
+  _fps = 30.;
+
+  while(!header.empty()) {
+    auto start = header.find_first_not_of(' ');
+    if(start == std::string_view::npos) break;
+
+    header.remove_prefix(start);
+    auto end = header.find(' ');
+    auto tag = header.substr(0, end);
+    header.remove_prefix(end == std::string_view::npos ? header.size() : end);
+
+    auto value = tag.substr(1);
+    bool valid = true;
+
+    switch(tag[0]) {
+    case 'W': valid = parse_number(value, _width); break;
+    case 'H': valid = parse_number(value, _height); break;
+    case 'F': {
+      auto colon = value.find(':');
+      int num = 0, den = 0;
+      valid = colon != std::string_view::npos && parse_number(value.substr(0, colon), num) && parse_number(value.substr(colon + 1), den) && den > 0;
+      if(valid) _fps = static_cast<double>(num) / den;
+      break;
+    }
+    case 'C':
+      // Only the chroma siting differs, 420p10 and the others are not 8 bits I420
+      if(value != "420" && value != "420jpeg" && value != "420paldv" && value != "420mpeg2") {
+	TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Unsupported Y4M colorspace " << value << " in " << path.string() << ", I420 only";
+	return false;
+      }
+      break;
+    default:
+      break;
+    }
+
+    if(!valid) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Invalid Y4M header tag " << tag << " in " << path.string();
+      return false;
+    }
+  }
+
+  if(_width <= 0 || _height <= 0) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "No frame size in the Y4M header of " << path.string();
+    return false;
+  }
+
+  // Every frame is a FRAME line, possibly with parameters, then the planes
+  size_t offset = eol + 1;
+
+  while(offset < data.size()) {
+    auto line_end = data.find('\n', offset);
+
+    if(data.compare(offset, Y4M_FRAME.size(), Y4M_FRAME) != 0 || line_end == std::string_view::npos) {
+      TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Invalid Y4M frame header in " << path.string() << " after " << _offsets.size() << " frames";
+      break;
+    }
+
+    size_t planes = line_end + 1;
+    if(planes + frame_size() > data.size()) {
+      TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Truncated Y4M frame in " << path.string() << " after " << _offsets.size() << " frames";
+      break;
+    }
+
+    _offsets.push_back(planes);
+    offset = planes + frame_size();
+  }
+
+  if(_offsets.empty()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "No frame in " << path.string();
+    return false;
+  }
+
+  return true;
+}
+
+void ReferenceVideo::close()
+{
+  if(_map) munmap(_map, _map_size);
+
+  _map = nullptr;
+  _map_size = 0;
+  _width = 0;
+  _height = 0;
+  _fps = 0.;
+  _offsets.clear();
+}
+
+ReferenceVideo::Frame ReferenceVideo::frame(size_t i) const
+{
+  auto y = static_cast<const uint8_t*>(_map) + _offsets[i];
+  auto u = y + static_cast<size_t>(_width) * _height;
+  auto v = u + static_cast<size_t>(chroma_width()) * chroma_height();
+
+  return { y, u, v };
+}
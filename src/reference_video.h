@@ -0,0 +1,55 @@
+#ifndef REFERENCE_VIDEO_H
+#define REFERENCE_VIDEO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+// Read only mmap'ed reference sequence for the quality scoring, 8 bits
+// I420 only : a Y4M file (4:2:0 chroma, any siting) or raw frames whose
+// size is given. Frames are read in place, nothing is copied.
+class ReferenceVideo
+{
+public:
+  struct Frame
+  {
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+  };
+
+  ReferenceVideo() = default;
+  ReferenceVideo(const ReferenceVideo&) = delete;
+  ReferenceVideo& operator=(const ReferenceVideo&) = delete;
+  ~ReferenceVideo() { close(); }
+
+  // Y4M, size and frame rate from the header
+  bool open(const std::filesystem::path& path);
+  // Raw I420
+  bool open(const std::filesystem::path& path, int width, int height, double fps);
+  void close();
+
+  int    width() const { return _width; }
+  int    height() const { return _height; }
+  int    chroma_width() const { return (_width + 1) / 2; }
+  int    chroma_height() const { return (_height + 1) / 2; }
+  double fps() const { return _fps; }
+  size_t size() const { return _offsets.size(); }
+
+  Frame frame(size_t i) const;
+
+private:
+  void*               _map = nullptr;
+  size_t              _map_size = 0;
+  int                 _width = 0;
+  int                 _height = 0;
+  double              _fps = 0.;
+  std::vector<size_t> _offsets;  // of the Y plane of each frame
+
+  bool map(const std::filesystem::path& path);
+  bool parse_y4m(const std::filesystem::path& path);
+  size_t frame_size() const { return static_cast<size_t>(_width) * _height + 2 * static_cast<size_t>(chroma_width()) * chroma_height(); }
+};
+
+#endif /* REFERENCE_VIDEO_H */
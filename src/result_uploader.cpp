@@ -0,0 +1,276 @@
+#include "result_uploader.h"
+
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/connect.hpp>
+#include <asio/write.hpp>
+#include <asio/read_until.hpp>
+#include <asio/buffer.hpp>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+#include "zip_writer.h"
+#include "tunnel_loggin.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+  using tcp = asio::ip::tcp;
+
+  // Blocking connection with a deadline on every operation : each one is
+  // started asynchronously and the context run until it completes or the
+  // deadline passes, which closes the socket.
+  class HttpConnection
+  {
+    asio::io_context          _io;
+    tcp::socket               _socket{_io};
+    std::chrono::milliseconds _timeout;
+
+    template<typename Op>
+    size_t run(Op&& op)
+    {
+      std::optional<std::error_code> result;
+      size_t transferred = 0;
+
+      op([&result, &transferred](const auto& ec, auto&& n) {
+	result = ec;
+	if constexpr(std::is_integral_v<std::decay_t<decltype(n)>>) transferred = n;
+      });
+
+      _io.restart();
+      _io.run_for(_timeout);
+
+      if(!result) {
+	asio::error_code ignored;
+	_socket.close(ignored);
+	_io.restart();
+	_io.run();
+	throw std::system_error(std::make_error_code(std::errc::timed_out));
+      }
+
+      if(*result) throw std::system_error(*result);
+      return transferred;
+    }
+
+  public:
+    explicit HttpConnection(std::chrono::milliseconds timeout) : _timeout(timeout) {}
+
+    void connect(const std::string& host, const std::string& port)
+    {
+      tcp::resolver resolver(_io);
+      auto endpoints = resolver.resolve(host, port);
+      run([&](auto&& handler) { asio::async_connect(_socket, endpoints, handler); });
+    }
+
+    void write(const void* data, size_t size)
+    {
+      run([&](auto&& handler) { asio::async_write(_socket, asio::buffer(data, size), handler); });
+    }
+
+    void write(const std::string& data) { write(data.data(), data.size()); }
+
+    // Up to the end of the headers, the body is not used
+    std::string read_headers()
+    {
+      std::string response;
+      run([&](auto&& handler) { asio::async_read_until(_socket, asio::dynamic_buffer(response), "\r\n\r\n", handler); });
+      return response;
+    }
+  };
+
+  // Transfer-Encoding: chunked body, buffered in chunks of 64 KiB
+  class ChunkedBody
+  {
+    HttpConnection&      _connection;
+    std::vector<uint8_t> _buffer;
+
+  public:
+    explicit ChunkedBody(HttpConnection& connection) : _connection(connection) { _buffer.reserve(64 * 1024); }
+
+    void write(const void* data, size_t size)
+    {
+      auto bytes = static_cast<const uint8_t*>(data);
+
+      while(size > 0) {
+	size_t n = std::min(size, _buffer.capacity() - _buffer.size());
+	_buffer.insert(_buffer.end(), bytes, bytes + n);
+	bytes += n;
+	size -= n;
+
+	if(_buffer.size() == _buffer.capacity()) flush();
+      }
+    }
+
+    void write(const std::string& data) { write(data.data(), data.size()); }
+
+    void flush()
+    {
+      if(_buffer.empty()) return;
+
+      _connection.write(fmt::format("{:x}\r\n", _buffer.size()));
+      _connection.write(_buffer.data(), _buffer.size());
+      _connection.write("\r\n");
+      _buffer.clear();
+    }
+
+    void finish()
+    {
+      flush();
+      _connection.write("0\r\n\r\n");
+    }
+  };
+
+  std::string make_boundary()
+  {
+    static thread_local std::mt19937_64 rng{std::random_device{}()};
+    return fmt::format("----qclient{:016x}{:016x}", rng(), rng());
+  }
+}
+
+ResultUploader::ResultUploader(Config config) : _config(std::move(config))
+{
+  for(size_t i = 0; i < std::max<size_t>(_config.workers, 1); ++i) {
+    _workers.emplace_back([this]() { work(); });
+  }
+}
+
+ResultUploader::~ResultUploader()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _cv.notify_all();
+
+  for(auto& worker : _workers) {
+    if(worker.joinable()) worker.join();
+  }
+}
+
+std::future<bool> ResultUploader::submit(Job job)
+{
+  Task task{ std::move(job), {} };
+  auto future = task.done.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queue.push_back(std::move(task));
+  }
+  _cv.notify_one();
+
+  return future;
+}
+
+void ResultUploader::wait_idle()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _idle_cv.wait(lock, [this]() { return _queue.empty() && _busy == 0; });
+}
+
+void ResultUploader::work()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  while(true) {
+    // Queued uploads are finished before stopping
+    _cv.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+    if(_queue.empty()) return;
+
+    auto task = std::move(_queue.front());
+    _queue.pop_front();
+    ++_busy;
+    lock.unlock();
+
+    bool uploaded = false;
+    auto delay = _config.retry_delay;
+
+    for(int attempt = 1; attempt <= _config.attempts && !uploaded; ++attempt) {
+      try {
+	upload(task.job);
+	uploaded = true;
+	TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Uploaded " << task.job.directory.string();
+      }
+      catch(const std::exception& e) {
+	TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Upload of " << task.job.directory.string() << " failed (attempt "
+						     << attempt << "/" << _config.attempts << ") : " << e.what();
+	if(attempt < _config.attempts) {
+	  std::this_thread::sleep_for(delay);
+	  delay *= 2;
+	}
+      }
+    }
+
+    if(!uploaded) TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Giving up upload of " << task.job.directory.string();
+    task.done.set_value(uploaded);
+
+    lock.lock();
+    --_busy;
+    if(_queue.empty() && _busy == 0) _idle_cv.notify_all();
+  }
+}
+
+void ResultUploader::upload(const Job& job)
+{
+  // Regular files of the directory, in a stable order
+  std::vector<fs::path> files;
+  for(auto& entry : fs::directory_iterator(job.directory)) {
+    if(entry.is_regular_file() && entry.path().filename() != "upload.zip") files.push_back(entry.path());
+  }
+  std::ranges::sort(files);
+
+  auto boundary = make_boundary();
+
+  HttpConnection connection(_config.timeout);
+  connection.connect(_config.host, _config.port);
+
+  connection.write(fmt::format("POST {} HTTP/1.1\r\n"
+			       "Host: {}:{}\r\n"
+			       "Content-Type: multipart/form-data; boundary={}\r\n"
+			       "Transfer-Encoding: chunked\r\n"
+			       "Connection: close\r\n"
+			       "\r\n",
+			       _config.target, _config.host, _config.port, boundary));
+
+  ChunkedBody body(connection);
+
+  for(auto& [name, value] : job.fields) {
+    body.write(fmt::format("--{}\r\nContent-Disposition: form-data; name=\"{}\"\r\n\r\n{}\r\n", boundary, name, value));
+  }
+
+  body.write(fmt::format("--{}\r\n"
+			 "Content-Disposition: form-data; name=\"file\"; filename=\"upload.zip\"\r\n"
+			 "Content-Type: application/zip\r\n"
+			 "\r\n",
+			 boundary));
+
+  ZipWriter zip([&body](const uint8_t* data, size_t size) { body.write(data, size); });
+  for(auto& file : files) zip.add_file(file, file.filename().string());
+  zip.finish();
+
+  body.write(fmt::format("\r\n--{}--\r\n", boundary));
+  body.finish();
+
+  auto response = connection.read_headers();
+
+  // HTTP/1.1 200 OK
+  auto status_begin = response.find(' ');
+  int status = status_begin == std::string::npos ? 0 : std::atoi(response.c_str() + status_begin + 1);
+
+  if(status < 200 || status >= 300) {
+    throw std::runtime_error("server answered " + response.substr(0, response.find("\r\n")));
+  }
+
+  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "Uploaded " << files.size() << " files, " << zip.size() << " bytes zipped";
+}
@@ -0,0 +1,74 @@
+#ifndef RESULT_UPLOADER_H
+#define RESULT_UPLOADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Uploads result directories to the collection server : the directory is
+// zipped on the fly into the file part of a chunked multipart/form-data
+// POST, as `curl -Ffile=@upload.zip -Fexp=... ` used to. Jobs run on a
+// few worker threads of their own and are retried with a backoff, the
+// caller never waits on them.
+class ResultUploader
+{
+public:
+  struct Config
+  {
+    std::string               host = "localhost";
+    std::string               port = "4455";
+    std::string               target = "/";
+    size_t                    workers = 2;  // uploads in flight at most
+    int                       attempts = 3;
+    std::chrono::milliseconds retry_delay{1000}; // doubled on each retry
+    std::chrono::milliseconds timeout{30000};    // per network operation
+  };
+
+  struct Job
+  {
+    std::filesystem::path                            directory;
+    std::vector<std::pair<std::string, std::string>> fields; // form fields besides the file
+  };
+
+  explicit ResultUploader(Config config);
+  ResultUploader() : ResultUploader(Config{}) {}
+  // Finishes the queued uploads
+  ~ResultUploader();
+
+  ResultUploader(const ResultUploader&) = delete;
+  ResultUploader& operator=(const ResultUploader&) = delete;
+
+  // True once uploaded, false once every attempt failed
+  std::future<bool> submit(Job job);
+
+  // Blocks until nothing is queued nor uploading
+  void wait_idle();
+
+private:
+  struct Task
+  {
+    Job                job;
+    std::promise<bool> done;
+  };
+
+  Config                   _config;
+  std::mutex               _mutex;
+  std::condition_variable  _cv;
+  std::condition_variable  _idle_cv;
+  std::deque<Task>         _queue;
+  size_t                   _busy = 0;
+  bool                     _stopping = false;
+  std::vector<std::thread> _workers;
+
+  void work();
+  void upload(const Job& job);
+};
+
+#endif /* RESULT_UPLOADER_H */
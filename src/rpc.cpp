@@ -0,0 +1,133 @@
+#include "rpc.h"
+
+#include "tunnel_loggin.h"
+
+RpcChannel::RpcChannel(EventLoop& loop) : _loop(loop), _state(std::make_shared<State>())
+{
+}
+
+RpcChannel::~RpcChannel()
+{
+  fail_all("channel destroyed");
+}
+
+std::future<RpcChannel::json> RpcChannel::call(std::string_view cmd, const json& data, std::chrono::milliseconds timeout)
+{
+  auto promise = std::make_shared<std::promise<json>>();
+  auto future = promise->get_future();
+
+  send(cmd, data, timeout,
+       [promise](const json& data) { promise->set_value(data); },
+       [promise](std::exception_ptr e) { promise->set_exception(e); });
+
+  return future;
+}
+
+void RpcChannel::send(std::string_view cmd, const json& data, std::chrono::milliseconds timeout,
+		      Resolve resolve, Reject reject)
+{
+  int id = _next_id.fetch_add(1, std::memory_order_relaxed);
+
+  Pending pending;
+  pending.cmd = cmd;
+  pending.resolve = std::move(resolve);
+  pending.reject = std::move(reject);
+  pending.timer = std::make_unique<asio::steady_timer>(_loop.context(), timeout);
+
+  pending.timer->async_wait([weak = std::weak_ptr<State>(_state), id](const std::error_code& ec) {
+    if(ec) return; // cancelled by the reply
+
+    auto state = weak.lock();
+    if(!state) return;
+
+    std::unique_lock<std::mutex> lock(state->_mutex);
+    auto it = state->_pending.find(id);
+    if(it == state->_pending.end()) return;
+
+    auto node = state->_pending.extract(it);
+    lock.unlock();
+
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Request " << node.mapped().cmd << " (" << id << ") timed out";
+    node.mapped().reject(std::make_exception_ptr(RpcTimeout(node.mapped().cmd + " timed out")));
+  });
+
+  {
+    std::lock_guard<std::mutex> lock(_state->_mutex);
+    _state->_pending.emplace(id, std::move(pending));
+  }
+
+  json payload = {
+    { "cmd", cmd },
+    { "transId", id },
+    { "data", data }
+  };
+
+  try {
+    if(!sender) throw RpcError("no sender");
+    sender(payload);
+  }
+  catch(const std::exception& e) {
+    std::unique_lock<std::mutex> lock(_state->_mutex);
+    if(auto node = _state->_pending.extract(id)) {
+      lock.unlock();
+      node.mapped().timer->cancel();
+      node.mapped().reject(std::make_exception_ptr(RpcError(std::string(cmd) + " not sent : " + e.what())));
+    }
+  }
+}
+
+bool RpcChannel::on_message(const json& msg)
+{
+  auto trans_id = msg.find("transId");
+  if(trans_id == msg.end() || !trans_id->is_number_integer()) return false;
+
+  std::unique_lock<std::mutex> lock(_state->_mutex);
+  auto node = _state->_pending.extract(trans_id->get<int>());
+  lock.unlock();
+
+  if(!node) return false;
+
+  auto& pending = node.mapped();
+  pending.timer->cancel();
+
+  auto type = msg.find("type");
+  auto data = msg.find("data");
+
+  if(type != msg.end() && *type == "error") {
+    std::string message = pending.cmd + " failed";
+    if(data != msg.end() && data->is_object()) message += " : " + data->value("message", std::string{});
+    pending.reject(std::make_exception_ptr(RpcError(message)));
+    return true;
+  }
+
+  try {
+    pending.resolve(data != msg.end() ? *data : json::object());
+  }
+  catch(const json::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Invalid " << pending.cmd << " reply : " << e.what();
+    pending.reject(std::make_exception_ptr(RpcError(pending.cmd + " invalid reply : " + e.what())));
+  }
+
+  return true;
+}
+
+void RpcChannel::fail_all(std::string_view reason)
+{
+  std::unordered_map<int, Pending> pending;
+
+  {
+    std::lock_guard<std::mutex> lock(_state->_mutex);
+    pending.swap(_state->_pending);
+  }
+
+  for(auto& [id, p] : pending) {
+    p.timer->cancel();
+    p.reject(std::make_exception_ptr(RpcError(p.cmd + " aborted : " + std::string(reason))));
+  }
+}
+
+size_t RpcChannel::pending() const
+{
+  std::lock_guard<std::mutex> lock(_state->_mutex);
+  return _state->_pending.size();
+}
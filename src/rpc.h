@@ -0,0 +1,112 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <string>
+#include <exception>
+
+#include "nlohmann/json.hpp"
+
+#include "event_loop.h"
+
+#include <asio/steady_timer.hpp>
+
+class RpcError : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+class RpcTimeout : public RpcError
+{
+public:
+  using RpcError::RpcError;
+};
+
+// Request / response on top of a message channel. Requests are
+// { cmd, transId, data } with a transId unique to the channel, replies
+// { type: "response" | "error", transId, data }. Each call returns a future
+// completed by the reply, or failed by an error reply, its deadline or the
+// channel closing, so any number of calls can be in flight.
+class RpcChannel
+{
+public:
+  using json = nlohmann::json;
+
+  static constexpr std::chrono::milliseconds DEFAULT_TIMEOUT{10000};
+
+  explicit RpcChannel(EventLoop& loop = EventLoop::get());
+  ~RpcChannel();
+
+  RpcChannel(const RpcChannel&) = delete;
+  RpcChannel& operator=(const RpcChannel&) = delete;
+
+  // Puts a request on the wire, set by the owner of the connection
+  std::function<void(const json&)> sender;
+
+  std::future<json> call(std::string_view cmd, const json& data,
+			 std::chrono::milliseconds timeout = DEFAULT_TIMEOUT);
+
+  // Typed request (see messages.h), the future gets the decoded reply or
+  // an RpcError if it does not match Request::Reply
+  template<typename Request>
+  std::future<typename Request::Reply> call(const Request& request,
+					    std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+  {
+    using Reply = typename Request::Reply;
+
+    auto promise = std::make_shared<std::promise<Reply>>();
+    auto future = promise->get_future();
+
+    send(Request::cmd, json(request), timeout,
+	 [promise](const json& data) { promise->set_value(data.template get<Reply>()); },
+	 [promise](std::exception_ptr e) { promise->set_exception(e); });
+
+    return future;
+  }
+
+  // Returns true if msg answered one of our calls
+  bool on_message(const json& msg);
+
+  // Fails every pending call, i.e. the connection is gone
+  void fail_all(std::string_view reason);
+
+  size_t pending() const;
+
+private:
+  // resolve may throw a json::exception on a reply it can not decode
+  using Resolve = std::function<void(const json&)>;
+  using Reject = std::function<void(std::exception_ptr)>;
+
+  struct Pending
+  {
+    std::string                         cmd;
+    Resolve                             resolve;
+    Reject                              reject;
+    std::unique_ptr<asio::steady_timer> timer;
+  };
+
+  void send(std::string_view cmd, const json& data, std::chrono::milliseconds timeout,
+	    Resolve resolve, Reject reject);
+
+  // Timer handlers only hold a weak reference on it
+  struct State
+  {
+    mutable std::mutex                _mutex;
+    std::unordered_map<int, Pending>  _pending;
+  };
+
+  EventLoop&             _loop;
+  std::shared_ptr<State> _state;
+  std::atomic<int>       _next_id{1};
+};
+
+#endif /* RPC_H */
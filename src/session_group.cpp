@@ -0,0 +1,85 @@
+#include "session_group.h"
+
+#include <atomic>
+#include <thread>
+
+#include "tunnel_loggin.h"
+
+SessionGroup::SessionGroup(size_t count, const Setup& setup)
+{
+  for(size_t i = 0; i < count; ++i) {
+    auto session = std::make_unique<Session>(i);
+    if(setup) setup(*session);
+    _sessions.push_back(std::move(session));
+  }
+}
+
+void SessionGroup::each(const std::function<void(Session&)>& f)
+{
+  if(_sessions.size() == 1) {
+    f(*_sessions.front());
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for(auto& session : _sessions) {
+    threads.emplace_back([&f, &session]() { f(*session); });
+  }
+
+  for(auto& th : threads) th.join();
+}
+
+bool SessionGroup::connect()
+{
+  std::atomic<bool> ok = true;
+
+  each([&ok](Session& s) {
+    if(!s.tunnel.connect()) {
+      ok = false;
+      return;
+    }
+    s.tunnel.query_capabilities();
+  });
+
+  return ok;
+}
+
+void SessionGroup::disconnect()
+{
+  each([](Session& s) {
+    s.tunnel.disconnect();
+    s.medooze.disconnect();
+  });
+}
+
+void SessionGroup::run_all(int repet, const Constraints& c)
+{
+  run_all(repet, std::vector<Constraints>(_sessions.size(), c));
+}
+
+void SessionGroup::run_all(int repet, const std::vector<Constraints>& c)
+{
+  if(c.size() != _sessions.size()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "SessionGroup::run_all : " << c.size() << " constraints for "
+					       << _sessions.size() << " sessions";
+    return;
+  }
+
+  each([repet, &c](Session& s) {
+    auto constraints = c[s.index];
+    s.tunnel.run_all(repet, constraints);
+  });
+}
+
+void SessionGroup::run_jobs(const std::vector<ExperimentJob>& jobs)
+{
+  each([&jobs](Session& s) { s.tunnel.run_jobs(jobs); });
+}
+
+void SessionGroup::reset_link()
+{
+  std::vector<std::future<messages::Ack>> replies;
+  for(auto& session : _sessions) replies.push_back(session->tunnel.reset_link());
+
+  for(auto& reply : replies) TunnelMgr::wait(reply, "reset link");
+}
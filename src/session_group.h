@@ -0,0 +1,65 @@
+#ifndef SESSION_GROUP_H
+#define SESSION_GROUP_H
+
+#include <memory>
+#include <vector>
+#include <queue>
+#include <functional>
+
+#include "medooze_mgr.h"
+#include "peerconnection.h"
+#include "tunnel_mgr.h"
+#include "null_sink.h"
+
+// One receive session : its own medooze channel, PeerConnection and tunnel
+// ends, so its own stats, bitstream and link.
+struct Session
+{
+  size_t            index;
+  MedoozeMgr        medooze;
+  PeerconnectionMgr pc;
+  TunnelMgr         tunnel;
+  NullSink          sink;
+  std::unique_ptr<QualityScorer> quality; // set as pc.quality when scoring
+
+  explicit Session(size_t i) : index(i), tunnel(medooze, pc) {}
+};
+
+// N sessions in one process. They share the PeerConnectionFactory and its
+// threads, and the websocket event loop, each campaign runs on a thread of
+// its own.
+class SessionGroup
+{
+  std::vector<std::unique_ptr<Session>> _sessions;
+
+  // f(session) on every session concurrently
+  void each(const std::function<void(Session&)>& f);
+
+public:
+  using Setup = std::function<void(Session&)>;
+  using Constraints = std::queue<TunnelMgr::Constraints>;
+
+  // setup configures the hosts, ports and names of each new session
+  SessionGroup(size_t count, const Setup& setup);
+
+  size_t size() const { return _sessions.size(); }
+  Session& operator[](size_t i) { return *_sessions[i]; }
+
+  auto begin() { return _sessions.begin(); }
+  auto end() { return _sessions.end(); }
+
+  // Connects to the tunnel ends and queries their capabilities, false if
+  // any session could not connect
+  bool connect();
+  void disconnect();
+
+  // Same constraints for every session, or one queue per session
+  void run_all(int repet, const Constraints& c);
+  void run_all(int repet, const std::vector<Constraints>& c);
+  // Every session runs all the jobs
+  void run_jobs(const std::vector<ExperimentJob>& jobs);
+
+  void reset_link();
+};
+
+#endif /* SESSION_GROUP_H */
@@ -0,0 +1,40 @@
+#include "stats_series.h"
+
+void StatsSeries::reserve(size_t capacity)
+{
+  _capacity = capacity > 0 ? capacity : 1;
+
+#define STATS_SERIES_RESIZE(TYPE, NAME, KEY) _##NAME.assign(_capacity, TYPE{});
+  STATS_SERIES_COLUMNS(STATS_SERIES_RESIZE)
+#undef STATS_SERIES_RESIZE
+}
+
+void StatsSeries::reset(size_t capacity)
+{
+  if(capacity != _capacity) reserve(capacity);
+  _count.store(0, std::memory_order_release);
+}
+
+void StatsSeries::push(const Sample& sample)
+{
+  size_t i = _count.load(std::memory_order_relaxed);
+  size_t slot = i % _capacity;
+
+#define STATS_SERIES_STORE(TYPE, NAME, KEY) _##NAME[slot] = sample.NAME;
+  STATS_SERIES_COLUMNS(STATS_SERIES_STORE)
+#undef STATS_SERIES_STORE
+
+  _count.store(i + 1, std::memory_order_release);
+}
+
+StatsSeries::Sample StatsSeries::operator[](size_t i) const
+{
+  Sample sample;
+  size_t slot = i % _capacity;
+
+#define STATS_SERIES_LOAD(TYPE, NAME, KEY) sample.NAME = _##NAME[slot];
+  STATS_SERIES_COLUMNS(STATS_SERIES_LOAD)
+#undef STATS_SERIES_LOAD
+
+  return sample;
+}
@@ -0,0 +1,83 @@
+#ifndef STATS_SERIES_H
+#define STATS_SERIES_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Receive stats columns: type, member, key in the uploaded json. x is the
+// sample index in the run, time the seconds since its first sample
+#define STATS_SERIES_COLUMNS(X)                                                  \
+  X(int64_t, x,                           "x")                                   \
+  X(double,  time,                        "time")                                \
+  X(int,     bitrate,                     "bitrate")                             \
+  X(int,     link,                        "link")                                \
+  X(double,  fps,                         "fps")                                 \
+  X(int64_t, frame_dropped,               "frameDropped")                        \
+  X(int64_t, frame_decoded,               "frameDecoded")                        \
+  X(int64_t, frame_key_decoded,           "keyFrameDecoded")                     \
+  X(double,  jitter,                      "jitter")                              \
+  X(double,  jitter_buffer_delay,         "jitterBufferDelay")                   \
+  X(double,  jitter_buffer_target_delay,  "jitterBufferTargetDelay")             \
+  X(double,  jitter_buffer_minimum_delay, "jitterBufferMinimumDelay")            \
+  X(int64_t, nack_count,                  "nackCount")                           \
+  X(int64_t, pli_count,                   "pliCount")                            \
+  X(int64_t, fir_count,                   "firCount")                            \
+  X(int64_t, fec_packets_received,        "fecPacketsReceived")                  \
+  X(int64_t, rtx_packets_received,        "retransmittedPacketsReceived")        \
+  X(int64_t, packets_lost,                "packetsLost")                         \
+  X(int64_t, freeze_count,                "freezeCount")                         \
+  X(int64_t, pause_count,                 "pauseCount")                          \
+  X(double,  available_incoming_bitrate,  "availableIncomingBitrate")
+
+// Stats samples of a run stored column by column (struct of arrays) in a
+// ring preallocated once, so sampling never allocates. One writer (the
+// signaling thread), readers may read any retained sample concurrently.
+class StatsSeries
+{
+public:
+  struct Sample
+  {
+#define STATS_SERIES_MEMBER(TYPE, NAME, KEY) TYPE NAME = 0;
+    STATS_SERIES_COLUMNS(STATS_SERIES_MEMBER)
+#undef STATS_SERIES_MEMBER
+  };
+
+  explicit StatsSeries(size_t capacity = 1 << 16) { reserve(capacity); }
+
+  // Drops every sample, keeps the allocation if big enough
+  void reset(size_t capacity);
+
+  void push(const Sample& sample);
+
+  // Absolute indices, [begin(), end()) are the retained samples
+  size_t end() const { return _count.load(std::memory_order_acquire); }
+  size_t begin() const { size_t e = end(); return e > _capacity ? e - _capacity : 0; }
+  size_t size() const { return end() - begin(); }
+  size_t capacity() const { return _capacity; }
+
+  Sample operator[](size_t i) const;
+
+  // Calls f(key, value) for each column of sample i
+  template<typename F>
+  void visit(size_t i, F&& f) const
+  {
+    size_t slot = i % _capacity;
+#define STATS_SERIES_VISIT(TYPE, NAME, KEY) f(KEY, _##NAME[slot]);
+    STATS_SERIES_COLUMNS(STATS_SERIES_VISIT)
+#undef STATS_SERIES_VISIT
+  }
+
+private:
+  size_t              _capacity = 0;
+  std::atomic<size_t> _count = 0;
+
+#define STATS_SERIES_COLUMN(TYPE, NAME, KEY) std::vector<TYPE> _##NAME;
+  STATS_SERIES_COLUMNS(STATS_SERIES_COLUMN)
+#undef STATS_SERIES_COLUMN
+
+  void reserve(size_t capacity);
+};
+
+#endif /* STATS_SERIES_H */
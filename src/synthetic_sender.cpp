@@ -0,0 +1,396 @@
+#include "synthetic_sender.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include <api/jsep.h>
+#include <api/rtp_parameters.h>
+#include <api/transport/bitrate_settings.h>
+#include <media/base/media_constants.h>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+#include "tunnel_loggin.h"
+
+namespace
+{
+  bool same_codec(std::string_view a, std::string_view b)
+  {
+    return std::ranges::equal(a, b, [](char x, char y) { return std::toupper(static_cast<unsigned char>(x)) == std::toupper(static_cast<unsigned char>(y)); });
+  }
+}
+
+SyntheticSender::SyntheticSender(SyntheticConfig config)
+  : _config(std::move(config)), _source(rtc::make_ref_counted<SyntheticVideoSource>(_config)), _me(this)
+{
+  AddRef();
+}
+
+SyntheticSender::~SyntheticSender()
+{
+  stop();
+  Release();
+}
+
+void SyntheticSender::start(PeerconnectionMgr& receiver)
+{
+  auto pcf = PeerconnectionMgr::get_pcf();
+
+  webrtc::PeerConnectionDependencies deps(this);
+  webrtc::PeerConnectionInterface::RTCConfiguration config;
+  config.sdp_semantics = webrtc::SdpSemantics::kUnifiedPlan;
+
+  auto res = pcf->CreatePeerConnectionOrError(config, std::move(deps));
+
+  if(!res.ok()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Can't create synthetic sender : " << res.error().message();
+    throw std::runtime_error("Could not create synthetic sender");
+  }
+
+  _pc = res.value();
+
+  // Nothing limits a loopback path : start at the target rather than
+  // measuring how fast the bandwidth estimation ramps up
+  webrtc::BitrateSettings bitrate;
+  bitrate.min_bitrate_bps = _config.bitrate * 1000;
+  bitrate.start_bitrate_bps = _config.bitrate * 1000;
+  _pc->SetBitrate(bitrate);
+
+  // Added as a track so it takes the m-line of the receiver's offer
+  auto track = pcf->CreateVideoTrack(_source, "synthetic");
+  auto sender = _pc->AddTrack(track, { "synthetic" });
+
+  if(!sender.ok()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Can't add synthetic track : " << sender.error().message();
+    throw std::runtime_error("Could not create synthetic sender");
+  }
+
+  _sender = sender.value();
+  // Called on the generator thread, which must not wait on the signaling one
+  _source->onkeyframe = [sender = _sender]() {
+    PeerconnectionMgr::signaling_thread()->PostTask([sender]() { sender->GenerateKeyFrame({}); });
+  };
+
+  _offer_set = false;
+  _answer_sent = false;
+  _to_sender.clear();
+  _to_receiver.clear();
+
+  _receiver = &receiver;
+  receiver.onlocaldesc = [this](const std::string& sdp) { on_offer(sdp); };
+  receiver.onicecandidate = [this](const webrtc::IceCandidateInterface* candidate) { on_receiver_candidate(candidate); };
+
+  receiver.start();
+  _source->start();
+}
+
+void SyntheticSender::stop()
+{
+  _source->stop();
+
+  if(!_pc && !_receiver) return;
+
+  // The callbacks of both peers use _receiver and _pc on the signaling
+  // thread, they are let go there
+  PeerconnectionMgr::signaling_thread()->BlockingCall([this]() {
+    if(_pc) _pc->Close();
+
+    if(_receiver) {
+      _receiver->onlocaldesc = nullptr;
+      _receiver->onicecandidate = nullptr;
+      _receiver = nullptr;
+    }
+
+    _pc = nullptr;
+    _sender = nullptr;
+  });
+}
+
+void SyntheticSender::on_offer(const std::string& sdp)
+{
+  auto desc = webrtc::CreateSessionDescription(webrtc::SdpType::kOffer, sdp);
+
+  if(!desc) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Synthetic sender : could not parse the offer";
+    return;
+  }
+
+  _pc->SetRemoteDescription(std::move(desc), _me);
+  _offer_set = true;
+
+  // Chained after the remote description
+  for(auto& candidate : _to_sender) {
+    _pc->AddIceCandidate(std::move(candidate), [](webrtc::RTCError error) {
+      if(!error.ok()) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Synthetic sender : could not add ice candidate : " << error.message();
+    });
+  }
+  _to_sender.clear();
+}
+
+void SyntheticSender::on_receiver_candidate(const webrtc::IceCandidateInterface* candidate)
+{
+  if(!_offer_set) {
+    _to_sender.push_back(copy(candidate));
+    return;
+  }
+
+  _pc->AddIceCandidate(copy(candidate), [](webrtc::RTCError error) {
+    if(!error.ok()) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Synthetic sender : could not add ice candidate : " << error.message();
+  });
+}
+
+void SyntheticSender::OnIceCandidate(const webrtc::IceCandidateInterface* candidate)
+{
+  if(!_receiver) return;
+
+  if(!_answer_sent) {
+    _to_receiver.push_back(copy(candidate));
+    return;
+  }
+
+  _receiver->add_ice_candidate(copy(candidate));
+}
+
+void SyntheticSender::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState new_state)
+{
+  switch(new_state) {
+  case webrtc::PeerConnectionInterface::IceConnectionState::kIceConnectionConnected:
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Synthetic sender connected";
+    break;
+  case webrtc::PeerConnectionInterface::IceConnectionState::kIceConnectionFailed:
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Synthetic sender : ice failed";
+    break;
+  default:
+    break;
+  }
+}
+
+void SyntheticSender::OnSetRemoteDescriptionComplete(webrtc::RTCError error)
+{
+  if(!error.ok()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Synthetic sender : could not set the offer : " << error.message();
+    return;
+  }
+
+  if(!_pc) return;
+
+  set_codec_preferences();
+  _pc->CreateAnswer(this, {});
+}
+
+void SyntheticSender::OnSuccess(webrtc::SessionDescriptionInterface* desc)
+{
+  std::unique_ptr<webrtc::SessionDescriptionInterface> answer(desc);
+  if(!_pc) return;
+
+  _pc->SetLocalDescription(std::move(answer), _me);
+}
+
+void SyntheticSender::OnFailure(webrtc::RTCError error)
+{
+  TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Synthetic sender : could not create the answer : " << error.message();
+}
+
+void SyntheticSender::OnSetLocalDescriptionComplete(webrtc::RTCError error)
+{
+  if(!error.ok()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Synthetic sender : could not set the answer : " << error.message();
+    return;
+  }
+
+  // Stopped meanwhile
+  if(!_receiver || !_pc) return;
+
+  set_encoding_parameters();
+
+  std::string sdp;
+  _pc->local_description()->ToString(&sdp);
+
+  try {
+    _receiver->set_remote_description(sdp);
+  }
+  catch(const std::runtime_error& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Synthetic sender : " << e.what();
+    return;
+  }
+
+  _answer_sent = true;
+
+  for(auto& candidate : _to_receiver) _receiver->add_ice_candidate(std::move(candidate));
+  _to_receiver.clear();
+}
+
+void SyntheticSender::set_codec_preferences()
+{
+  auto capabilities = PeerconnectionMgr::get_pcf()->GetRtpSenderCapabilities(cricket::MediaType::MEDIA_TYPE_VIDEO);
+  std::vector<webrtc::RtpCodecCapability> codecs;
+
+  for(auto& codec : capabilities.codecs) {
+    if(same_codec(codec.name, _config.codec)) codecs.push_back(codec);
+  }
+
+  if(codecs.empty()) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Synthetic sender : no " << _config.codec << " encoder, using the negotiated default";
+    return;
+  }
+
+  // Keep retransmissions
+  for(auto& codec : capabilities.codecs) {
+    if(codec.name == cricket::kRtxCodecName) codecs.push_back(codec);
+  }
+
+  for(auto& transceiver : _pc->GetTransceivers()) {
+    if(transceiver->sender() != _sender) continue;
+
+    auto error = transceiver->SetCodecPreferences(codecs);
+    if(!error.ok()) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Synthetic sender : could not prefer " << _config.codec << " : " << error.message();
+  }
+}
+
+void SyntheticSender::set_encoding_parameters()
+{
+  auto parameters = _sender->GetParameters();
+
+  for(auto& encoding : parameters.encodings) {
+    encoding.max_bitrate_bps = _config.bitrate * 1000;
+    encoding.max_framerate = _config.fps;
+  }
+
+  // Load the decoder at the configured size, adapt the frame rate if the encoder can not follow
+  parameters.degradation_preference = webrtc::DegradationPreference::MAINTAIN_RESOLUTION;
+
+  auto error = _sender->SetParameters(parameters);
+  if(!error.ok()) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Synthetic sender : could not set the encoding : " << error.message();
+}
+
+std::unique_ptr<webrtc::IceCandidateInterface> SyntheticSender::copy(const webrtc::IceCandidateInterface* candidate)
+{
+  return webrtc::CreateIceCandidate(candidate->sdp_mid(), candidate->sdp_mline_index(), candidate->candidate());
+}
+
+std::vector<SyntheticSender::Result> SyntheticSender::run_ladder(PeerconnectionMgr& receiver, SyntheticProbe& probe,
+								 const std::vector<SyntheticConfig>& loads, std::chrono::seconds duration,
+								 const std::optional<Quality>& quality)
+{
+  // Stats of the first seconds are the connection set up and the first key frame
+  const double warm_up = std::min(3., duration.count() / 2.);
+
+  std::vector<Result> results;
+  std::optional<size_t> saturation;
+
+  for(auto& load : loads) {
+    SyntheticSender sender(load);
+    probe.attach(&sender.source());
+    receiver.link = load.bitrate;
+
+    // The picture only depends on the size and complexity
+    std::unique_ptr<QualityScorer> scorer;
+    std::filesystem::path reference_path;
+
+    if(quality) {
+      reference_path = quality->directory / fmt::format("synthetic_{}x{}_{}.y4m", load.width, load.height, load.complexity);
+      auto reference = std::make_shared<ReferenceVideo>();
+
+      if(sender.source().write_reference(reference_path) && reference->open(reference_path)) {
+	auto config = quality->config;
+	config.match = QualityScorer::Match::STAMP;
+	scorer = std::make_unique<QualityScorer>(reference, config);
+      }
+      else {
+	TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "No quality scores for " << load.to_string();
+      }
+    }
+
+    receiver.quality = scorer.get();
+
+    try {
+      sender.start(receiver);
+    }
+    catch(const std::runtime_error& e) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Skipping synthetic load " << load.to_string() << " : " << e.what();
+      receiver.quality = nullptr;
+      continue;
+    }
+
+    std::this_thread::sleep_for(duration);
+
+    sender.source().stop();
+    receiver.stop();
+    sender.stop();
+    probe.attach(nullptr);
+
+    Result result{ .config = load };
+    size_t samples = 0;
+
+    for(size_t i = receiver.stats.begin(); i < receiver.stats.end(); ++i) {
+      auto sample = receiver.stats[i];
+
+      // Cumulative counters
+      result.frames_decoded = sample.frame_decoded;
+      result.frames_dropped = sample.frame_dropped;
+
+      if(sample.time < warm_up) continue;
+
+      result.fps += sample.fps;
+      result.bitrate += sample.bitrate;
+      ++samples;
+    }
+
+    if(samples > 0) {
+      result.fps /= samples;
+      result.bitrate /= samples;
+    }
+
+    result.missing = probe.missing();
+    result.late = sender.source().late();
+    result.latency_p50 = probe.latency().percentile(0.5);
+    result.latency_p95 = probe.latency().percentile(0.95);
+    result.latency_p99 = probe.latency().percentile(0.99);
+
+    for(auto&& s : receiver.tracer.summary()) {
+      if(s.name == "decode") result.decode_p95 = s.p95;
+    }
+
+    if(scorer) {
+      scorer->drain();
+      receiver.quality = nullptr;
+
+      auto scores = scorer->to_json();
+      auto& summary = scores["summary"];
+      result.scored = summary["scored"].get<uint64_t>();
+      result.psnr_y = summary["psnr_y"]["mean"].get<double>();
+      result.ssim = summary["ssim"]["mean"].get<double>();
+
+      auto scores_path = reference_path;
+      std::ofstream(scores_path.replace_extension(".quality.json")) << scores.dump() << "\n";
+    }
+
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Synthetic " << load.to_string() << " : " << result.fps << " fps, "
+					      << result.bitrate << " kbps, decoded " << result.frames_decoded
+					      << ", dropped " << result.frames_dropped << ", missing " << result.missing
+					      << ", late " << result.late << ", capture to decoded (us) p50=" << result.latency_p50
+					      << " p95=" << result.latency_p95 << " p99=" << result.latency_p99
+					      << ", decode p95=" << result.decode_p95
+					      << (scorer ? fmt::format(", psnr_y {:.2f} dB ssim {:.4f} over {} frames", result.psnr_y, result.ssim, result.scored) : "")
+					      << (result.saturated() ? " SATURATED" : "");
+
+    if(!saturation && result.saturated()) saturation = results.size();
+    results.push_back(result);
+  }
+
+  if(saturation) {
+    auto& result = results[*saturation];
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Receiver saturates at " << result.config.to_string()
+					      << " (" << result.fps << " of " << result.config.fps << " fps)";
+  }
+  else {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Receiver kept up with every synthetic load";
+  }
+
+  return results;
+}
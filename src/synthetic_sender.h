@@ -0,0 +1,124 @@
+#ifndef SYNTHETIC_SENDER_H
+#define SYNTHETIC_SENDER_H
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <api/peer_connection_interface.h>
+#include <api/scoped_refptr.h>
+#include <api/set_local_description_observer_interface.h>
+#include <api/set_remote_description_observer_interface.h>
+
+#include "peerconnection.h"
+#include "quality_scorer.h"
+#include "synthetic_source.h"
+
+// Sending peerconnection in the same factory as the receiver, fed by a
+// SyntheticVideoSource. It answers the receiver's offer itself, and ICE
+// candidates are exchanged in process, so the receive pipeline runs
+// without medooze or the tunnels. Every callback of both peers runs on the
+// factory signaling thread.
+class SyntheticSender : public webrtc::PeerConnectionObserver,
+			public webrtc::CreateSessionDescriptionObserver,
+			public webrtc::SetLocalDescriptionObserverInterface,
+			public webrtc::SetRemoteDescriptionObserverInterface
+{
+public:
+  // One load of a ladder run
+  struct Result
+  {
+    SyntheticConfig config;
+    double          fps = 0.;     // received, mean after the warm up
+    double          bitrate = 0.; // kbps
+    int64_t         frames_decoded = 0;
+    int64_t         frames_dropped = 0;
+    uint64_t        missing = 0;
+    uint64_t        late = 0;     // the generator itself could not keep up
+    uint64_t        latency_p50 = 0; // capture to decoded, us
+    uint64_t        latency_p95 = 0;
+    uint64_t        latency_p99 = 0;
+    uint64_t        decode_p95 = 0;
+    uint64_t        scored = 0;   // frames scored against the reference, if any
+    double          psnr_y = 0.;  // mean, dB
+    double          ssim = 0.;    // mean
+
+    bool saturated() const { return fps < 0.9 * config.fps; }
+  };
+
+  // Every load scored against a period of its own source written to
+  // directory, matched by stamp
+  struct Quality
+  {
+    std::filesystem::path directory;
+    QualityScorer::Config config;
+  };
+
+  explicit SyntheticSender(SyntheticConfig config);
+  ~SyntheticSender();
+
+  // Starts the receiver too, taking over its onlocaldesc and onicecandidate.
+  // Throws std::runtime_error if the peerconnection can not be created
+  void start(PeerconnectionMgr& receiver);
+  // Once the receiver is stopped
+  void stop();
+
+  SyntheticVideoSource& source() { return *_source; }
+
+  // Each load in turn for duration, the receiver video sink is expected to
+  // be probe. Logs every load and the first one the receiver can not keep up with
+  static std::vector<Result> run_ladder(PeerconnectionMgr& receiver, SyntheticProbe& probe,
+					const std::vector<SyntheticConfig>& loads, std::chrono::seconds duration,
+					const std::optional<Quality>& quality = std::nullopt);
+
+private:
+  SyntheticConfig                                       _config;
+  rtc::scoped_refptr<SyntheticVideoSource>              _source;
+  rtc::scoped_refptr<webrtc::PeerConnectionInterface>   _pc;
+  rtc::scoped_refptr<webrtc::RtpSenderInterface>        _sender;
+  rtc::scoped_refptr<SyntheticSender>                   _me;
+  PeerconnectionMgr*                                    _receiver = nullptr;
+
+  // Candidates of one side gathered before the other can take them
+  bool _offer_set = false;
+  bool _answer_sent = false;
+  std::vector<std::unique_ptr<webrtc::IceCandidateInterface>> _to_sender;
+  std::vector<std::unique_ptr<webrtc::IceCandidateInterface>> _to_receiver;
+
+  void on_offer(const std::string& sdp);
+  void on_receiver_candidate(const webrtc::IceCandidateInterface* candidate);
+  void set_codec_preferences();
+  void set_encoding_parameters();
+
+  static std::unique_ptr<webrtc::IceCandidateInterface> copy(const webrtc::IceCandidateInterface* candidate);
+
+public:
+  void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state) override {}
+  void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> channel) override {}
+  void OnRenegotiationNeeded() override {}
+  void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) override {}
+  void OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState new_state) override;
+  void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
+
+  void OnSuccess(webrtc::SessionDescriptionInterface* desc) override;
+  void OnFailure(webrtc::RTCError error) override;
+
+  void OnSetLocalDescriptionComplete(webrtc::RTCError error) override;
+  void OnSetRemoteDescriptionComplete(webrtc::RTCError error) override;
+
+public:
+  void AddRef() const override { ref_count_.IncRef(); }
+
+  rtc::RefCountReleaseStatus Release() const override {
+    // Owned by whoever constructed it, like PeerconnectionMgr
+    return ref_count_.DecRef();
+  }
+
+protected:
+  mutable webrtc::webrtc_impl::RefCounter ref_count_{0};
+};
+
+#endif /* SYNTHETIC_SENDER_H */
@@ -0,0 +1,305 @@
+#include "synthetic_source.h"
+
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <rtc_base/time_utils.h>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+#include "tunnel_loggin.h"
+
+namespace
+{
+  // splitmix64, a fixed value per frame of the period
+  uint64_t frame_random(uint32_t counter)
+  {
+    uint64_t z = (counter % SyntheticVideoSource::PERIOD) + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+}
+
+std::optional<SyntheticConfig> SyntheticConfig::parse(std::string_view spec)
+{
+  SyntheticConfig config;
+  std::string str(spec);
+  int consumed = 0;
+
+  if(std::sscanf(str.c_str(), "%dx%d@%d:%d%n", &config.width, &config.height, &config.fps, &config.bitrate, &consumed) != 4) {
+    return std::nullopt;
+  }
+
+  // Optional fields, each after a ':'
+  std::string rest = str.substr(consumed);
+  if(!rest.empty() && rest.front() != ':') return std::nullopt;
+
+  std::istringstream fields(rest.empty() ? rest : rest.substr(1));
+  std::string field;
+
+  try {
+    if(std::getline(fields, field, ':') && !field.empty()) {
+      for(auto& c : field) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+      config.codec = field;
+    }
+    if(std::getline(fields, field, ':') && !field.empty()) config.key_frame_interval = std::stoi(field);
+    if(std::getline(fields, field, ':') && !field.empty()) config.complexity = std::stod(field);
+  }
+  catch(const std::exception&) {
+    return std::nullopt;
+  }
+
+  // The stamp needs a few pixels per bit
+  if(config.width < 64 || config.height < 48 || config.fps <= 0 || config.bitrate <= 0) return std::nullopt;
+  if(config.key_frame_interval < 0 || config.complexity < 0. || config.complexity > 1.) return std::nullopt;
+
+  return config;
+}
+
+std::string SyntheticConfig::to_string() const
+{
+  return fmt::format("{}x{}@{}:{}:{}:{}:{}", width, height, fps, bitrate, codec, key_frame_interval, complexity);
+}
+
+SyntheticVideoSource::SyntheticVideoSource(SyntheticConfig config)
+  : rtc::AdaptedVideoTrackSource(2), _config(std::move(config)), _pool(false, 16),
+    _noise(2 * static_cast<size_t>(_config.width) * _config.height)
+{
+  for(auto& n : _noise) n = static_cast<uint8_t>(next_random() >> 56);
+}
+
+SyntheticVideoSource::~SyntheticVideoSource()
+{
+  stop();
+}
+
+void SyntheticVideoSource::start()
+{
+  if(_running.exchange(true)) return;
+
+  _thread = std::thread([this]() { run(); });
+}
+
+void SyntheticVideoSource::stop()
+{
+  _running = false;
+  if(_thread.joinable()) _thread.join();
+}
+
+int64_t SyntheticVideoSource::capture_time_us(uint32_t counter) const
+{
+  const Slot& slot = _slots[counter % SLOTS];
+  if(slot.counter.load(std::memory_order_acquire) != counter) return 0;
+
+  return slot.capture_us.load(std::memory_order_relaxed);
+}
+
+uint32_t SyntheticVideoSource::read_stamp(const webrtc::I420BufferInterface& buffer)
+{
+  int block = buffer.width() / STAMP_BITS;
+  if(block == 0) return 0;
+
+  // Centre of each block, far from the edges the encoder blurs
+  const uint8_t* row = buffer.DataY() + (stamp_height(buffer.height()) / 2) * buffer.StrideY();
+  uint32_t counter = 0;
+
+  for(int i = 0; i < STAMP_BITS; ++i) counter = (counter << 1) | (row[i * block + block / 2] >= 128 ? 1 : 0);
+
+  return counter;
+}
+
+void SyntheticVideoSource::run()
+{
+  using clock = std::chrono::steady_clock;
+
+  auto period = std::chrono::nanoseconds(1'000'000'000 / _config.fps);
+  auto deadline = clock::now();
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Synthetic source " << _config.to_string() << " started";
+
+  while(_running) {
+    int64_t now_us = rtc::TimeMicros();
+    uint32_t counter = _counter.load(std::memory_order_relaxed) + 1;
+
+    int width, height, crop_width, crop_height, crop_x, crop_y;
+
+    if(!AdaptFrame(_config.width, _config.height, now_us, &width, &height, &crop_width, &crop_height, &crop_x, &crop_y)) {
+      _adapted.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Pool exhausted : the encoder still holds every buffer, skip this one
+    else if(auto buffer = _pool.CreateI420Buffer(_config.width, _config.height)) {
+      draw(*buffer, counter);
+
+      rtc::scoped_refptr<webrtc::I420BufferInterface> frame_buffer = buffer;
+      if(width != _config.width || height != _config.height) {
+	auto scaled = webrtc::I420Buffer::Create(width, height);
+	scaled->CropAndScaleFrom(*buffer, crop_x, crop_y, crop_width, crop_height);
+	frame_buffer = scaled;
+      }
+
+      Slot& slot = _slots[counter % SLOTS];
+      slot.capture_us.store(now_us, std::memory_order_relaxed);
+      slot.counter.store(counter, std::memory_order_release);
+
+      OnFrame(webrtc::VideoFrame::Builder()
+	      .set_video_frame_buffer(frame_buffer)
+	      .set_timestamp_us(now_us)
+	      .set_rotation(webrtc::kVideoRotation_0)
+	      .build());
+
+      _counter.store(counter, std::memory_order_relaxed);
+
+      if(_config.key_frame_interval > 0 && counter % _config.key_frame_interval == 0 && onkeyframe) onkeyframe();
+    }
+    else {
+      _late.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Behind schedule : restart from now rather than sending a burst
+    deadline += period;
+    auto now = clock::now();
+
+    if(deadline < now) {
+      _late.fetch_add(1, std::memory_order_relaxed);
+      deadline = now;
+    }
+    else {
+      std::this_thread::sleep_until(deadline);
+    }
+  }
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Synthetic source stopped after " << frames() << " frames, late : " << late()
+					    << ", dropped by adaptation : " << adapted();
+}
+
+void SyntheticVideoSource::draw(webrtc::I420Buffer& buffer, uint32_t counter) const
+{
+  int width = buffer.width();
+  int height = buffer.height();
+  int amplitude = static_cast<int>(_config.complexity * 256.);
+  // A multiple of 256 over a period, the gradient wraps with it
+  int shift = static_cast<int>((counter % PERIOD) * 4);
+
+  // A different window of the noise each frame, so it does not predict
+  const uint8_t* noise = _noise.data() + frame_random(counter) % (static_cast<size_t>(width) * height);
+
+  for(int y = 0; y < height; ++y) {
+    uint8_t* row = buffer.MutableDataY() + y * buffer.StrideY();
+    const uint8_t* n = noise + static_cast<size_t>(y) * width;
+
+    for(int x = 0; x < width; ++x) {
+      int v = ((x + y + shift) & 255) + (((n[x] - 128) * amplitude) >> 8);
+      row[x] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+    }
+  }
+
+  // Slowly drifting tint, neutral under the stamp
+  int stamp = stamp_height(height);
+  uint8_t u = static_cast<uint8_t>(112 + ((counter / 2) & 31));
+
+  for(int y = 0; y < buffer.ChromaHeight(); ++y) {
+    bool under_stamp = 2 * y < stamp + 2;
+    std::memset(buffer.MutableDataU() + y * buffer.StrideU(), under_stamp ? 128 : u, buffer.ChromaWidth());
+    std::memset(buffer.MutableDataV() + y * buffer.StrideV(), 128, buffer.ChromaWidth());
+  }
+
+  // Counter, most significant bit first, then black to the right edge
+  int block = width / STAMP_BITS;
+
+  for(int y = 0; y < stamp; ++y) {
+    uint8_t* row = buffer.MutableDataY() + y * buffer.StrideY();
+
+    for(int i = 0; i < STAMP_BITS; ++i) {
+      bool bit = (counter >> (STAMP_BITS - 1 - i)) & 1;
+      std::memset(row + i * block, bit ? 235 : 16, block);
+    }
+    std::memset(row + STAMP_BITS * block, 16, width - STAMP_BITS * block);
+  }
+}
+
+bool SyntheticVideoSource::write_reference(const std::filesystem::path& path) const
+{
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if(!out.is_open()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not open " << path.string();
+    return false;
+  }
+
+  out << fmt::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C420jpeg\n", _config.width, _config.height, _config.fps);
+
+  auto buffer = webrtc::I420Buffer::Create(_config.width, _config.height);
+
+  auto write_plane = [&out](const uint8_t* data, int stride, int width, int height) {
+    for(int y = 0; y < height; ++y) out.write(reinterpret_cast<const char*>(data + static_cast<size_t>(y) * stride), width);
+  };
+
+  // The counters start at 1, frame i of the reference is counter i + 1
+  for(uint32_t counter = 1; counter <= PERIOD; ++counter) {
+    draw(*buffer, counter);
+
+    out << "FRAME\n";
+    write_plane(buffer->DataY(), buffer->StrideY(), buffer->width(), buffer->height());
+    write_plane(buffer->DataU(), buffer->StrideU(), buffer->ChromaWidth(), buffer->ChromaHeight());
+    write_plane(buffer->DataV(), buffer->StrideV(), buffer->ChromaWidth(), buffer->ChromaHeight());
+  }
+
+  if(!out.good()) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not write the synthetic reference " << path.string();
+    return false;
+  }
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Synthetic reference " << path.string() << " : " << PERIOD << " frames of " << _config.to_string();
+  return true;
+}
+
+uint64_t SyntheticVideoSource::next_random()
+{
+  // xorshift64*, only ever called from one thread at a time
+  _seed ^= _seed >> 12;
+  _seed ^= _seed << 25;
+  _seed ^= _seed >> 27;
+  return _seed * 0x2545f4914f6cdd1dull;
+}
+
+void SyntheticProbe::attach(const SyntheticVideoSource* source)
+{
+  _source = source;
+  reset();
+}
+
+void SyntheticProbe::reset()
+{
+  _latency.reset();
+  _frames = 0;
+  _missing = 0;
+  _unreadable = 0;
+  _last.reset();
+}
+
+void SyntheticProbe::OnFrame(const webrtc::VideoFrame& frame)
+{
+  _frames.fetch_add(1, std::memory_order_relaxed);
+
+  if(_source) {
+    // No copy for I420 buffers, which is what the builtin decoders output
+    uint32_t counter = SyntheticVideoSource::read_stamp(*frame.video_frame_buffer()->ToI420());
+    int64_t captured = _source->capture_time_us(counter);
+
+    if(captured == 0 || (_last && counter <= *_last)) {
+      _unreadable.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+      if(_last) _missing.fetch_add(counter - *_last - 1, std::memory_order_relaxed);
+      _last = counter;
+      _latency.record(rtc::TimeMicros() - captured);
+    }
+  }
+
+  if(next) next->OnFrame(frame);
+}
@@ -0,0 +1,142 @@
+#ifndef SYNTHETIC_SOURCE_H
+#define SYNTHETIC_SOURCE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+#include <api/video/i420_buffer.h>
+#include <api/video/video_frame.h>
+#include <api/video/video_sink_interface.h>
+#include <common_video/include/video_frame_buffer_pool.h>
+#include <media/base/adapted_video_track_source.h>
+
+#include "latency_histogram.h"
+
+// Load of the synthetic sender, see SyntheticVideoSource
+struct SyntheticConfig
+{
+  int         width = 1280;
+  int         height = 720;
+  int         fps = 30;
+  int         bitrate = 2500;         // kbps, encoder target and max
+  std::string codec = "VP8";
+  int         key_frame_interval = 0; // frames, 0 : left to the encoder
+  double      complexity = 0.5;       // 0 smooth gradient .. 1 noise everywhere
+
+  // WxH@fps:kbps[:codec[:keyint[:complexity]]], e.g. 1920x1080@60:8000:VP9:120:0.8
+  static std::optional<SyntheticConfig> parse(std::string_view spec);
+  std::string to_string() const;
+};
+
+// Generated video at a fixed frame rate, on its own thread: a moving
+// gradient plus noise scaled by the complexity, so the encoded size and the
+// decode cost follow it. Each frame is stamped with its counter as a row of
+// black and white blocks along the top, proportional to the frame size so
+// it survives scaling, and its capture time is kept to measure the latency
+// once the receiver decoded it, see SyntheticProbe. Apart from the stamp
+// the picture only depends on the counter modulo PERIOD, so one period
+// written out is a reference for the whole run, see QualityScorer.
+class SyntheticVideoSource : public rtc::AdaptedVideoTrackSource
+{
+public:
+  static constexpr uint32_t PERIOD = 64;
+
+  explicit SyntheticVideoSource(SyntheticConfig config);
+  ~SyntheticVideoSource() override;
+
+  void start();
+  void stop();
+
+  // Generator thread, every key_frame_interval frames
+  std::function<void()> onkeyframe;
+
+  const SyntheticConfig& config() const { return _config; }
+  uint32_t frames() const { return _counter.load(std::memory_order_relaxed); }
+  // Frames sent later than their deadline, the generator could not keep up
+  uint32_t late() const { return _late.load(std::memory_order_relaxed); }
+  // Frames dropped because the encoder asked for a lower frame rate
+  uint32_t adapted() const { return _adapted.load(std::memory_order_relaxed); }
+
+  // Capture time of the frame stamped with counter, 0 if no longer known
+  int64_t capture_time_us(uint32_t counter) const;
+
+  // Counter stamped in a (possibly scaled) frame of this source
+  static uint32_t read_stamp(const webrtc::I420BufferInterface& buffer);
+  // Luma rows of the stamp at the top of a frame of that height
+  static int stamp_height(int height) { return std::max(2, height / 24); }
+
+  // Frames 1 to PERIOD at the configured size as a Y4M file
+  bool write_reference(const std::filesystem::path& path) const;
+
+  SourceState state() const override { return kLive; }
+  bool remote() const override { return false; }
+  bool is_screencast() const override { return false; }
+  absl::optional<bool> needs_denoising() const override { return false; }
+
+private:
+  static constexpr int    STAMP_BITS = 32;
+  static constexpr size_t SLOTS = 1024;
+
+  struct Slot
+  {
+    std::atomic<uint32_t> counter{0};
+    std::atomic<int64_t>  capture_us{0};
+  };
+
+  SyntheticConfig              _config;
+  webrtc::VideoFrameBufferPool _pool;
+  std::vector<uint8_t>         _noise; // two frames of luma noise, read from a random offset
+  uint64_t                     _seed = 0x9e3779b97f4a7c15ull;
+
+  std::thread             _thread;
+  std::atomic<bool>       _running = false;
+  std::atomic<uint32_t>   _counter = 0;
+  std::atomic<uint32_t>   _late = 0;
+  std::atomic<uint32_t>   _adapted = 0;
+  std::array<Slot, SLOTS> _slots;
+
+  void run();
+  void draw(webrtc::I420Buffer& buffer, uint32_t counter) const;
+  uint64_t next_random();
+};
+
+// Video sink on the receiver track of a synthetic run: reads back the
+// stamp of each decoded frame for the capture to decoded latency, counts
+// the frames that never made it, then hands the frame to the next sink.
+class SyntheticProbe : public rtc::VideoSinkInterface<webrtc::VideoFrame>
+{
+public:
+  rtc::VideoSinkInterface<webrtc::VideoFrame>* next = nullptr;
+
+  // Not thread safe with OnFrame, call while no track is attached
+  void attach(const SyntheticVideoSource* source);
+  void reset();
+
+  void OnFrame(const webrtc::VideoFrame& frame) override;
+
+  const LatencyHistogram& latency() const { return _latency; }
+  uint64_t frames() const { return _frames.load(std::memory_order_relaxed); }
+  // Stamps skipped over: dropped by the encoder, lost, or dropped by the decoder
+  uint64_t missing() const { return _missing.load(std::memory_order_relaxed); }
+  // Stamps older than the last one, or too damaged to match a sent frame
+  uint64_t unreadable() const { return _unreadable.load(std::memory_order_relaxed); }
+
+private:
+  const SyntheticVideoSource* _source = nullptr;
+  LatencyHistogram      _latency;
+  std::atomic<uint64_t> _frames = 0;
+  std::atomic<uint64_t> _missing = 0;
+  std::atomic<uint64_t> _unreadable = 0;
+  std::optional<uint32_t> _last;
+};
+
+#endif /* SYNTHETIC_SOURCE_H */
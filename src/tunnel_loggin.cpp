@@ -1,22 +1,203 @@
 #include "tunnel_loggin.h"
 
 #include <iostream>
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
 
-TunnelLogging::Severity TunnelLogging::_min_severity = TunnelLogging::Severity::INFO;
+#include <unistd.h>
+#include <sys/syscall.h>
 
-void TunnelLogging::print(const std::string& msg, Severity sev)
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+std::atomic<TunnelLogging::Severity> TunnelLogging::_min_severity = TunnelLogging::Severity::INFO;
+
+namespace
 {
-  if(sev < _min_severity) return;
 
-  std::string sev_str;
-    
+using Clock = std::chrono::steady_clock;
+
+Clock::time_point start_time()
+{
+  static const Clock::time_point start = Clock::now();
+  return start;
+}
+
+long thread_id()
+{
+  thread_local long tid = syscall(SYS_gettid);
+  return tid;
+}
+
+const char * severity_str(TunnelLogging::Severity sev)
+{
   switch(sev) {
-  case Severity::VERBOSE: sev_str = "Verbose"; break;
-  case Severity::INFO:    sev_str = "Info";    break;
-  case Severity::WARNING: sev_str = "Warning"; break;
-  case Severity::ERROR:   sev_str = "Error";   break;
-  default: sev_str = "Unknown";
+  case TunnelLogging::Severity::VERBOSE: return "Verbose";
+  case TunnelLogging::Severity::INFO:    return "Info";
+  case TunnelLogging::Severity::WARNING: return "Warning";
+  case TunnelLogging::Severity::ERROR:   return "Error";
+  default: return "Unknown";
+  }
+}
+
+// Bounded multi producer / single consumer ring (Vyukov's sequence per slot)
+class LogRing
+{
+public:
+  struct Entry
+  {
+    std::atomic<size_t>     seq;
+    int64_t                 time_ns;
+    long                    tid;
+    TunnelLogging::Severity sev;
+    std::string             msg;
+  };
+
+  static constexpr size_t CAPACITY = 4096;
+
+  LogRing()
+  {
+    for(size_t i = 0; i < CAPACITY; ++i) _entries[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  ~LogRing()
+  {
+    stop();
+  }
+
+  void push(std::string&& msg, TunnelLogging::Severity sev)
+  {
+    std::call_once(_started, [this]() { _writer = std::thread([this]() { write_loop(); }); });
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time()).count();
+    size_t pos = _enqueue.load(std::memory_order_relaxed);
+
+    while(true) {
+      Entry& entry = _entries[pos % CAPACITY];
+      size_t seq = entry.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+      if(diff == 0) {
+	if(_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+	  entry.time_ns = now;
+	  entry.tid = thread_id();
+	  entry.sev = sev;
+	  entry.msg = std::move(msg);
+	  entry.seq.store(pos + 1, std::memory_order_release);
+	  break;
+	}
+      }
+      else if(diff < 0) {
+	// Full, never block the caller
+	_dropped.fetch_add(1, std::memory_order_relaxed);
+	return;
+      }
+      else {
+	pos = _enqueue.load(std::memory_order_relaxed);
+      }
+    }
+
+    _wake.fetch_add(1, std::memory_order_release);
+    _wake.notify_one();
+  }
+
+  void flush()
+  {
+    if(!_running) return;
+
+    size_t target = _enqueue.load(std::memory_order_acquire);
+    while(_running && _written.load(std::memory_order_acquire) < target) {
+      _wake.fetch_add(1, std::memory_order_release);
+      _wake.notify_one();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void stop()
+  {
+    if(!_writer.joinable()) return;
+
+    _running = false;
+    _wake.fetch_add(1, std::memory_order_release);
+    _wake.notify_one();
+    _writer.join();
+  }
+
+private:
+  std::array<Entry, CAPACITY> _entries;
+  std::atomic<size_t>         _enqueue{0};
+  size_t                      _dequeue = 0; // writer only
+  std::atomic<size_t>         _written{0};
+  std::atomic<uint64_t>       _dropped{0};
+  std::atomic<uint32_t>       _wake{0};
+  std::atomic_bool            _running{true};
+  std::once_flag              _started;
+  std::thread                 _writer;
+
+  void write_loop()
+  {
+    std::string out;
+    uint64_t reported_dropped = 0;
+
+    while(true) {
+      uint32_t wake = _wake.load(std::memory_order_acquire);
+      bool running = _running.load();
+
+      out.clear();
+
+      while(true) {
+	Entry& entry = _entries[_dequeue % CAPACITY];
+	if(entry.seq.load(std::memory_order_acquire) != _dequeue + 1) break;
+
+	fmt::format_to(std::back_inserter(out), "[Native Tunnel Client][{:.6f}][{}][Log-{}] : ",
+		       entry.time_ns / 1e9, entry.tid, severity_str(entry.sev));
+	out += entry.msg;
+
+	entry.msg.clear();
+	entry.seq.store(_dequeue + CAPACITY, std::memory_order_release);
+	++_dequeue;
+      }
+
+      uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+      if(dropped != reported_dropped) {
+	fmt::format_to(std::back_inserter(out), "[Native Tunnel Client][Log-Warning] : {} log messages dropped\n", dropped - reported_dropped);
+	reported_dropped = dropped;
+      }
+
+      if(!out.empty()) {
+	std::cout.write(out.data(), out.size());
+	std::cout.flush();
+      }
+
+      _written.store(_dequeue, std::memory_order_release);
+
+      if(out.empty()) {
+	if(!running) break;
+	_wake.wait(wake, std::memory_order_acquire);
+      }
+    }
   }
+};
 
-  std::cout << "[Native Tunnel Client][Log-" << sev_str << "] : " << msg;
+LogRing& ring()
+{
+  static LogRing ring;
+  return ring;
+}
+
+}
+
+void TunnelLogging::print(std::string&& msg, Severity sev)
+{
+  if(!enabled(sev)) return;
+
+  ring().push(std::move(msg), sev);
+}
+
+void TunnelLogging::flush()
+{
+  ring().flush();
 }
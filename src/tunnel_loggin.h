@@ -2,9 +2,15 @@
 #define TUNNEL_LOGGIN_H
 
 #include <string>
+#include <atomic>
 #include <inttypes.h>
 #include <sstream>
 
+// Messages below this severity are compiled out (0 verbose ... 3 error)
+#ifndef TUNNEL_LOG_MIN_SEVERITY
+#define TUNNEL_LOG_MIN_SEVERITY 0
+#endif
+
 class TunnelLogging
 {
   
@@ -12,7 +18,19 @@ public:
 
   enum class Severity : uint8_t { VERBOSE, INFO, WARNING, ERROR };
 
-  static void print(const std::string& msg, Severity sev);
+  static constexpr Severity COMPILED_MIN_SEVERITY = static_cast<Severity>(TUNNEL_LOG_MIN_SEVERITY);
+
+  // Checked before the message is formatted
+  static bool enabled(Severity sev)
+  {
+    return sev >= COMPILED_MIN_SEVERITY && sev >= _min_severity.load(std::memory_order_relaxed);
+  }
+
+  // Queues the message, a background thread timestamps and writes it
+  static void print(std::string&& msg, Severity sev);
+
+  // Blocks until everything queued so far is written
+  static void flush();
 
   static void set_min_severity(Severity sev)
   {
@@ -20,7 +38,7 @@ public:
   }
 
 private:
-  static Severity _min_severity;
+  static std::atomic<Severity> _min_severity;
 };
 
 template<TunnelLogging::Severity S>
@@ -38,7 +56,7 @@ public:
 
   void call() {
     oss << "\n";
-    TunnelLogging::print(oss.str(), S);
+    TunnelLogging::print(std::move(oss).str(), S);
   }
 };
 
@@ -51,6 +69,8 @@ public:
   }
 };
 
-#define TUNNEL_LOG(SEVERITY) TunnelLoggingCall<SEVERITY>() & TunnelLoggingStream<SEVERITY>()
+// Nothing is constructed nor formatted when the severity is filtered
+#define TUNNEL_LOG(SEVERITY)						\
+  !TunnelLogging::enabled(SEVERITY) ? (void)0 : TunnelLoggingCall<SEVERITY>() & TunnelLoggingStream<SEVERITY>()
 
 #endif /* TUNNEL_LOGGIN_H */
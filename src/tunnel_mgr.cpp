@@ -7,8 +7,8 @@
 #include <algorithm>
 #include <string>
 #include <filesystem>
-#include <cstdlib>
-#include <sys/wait.h>
+#include <future>
+#include <thread>
 
 #define FMT_HEADER_ONLY
 #include <fmt/format.h>
@@ -17,49 +17,79 @@ namespace fs = std::filesystem;
 
 #include "tunnel_mgr.h"
 
+#include <asio/post.hpp>
+
 // tunnelsocket ///////////////////////////////////////////////////////////////
 
   
-void TunnelSocket::connect()
+bool TunnelSocket::connect(std::chrono::milliseconds timeout)
 {
-  socket.onopen = [this]() { is_connected = true; cv.notify_all(); };
-  socket.onclose = [this]() { cv.notify_all(); };
+  // Under the lock, the handlers may run on the loop before we wait
+  socket.onopen = [this]() {
+    std::lock_guard<std::mutex> lck(cv_mutex);
+    is_connected = true;
+    cv.notify_all();
+  };
+  socket.onclose = [this]() {
+    rpc.fail_all("connection closed");
 
+    std::lock_guard<std::mutex> lck(cv_mutex);
+    is_connected = false;
+    closed = true;
+    cv.notify_all();
+  };
+  socket.onmessage = [this](const json& msg) {
+    if(rpc.on_message(msg)) return;
+    if(onmessage) onmessage(msg);
+  };
+
+  rpc.sender = [this](const json& payload) { socket.send_json(payload); };
+
+  {
+    std::lock_guard<std::mutex> lck(cv_mutex);
+    is_connected = false;
+    closed = false;
+  }
+
+  socket.set_encoding(Encoding::JSON);
   socket.connect(host, port);
 
-  std::unique_lock<std::mutex> lck(cv_mutex);
-  cv.wait(lck);
+  {
+    std::unique_lock<std::mutex> lck(cv_mutex);
+    if(!cv.wait_for(lck, timeout, [this]() { return is_connected || closed; }) || !is_connected) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not connect to " << host << ":" << port;
+      return false;
+    }
+  }
+
+  if(!binary) return true;
+
+  // An error or no answer means the peer only speaks JSON
+  try {
+    auto reply = request(messages::EncodingQuery{ { "msgpack", "cbor", "json" } }, std::chrono::seconds(1)).get();
+
+    auto& encoding = reply.encoding;
+    if(encoding == "msgpack") socket.set_encoding(Encoding::MSGPACK);
+    else if(encoding == "cbor") socket.set_encoding(Encoding::CBOR);
+  }
+  catch(const std::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "No encoding negotiated with " << host << ", using JSON";
+  }
+
+  return true;
 }
 
 void TunnelSocket::disconnect()
 {
   socket.disconnect();
-}
-  
-void TunnelSocket::send(std::string_view cmd, int req, const json& data)
-{
-  json payload = {
-    { "cmd", cmd },
-    { "transId", req },
-    { "data", data }
-  };
-
-  socket.send(payload.dump());
+  rpc.fail_all("disconnected");
 }
 
 // Capabititiesvector /////////////////////////////////////////////////////////
 
-void CapabititiesVector::from_json(const std::vector<nlohmann::json>& data)
+void CapabititiesVector::from_json(std::vector<Capabilities> data)
 {
-  for(auto jcap : data) {
-    Capabilities c;
-    c.impl = jcap["impl"].get<std::string>();
-    c.datagrams = jcap["datagrams"].get<bool>();
-    c.streams = jcap["streams"].get<bool>();
-      
-    auto cc = jcap["cc"].get<std::vector<std::string>>();
-    c.cc = std::move(cc);
-
+  for(auto& c : data) {
     if(c.impl == "udp") c.cc.push_back("none");
 
     caps.push_back(std::move(c));
@@ -71,150 +101,204 @@ void CapabititiesVector::from_json(const std::vector<nlohmann::json>& data)
 TunnelMgr::TunnelMgr(MedoozeMgr& m, PeerconnectionMgr& pc)
   : _medooze(m), _pc(pc)
 {
-  client.socket.onmessage = [this](auto&& msg) {
-    if(msg["type"] == "error") TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Client received error" << msg["data"]["message"];
-    else if(msg["type"] == "response") parse_client_response(msg);
+  // Replies are routed to their request, anything else is unexpected
+  client.onmessage = [](auto&& msg) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Client unexpected message : " << msg.dump();
   };
 
-  server.socket.onmessage = [this](auto&& msg) {
-    if(msg["type"] == "error") TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Server received error" << msg["data"]["message"];
-    else if(msg["type"] == "response") parse_server_response(msg);
+  server.onmessage = [](auto&& msg) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Server unexpected message : " << msg.dump();
   };
 
-  _pc.onlocaldesc = [this](auto&& desc) -> void { _medooze.view(desc); };
+  // The offer is sent by start() once the tunnel is up
+  _pc.onlocaldesc = [this](auto&& desc) -> void {
+    mark_phase("offer");
+    try {
+      _offer.set_value(desc);
+    }
+    catch(const std::future_error&) {
+      // renegotiation, only the first offer is viewed
+    }
+  };
+  _pc.onfirstframe = [this]() -> void { mark_phase("first_frame"); };
+  // Chunks are serialized and sent on the event loop, the signaling thread
+  // only samples. At most one upload is queued, it takes every full chunk
+  _pc.onstats = [this]() -> void {
+    if(!_running || _upload_posted.exchange(true)) return;
+
+    asio::post(EventLoop::get().context(), [this]() {
+      if(_running) upload_stats(false);
+
+      _upload_posted = false;
+      _upload_posted.notify_all();
+    });
+  };
   _medooze.onanswer = [this](auto&& sdp) -> void { _pc.set_remote_description(sdp); };
 }
 
 TunnelMgr::~TunnelMgr()
 {
-
-}
-
-void TunnelMgr::parse_client_response(const json& response)
-{
-  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "client received : " << response.dump();
-  
-  int req = response["transId"].get<int>();
-
-  auto data = response["data"];
-  
-  switch(req) {
-  case START_REQUEST:
-    client.session_id = data["id"].get<int>();
-    if(onstart) onstart();
-    _pc.start();
-    _cv.notify_all();
-    break;
-  case STOP_REQUEST:
-    _cv.notify_all();
-    break;
-  case CAPABILITIES_REQUEST:
-    // capabilities affect
-    _caps.from_json(data["in_impls"].get<std::vector<json>>());
-    _cv.notify_all();
-    // capabilities callback
-    break;
-  default:
-      std::unreachable();
-  }
-}
-
-void TunnelMgr::parse_server_response(const json& response)
-{
-  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "server received : " << response.dump();
-  int req = response["transId"].get<int>();
-
-  auto data = response["data"];
-
-  switch(req) {
-  case START_REQUEST: {
-    server.session_id = data["id"].get<int>();
-
-    // start client
-    json data = {
-      { "impl", in_config.impl },
-      { "datagrams", in_config.datagrams },
-      { "cc", in_config.cc },
-      { "quic_port", in_config.quic_port },
-      { "quic_host", in_config.quic_host },
-      { "external_file_transfer", in_config.external_file_transfer }
-    };
-
-    client.send("startclient", START_REQUEST, data);
-    
-    break;
-  }
-  case STOP_REQUEST:
-    // get stats
-    _cv2.notify_all();
-    break;
-  case UPLOAD_REQUEST:
-    // nothing / ack
-    break;
-  case GETSTATS_REQUEST: {
-    std::string url = data["url"].get<std::string>();
-    auto pos = url.find("/", url.find("/") + 2);
-
-    // remove https://host/
-    _result_path = url.substr(pos + 1);
-    _result_path.remove_filename();
-
-    // fs::copy("bitstream.264", path / fs::path{"bitstream.264"});
-
-    _cv2.notify_all();
-    break;
-  }
-  case LINK_REQUEST:
-
-    break;
-  default:
-    std::unreachable();
-  }
+  _upload_posted.wait(true);
+  wait_post_processing();
 }
 
-void TunnelMgr::connect()
+bool TunnelMgr::connect()
 {
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::connect";
 
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "connect client";
-  client.connect();
+  if(!client.connect(rpc_timeout)) return false;
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "connect server";
-  server.connect();
+  if(!server.connect(rpc_timeout)) return false;
   
   TUNNEL_LOG(TunnelLogging::Severity::INFO) << "TunnelMgr::connected";
+  return true;
 }
 
 void TunnelMgr::disconnect()
 {
   TUNNEL_LOG(TunnelLogging::Severity::INFO) << "TunnelMgr::disconnect";
+  // Its getstats reply comes over the server connection
+  wait_post_processing();
+
   client.disconnect();
   server.disconnect();
 }
 
-void TunnelMgr::start()
+void TunnelMgr::mark_phase(std::string_view name)
+{
+  using namespace std::chrono;
+  
+  std::lock_guard<std::mutex> lock(_phase_mutex);
+  _phases.emplace_back(name, duration<double, std::milli>(steady_clock::now() - _phase_origin).count());
+}
+
+TunnelMgr::json TunnelMgr::phases_to_json()
+{
+  std::lock_guard<std::mutex> lock(_phase_mutex);
+  json phases = json::object();
+
+  for(auto&& [name, ms] : _phases) phases[name] = ms;
+
+  return phases;
+}
+
+bool TunnelMgr::start()
 {
   TUNNEL_LOG(TunnelLogging::Severity::INFO) << "TunnelMgr::start";
   _running = true;
-  _medooze.start();
+  ++_run_index;
+  _pc.bitstream_path = fmt::format("bitstream_{}.264", run_name());
+
+  {
+    std::lock_guard<std::mutex> lock(_upload_mutex);
+    _upload_cursor = 0;
+    _upload_seq = 0;
+    _upload_done = false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_phase_mutex);
+    _phases.clear();
+    _phase_origin = std::chrono::steady_clock::now();
+  }
 
-  out_config.rtp_port = _medooze.get_rtp_port();
+  _offer = std::promise<std::string>{};
+  auto offer = _offer.get_future();
+
+  // Independent of each other : startserver only needs the port, and the
+  // offer is only sent once both medooze and the tunnel are up
+  auto medooze = std::async(std::launch::async, [this]() {
+    bool connected = _medooze.start();
+    mark_phase("medooze_connect");
+    return connected;
+  });
+
+  auto rtp_port = std::async(std::launch::async, [this]() {
+    int port = _medooze.get_rtp_port();
+    mark_phase("rtp_port");
+    return port;
+  });
+
+  // Ends that returned a session id, stopped again if a later step fails
+  bool server_started = false;
+  bool client_started = false;
+
+  try {
+    // The offer is created on the signaling thread meanwhile
+    _pc.start();
+    mark_phase("peerconnection");
+
+    out_config.rtp_port = rtp_port.get();
+    if(out_config.rtp_port < 0) throw std::runtime_error("no rtp port from medooze");
   
-  // start server
-  json data = {
-    { "impl", out_config.impl },
-    { "datagrams", out_config.datagrams },
-    { "cc", out_config.cc },
-    { "port_out", out_config.rtp_port },
-    { "addr_out", _medooze.host },
-    { "quic_port", out_config.quic_port },
-    { "quic_host", out_config.quic_host },
-    { "external_file_transfer", out_config.external_file_transfer }
-  };
+    // start server
+    messages::StartServer start_server{
+      .impl = out_config.impl,
+      .datagrams = out_config.datagrams,
+      .cc = out_config.cc,
+      .port_out = out_config.rtp_port,
+      .addr_out = _medooze.host,
+      .quic_port = out_config.quic_port,
+      .quic_host = out_config.quic_host,
+      .external_file_transfer = out_config.external_file_transfer
+    };
+
+    server.session_id = server.request(start_server, rpc_timeout).get().id;
+    server_started = true;
+    mark_phase("startserver");
+
+    // start client, once the server listens
+    messages::StartClient start_client{
+      .impl = in_config.impl,
+      .datagrams = in_config.datagrams,
+      .cc = in_config.cc,
+      .quic_port = in_config.quic_port,
+      .quic_host = in_config.quic_host,
+      .external_file_transfer = in_config.external_file_transfer
+    };
+
+    client.session_id = client.request(start_client, rpc_timeout).get().id;
+    client_started = true;
+    mark_phase("startclient");
 
-  server.send("startserver", START_REQUEST, data);
+    if(!medooze.get()) throw std::runtime_error("not connected to medooze");
 
-  std::unique_lock<std::mutex> lck(_cv_mutex);
-  _cv.wait(lck);
+    if(offer.wait_for(rpc_timeout) != std::future_status::ready) throw std::runtime_error("no local offer");
+    _medooze.view(offer.get());
+    mark_phase("view");
+
+    if(onstart) onstart();
+  }
+  catch(const std::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not start the tunnel : " << e.what();
+    _running = false;
+
+    // Let the concurrent steps end before tearing down
+    if(medooze.valid()) medooze.wait();
+    if(rtp_port.valid()) rtp_port.wait();
+
+    // Both ends concurrently, like stop()
+    std::optional<std::future<messages::Ack>> client_reply, server_reply;
+    if(client_started) client_reply = client.request(messages::StopClient{ client.session_id }, rpc_timeout);
+    if(server_started) server_reply = server.request(messages::StopServer{ server.session_id }, rpc_timeout);
+
+    _medooze.stop();
+    _pc.stop();
+
+    if(client_reply) wait(*client_reply, "stopclient");
+    if(server_reply) wait(*server_reply, "stopserver");
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_phase_mutex);
+    for(auto&& [name, ms] : _phases) {
+      TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Setup " << name << " : " << ms << " ms";
+    }
+  }
+
+  return true;
 }
 
 void TunnelMgr::stop()
@@ -222,129 +306,271 @@ void TunnelMgr::stop()
   TUNNEL_LOG(TunnelLogging::Severity::INFO) << "TunnelMgr::stop";
   _running = false;
 
-  reset_link();
-  
-  upload_stats();
+  auto link_reply = reset_link();
+
+  if(auto phases = phases_to_json(); phases.contains("first_frame")) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Setup first_frame : " << phases["first_frame"].get<double>() << " ms";
+  }
+  else {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "No frame received during the run";
+  }
+
+  // Only what was not streamed yet during the run
+  upload_stats(true);
 
   _medooze.stop();
   _pc.stop();
 
-  // stop client
-  auto client_th = std::thread([this]() {
-    json data = { { "id", client.session_id } };
-    client.send("stopclient", STOP_REQUEST, data);
+  if(onstop) onstop();
 
-    std::unique_lock<std::mutex> lck(_cv_mutex);
-    _cv.wait(lck);
-  });
+  // stop both ends concurrently
+  auto client_reply = client.request(messages::StopClient{ client.session_id }, rpc_timeout);
+  auto server_reply = server.request(messages::StopServer{ server.session_id }, rpc_timeout);
 
-  // stop server
-  auto server_th = std::thread([this]() {
-    json data = { { "id", server.session_id } };
-    server.send("stopserver", STOP_REQUEST, data);
+  wait(link_reply, "reset link");
+  wait(client_reply, "stopclient");
+  wait(server_reply, "stopserver");
 
-    std::unique_lock<std::mutex> lck(_cv_mutex2);
-    _cv2.wait(lck);
-  });
+  // Results are ready once the server is stopped. The request goes out
+  // now, ahead of the next startserver, the reply is waited for and the
+  // results uploaded while the next run starts
+  post_process(get_stats());
+}
 
-  if(client_th.joinable()) client_th.join();
-  if(server_th.joinable()) server_th.join();
+void TunnelMgr::post_process(std::future<messages::GetStatsReply> stats_reply)
+{
+  // One run in post-processing at most
+  wait_post_processing();
+
+  // This run's configuration, the next one may already be starting
+  ResultUploader::Job job{
+    {},
+    {
+      { "exp", exp_name },
+      { "reliability", (out_config.datagrams) ? "dgram" : "stream" },
+      { "cc", out_config.cc },
+      { "impl", out_config.impl }
+    }
+  };
 
-  get_stats();
-  
-  std::unique_lock<std::mutex> lck(_cv_mutex2);
-  _cv2.wait(lck);
-  
-  std::string cmd = fmt::format("cd {} && zip upload.zip * && {}", _result_path.string(), curl_cmd);
-  std::system(cmd.c_str());
+  _post_processing = std::async(std::launch::async, [this, stats_reply = std::move(stats_reply), job = std::move(job)]() mutable {
+    auto stats = wait(stats_reply, "getstats");
+
+    if(!stats) return;
+
+    const std::string& url = stats->url;
+    auto pos = url.find("/", url.find("/") + 2);
+
+    // remove https://host/
+    job.directory = url.substr(pos + 1);
+    job.directory.remove_filename();
+
+    // fs::copy("bitstream.264", path / fs::path{"bitstream.264"});
+
+    // Zipped and posted by the uploader workers
+    _uploader.submit(std::move(job));
+  });
+}
+
+void TunnelMgr::wait_post_processing()
+{
+  if(_post_processing.valid()) _post_processing.get();
 }
 
 void TunnelMgr::run(std::queue<Constraints>& c)
 {
   TUNNEL_LOG(TunnelLogging::Severity::INFO) << "TunnelMgr::run";
-  
-  if(!_running) return;
 
-  while(!c.empty()) {
-    if(!c.front().has_value()) {
-      c.pop();
-      break;
+  run_steps([&c]() -> std::optional<LinkStep> {
+    if(c.empty()) return std::nullopt;
+
+    auto step = c.front();
+    c.pop();
+    return step;
+  });
+}
+
+void TunnelMgr::run_trace(const std::filesystem::path& path, const LinkTrace::Options& options)
+{
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "TunnelMgr::run_trace " << path.string();
+
+  std::optional<LinkTrace> trace;
+
+  try {
+    trace.emplace(path, options);
+  }
+  catch(const std::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not read trace : " << e.what();
+    if(_running) stop();
+    return;
+  }
+
+  run_steps([&trace]() -> std::optional<LinkStep> {
+    try {
+      return trace->next();
     }
+    catch(const std::exception& e) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Trace cut short : " << e.what();
+      return std::nullopt;
+    }
+  });
+}
+
+void TunnelMgr::run_steps(const std::function<std::optional<LinkStep>()>& next)
+{
+  using namespace std::chrono;
+
+  if(!_running) return;
+
+  {
+    std::lock_guard<std::mutex> lock(_link_mutex);
+    _link_steps.clear();
+  }
+
+  auto since_start = [this](steady_clock::time_point t) {
+    return duration<double, std::milli>(t - _phase_origin).count();
+  };
+
+  // Deadlines are absolute, the time spent sending a step is not added to
+  // the next one and a long schedule does not drift
+  auto deadline = steady_clock::now();
+  std::future<messages::Ack> reply;
+  size_t late = 0;
 
-    auto [ time, bitrate, delay, loss ] = *c.front();
-    set_link(bitrate, delay, loss);
+  // The ack of the last step sent, if it comes before the next deadline
+  auto wait_ack = [&]() {
+    if(!reply.valid()) return;
+
+    bool acked = reply.wait_until(deadline) == std::future_status::ready && wait(reply, "link");
+    auto now = steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(_link_mutex);
+    if(acked) _link_steps.back().acked = since_start(now);
+  };
+
+  while(auto step = next()) {
+    auto [time, bitrate, delay, loss] = *step;
+
+    wait_ack();
+    std::this_thread::sleep_until(deadline);
+
+    auto sent = steady_clock::now();
+    if(sent - deadline > milliseconds(10)) ++late;
+
+    reply = set_link(bitrate, delay, loss);
     _pc.link = bitrate;
 
-    c.pop();
-    
-    std::this_thread::sleep_for(std::chrono::seconds(time));
+    {
+      std::lock_guard<std::mutex> lock(_link_mutex);
+      _link_steps.push_back({ since_start(deadline), since_start(sent), -1, bitrate, delay, loss });
+    }
+
+    deadline += time;
+  }
+
+  wait_ack();
+  std::this_thread::sleep_until(deadline);
+
+  if(late > 0) {
+    // Steps shorter than the link command round trip
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << late << " link steps applied more than 10 ms late";
   }
 
   stop();
 }
 
-void TunnelMgr::run_all(int repet, std::queue<Constraints>& c)
+TunnelMgr::json TunnelMgr::link_to_json()
 {
-  std::queue<Constraints> save = c;
+  std::lock_guard<std::mutex> lock(_link_mutex);
+  json steps = json::array();
+
+  for(auto& step : _link_steps) {
+    steps.push_back(json{
+      { "planned", step.planned },
+      { "sent", step.sent },
+      { "acked", step.acked },
+      { "bitrate", step.bitrate },
+      { "delay", step.delay },
+      { "loss", step.loss }
+    });
+  }
 
-  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "--- Running all implementations ---";
-  
-  for(int r = 0; r < repet; ++r) {
-    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "# Repet : " << (r + 1);
-    
-    for(size_t impl = 0; impl < _caps.caps.size(); ++impl) {
-      auto [name, dgram, stream] = _caps[impl];
-      out_config.impl = name;
-      in_config.impl = name;
-
-      if(name == "quiche") continue;
-
-      TUNNEL_LOG(TunnelLogging::Severity::INFO) << "## Impl : " << name;
-      
-      for(int d = 0; d < 2; ++d) { 
-	if((d == 0 && !dgram) || (d == 1 && !stream)) continue;
-	out_config.datagrams = d == 0;
-	in_config.datagrams = d == 0;
-
-	TUNNEL_LOG(TunnelLogging::Severity::INFO) << "### Datagram ? : " << ((d == 0) ? "Yes" : "No");
-		
-	for(size_t cc = 0; cc < _caps.caps[impl].cc.size(); ++cc) {	  
-	  out_config.cc = _caps[impl, cc];
-	  in_config.cc = _caps[impl, cc];
-
-	  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "#### cc : " << out_config.cc;
-
-	  c = save;
-	
-	  while(!c.empty()) {
-	    start();
-	    run(c);
-	  }
-
-	  if(out_config.datagrams) break;
-	}
-      }
-    }
+  return steps;
+}
+
+void TunnelMgr::run_job(const ExperimentJob& job)
+{
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "## Job " << job.index << " : " << job.schedule << " #" << (job.repetition + 1)
+					    << ", " << job.impl << " " << (job.datagrams ? "dgram" : "stream") << " " << job.cc;
+
+  exp_name = job.schedule;
+  out_config.impl = job.impl;
+  in_config.impl = job.impl;
+  out_config.datagrams = job.datagrams;
+  in_config.datagrams = job.datagrams;
+  out_config.cc = job.cc;
+  in_config.cc = job.cc;
+
+  if(!job.trace.empty()) {
+    if(start()) run_trace(job.trace, job.trace_options);
+    return;
+  }
+
+  std::queue<Constraints> c(std::deque<Constraints>(job.steps.begin(), job.steps.end()));
+
+  while(!c.empty()) {
+    // skip this configuration
+    if(!start()) break;
+    run(c);
   }
+}
+
+void TunnelMgr::run_jobs(const std::vector<ExperimentJob>& jobs)
+{
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "--- Running " << jobs.size() << " jobs ---";
+
+  for(auto& job : jobs) run_job(job);
+
+  wait_post_processing();
 
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "Finito";
 }
 
+void TunnelMgr::run_all(int repet, std::queue<Constraints>& c)
+{
+  // Every capability but quiche, as a matrix of the current experiment
+  ExperimentMatrix matrix;
+  matrix.repetitions = repet;
+  matrix.exclusions.push_back({ .impl = "quiche" });
+
+  ExperimentMatrix::Schedule schedule{ exp_name, {} };
+  for(; !c.empty(); c.pop()) schedule.steps.push_back(c.front());
+  matrix.schedules.push_back(std::move(schedule));
+
+  auto jobs = matrix.expand(_caps.caps);
+
+  // Datagram runs only ever used the first cc of the impl
+  std::erase_if(jobs, [this](const ExperimentJob& job) {
+    if(!job.datagrams) return false;
+    auto cap = std::ranges::find(_caps.caps, job.impl, &Capabilities::impl);
+    return cap != _caps.caps.end() && !cap->cc.empty() && cap->cc.front() != job.cc;
+  });
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "--- Running all implementations ---";
+  run_jobs(jobs);
+}
+
 void TunnelMgr::query_capabilities()
 {
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::query_capabilities";
-  json data = {
-    { "out_requested", false },
-    { "in_requested", true }
-  };
+  auto reply = client.request(messages::CapabilitiesQuery{ .out_requested = false, .in_requested = true }, rpc_timeout);
 
-  client.send("capabilities", CAPABILITIES_REQUEST, data);
+  if(auto caps = wait(reply, "capabilities")) _caps.from_json(std::move(caps->in_impls));
 
-  std::unique_lock<std::mutex> lck(_cv_mutex);
-  _cv.wait(lck);
+  if(oncapabilities) oncapabilities();
 }
 
-void TunnelMgr::get_stats()
+std::future<messages::GetStatsReply> TunnelMgr::get_stats()
 {
   using namespace std::chrono;
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::getstats";
@@ -358,60 +584,109 @@ void TunnelMgr::get_stats()
   oss << out_config.impl << "_" << out_config.cc << "_" << ((out_config.datagrams) ? "dgram" : "stream") << "_"
       << date.substr(0, date.size() - 1) << (out_config.external_file_transfer ? "_scp" : "");
 
-  json data = {
-    { "exp_name", oss.str() },
-    { "transport", ((out_config.impl == "tcp" || out_config.impl == "udp") ? out_config.impl : "quic") },
-    { "medooze_dump_url", _medooze.csv_url }
+  messages::GetStats data{
+    .exp_name = oss.str(),
+    .transport = ((out_config.impl == "tcp" || out_config.impl == "udp") ? out_config.impl : "quic"),
+    .medooze_dump_url = _medooze.csv_url
   };
-
-  curl_cmd = fmt::format("curl http://localhost:4455 -Ffile=@upload.zip -Fexp={} -Freliability={} -Fcc={} -Fimpl={}",
-			 exp_name,
-			 ((out_config.datagrams) ? "dgram" : "stream"),
-			 out_config.cc,
-			 out_config.impl);
   
-  server.send("getstats", GETSTATS_REQUEST, data);
+  return server.request(data, std::max(rpc_timeout, std::chrono::milliseconds(30000)));
 }
 
-void TunnelMgr::upload_stats()
+TunnelMgr::json TunnelMgr::stats_to_json(const StatsSeries& stats, size_t begin, size_t end)
+{
+  json samples = json::array();
+
+  for(size_t i = begin; i < end; ++i) {
+    json sample = json::object();
+    stats.visit(i, [&sample](const char* key, auto value) { sample[key] = value; });
+    sample["frameRendered"] = 0;
+
+    samples.push_back(std::move(sample));
+  }
+
+  return samples;
+}
+
+void TunnelMgr::upload_stats(bool final)
 {
   namespace ranges = std::ranges;
-  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::upload_stats";
 
-  std::vector<json> stats_data;
-  
-  ranges::transform(_pc.stats, std::back_inserter(stats_data), [](const auto& s) -> json {
-    return json{
-      { "x", s.x },
-      { "bitrate", s.bitrate },
-      { "link", s.link },
-      { "fps", s.fps },
-      { "frameDropped", s.frame_dropped },
-      { "frameDecoded", s.frame_decoded },
-      { "keyFrameDecoded", s.frame_key_decoded },
-      { "frameRendered", 0 },
+  std::lock_guard<std::mutex> lock(_upload_mutex);
+  if(_upload_done) return;
+
+  auto& stats = _pc.stats;
+
+  // The ring went around before we could send them
+  if(_upload_cursor < stats.begin()) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Stats samples lost before upload : " << (stats.begin() - _upload_cursor);
+    _upload_cursor = stats.begin();
+  }
+
+  while(stats.end() - _upload_cursor >= stats_chunk_size || final) {
+    size_t end = std::min(stats.end(), _upload_cursor + stats_chunk_size);
+    bool last = final && end == stats.end();
+
+    TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::upload_stats seq " << _upload_seq << " [" << _upload_cursor << ", " << end << ")";
+
+    messages::UploadStats data{
+      .seq = _upload_seq++,
+      .offset = _upload_cursor,
+      .final = last,
+      .stats = stats_to_json(stats, _upload_cursor, end)
     };
-  });
 
-  json data = { { "stats",  stats_data } };
+    _upload_cursor = end;
+
+    if(last) {
+      std::vector<json> latency_data;
+
+      ranges::transform(_pc.tracer.summary(), std::back_inserter(latency_data), [](const auto& s) -> json {
+	return json{
+	  { "stage", s.name },
+	  { "count", s.count },
+	  { "p50", s.p50 },
+	  { "p95", s.p95 },
+	  { "p99", s.p99 },
+	  { "max", s.max },
+	};
+      });
+
+      data.latency = std::move(latency_data);
+      data.setup = phases_to_json();
+      data.link = link_to_json();
+
+      // The last decoded frames may still be scored
+      if(_pc.quality) {
+	_pc.quality->drain();
+	data.quality = _pc.quality->to_json();
+      }
+    }
+
+    // ack only, nothing to wait for
+    server.request(data, rpc_timeout);
 
-  server.send("uploadstats", UPLOAD_REQUEST, data);
+    if(last) {
+      _upload_done = true;
+      break;
+    }
+  }
 }
 
-void TunnelMgr::reset_link()
+std::future<messages::Ack> TunnelMgr::reset_link()
 {
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::reset_link";
-  server.send("link", LINK_REQUEST, json{});
+  return server.request(messages::ResetLink{}, rpc_timeout);
 }
 
-void TunnelMgr::set_link(int bitrate, int delay, int loss)
+std::future<messages::Ack> TunnelMgr::set_link(int bitrate, int delay, int loss)
 {
   TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "TunnelMgr::set_link";
-  json data = {
-    { "bitrate", bitrate },
-    { "delay", delay },
-    { "loss", loss }
-  };
+  return server.request(messages::Link{ bitrate, delay, loss }, rpc_timeout);
+}
 
-  server.send("link", LINK_REQUEST, data);
+std::string TunnelMgr::run_name() const
+{
+  return fmt::format("{}{}{}_{}_{}_{}_{}", exp_name, (tag.empty() ? "" : "_"), tag, out_config.impl, out_config.cc,
+		     (out_config.datagrams ? "dgram" : "stream"), _run_index);
 }
@@ -4,38 +4,56 @@
 #include <atomic>
 #include <queue>
 #include <condition_variable>
+#include <future>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <filesystem>
 
 #include "medooze_mgr.h"
 #include "peerconnection.h"
+#include "rpc.h"
+#include "messages.h"
+#include "result_uploader.h"
+#include "experiment_matrix.h"
 
 struct TunnelSocket
 {
   using json = nlohmann::json;
-  
-  WebSocket socket;
+
+  WebSocket  socket;
+  RpcChannel rpc;
 
   std::string host;
   int port;
 
   std::atomic_bool is_connected = false;
+  bool closed = false; // since the last connect(), under cv_mutex
   std::condition_variable cv;
   std::mutex cv_mutex;
   
   int session_id;
+
+  // Ask the peer for a binary encoding after connecting, JSON if it does not answer
+  bool binary = true;
+
+  // Messages that are not replies to our requests
+  std::function<void(const json&)> onmessage;
   
-  void connect();
+  // False if the connection is not open within timeout
+  bool connect(std::chrono::milliseconds timeout);
   void disconnect();
-  void send(std::string_view cmd, int req, const json& data);
-};
 
-struct Capabilities
-{
-  std::string              impl;
-  bool                     datagrams;
-  bool                     streams;
-  std::vector<std::string> cc;
+  template<typename Request>
+  std::future<typename Request::Reply> request(const Request& request,
+					       std::chrono::milliseconds timeout = RpcChannel::DEFAULT_TIMEOUT)
+  {
+    return rpc.call(request, timeout);
+  }
 };
 
+using Capabilities = messages::Capabilities;
+
 struct CapabititiesVector
 {
   std::vector<Capabilities> caps;
@@ -44,20 +62,12 @@ struct CapabititiesVector
   std::tuple<const std::string&, bool, bool> operator[](size_t impl) {
     return { caps[impl].impl, caps[impl].datagrams, caps[impl].streams };
   }
-  void from_json(const std::vector<nlohmann::json>& data);
+  void from_json(std::vector<Capabilities> data);
 };
 
 class TunnelMgr
 {
   using json = nlohmann::json;
-  
-  static constexpr int START_REQUEST = 0;
-  static constexpr int STOP_REQUEST = 1;
-  static constexpr int LINK_REQUEST = 2;
-  static constexpr int OUT_REQUEST = 3;
-  static constexpr int CAPABILITIES_REQUEST = 6;
-  static constexpr int UPLOAD_REQUEST = 8;
-  static constexpr int GETSTATS_REQUEST = 9;
 
   std::atomic_bool   _running;
   MedoozeMgr&        _medooze;
@@ -65,18 +75,54 @@ class TunnelMgr
 
   CapabititiesVector _caps;
 
-  void parse_client_response(const json& response);
-  void parse_server_response(const json& response);
+  ResultUploader        _uploader;
+  std::future<void>     _post_processing; // previous run's getstats and upload
+
+  // Waits for the previous run's post-processing and starts this one's
+  void post_process(std::future<messages::GetStatsReply> stats_reply);
+  void wait_post_processing();
+
+  int _run_index = 0;
 
-  std::condition_variable _cv, _cv2;
-  std::mutex _cv_mutex, _cv_mutex2;
+  // Stats streamed to the server during the run
+  std::mutex _upload_mutex;
+  size_t     _upload_cursor = 0;
+  int        _upload_seq = 0;
+  bool       _upload_done = false;
+  std::atomic_bool _upload_posted = false; // an interim upload is queued on the event loop
 
-  std::string curl_cmd;
-  std::filesystem::path _result_path;
+  // Session bring-up, time of each phase since start() was called
+  std::mutex                                  _phase_mutex;
+  std::chrono::steady_clock::time_point       _phase_origin;
+  std::vector<std::pair<std::string, double>> _phases; // name, ms
+  std::promise<std::string>                   _offer;
+
+  void mark_phase(std::string_view name);
+  json phases_to_json();
+
+  // Link steps of the run as applied, times in ms since start() like the
+  // phases : planned, command sent, acknowledged (-1 if not before the
+  // next step)
+  struct AppliedStep
+  {
+    double planned;
+    double sent;
+    double acked;
+    int    bitrate;
+    int    delay;
+    int    loss;
+  };
+
+  std::mutex               _link_mutex;
+  std::vector<AppliedStep> _link_steps;
+
+  // Applies the steps on absolute deadlines until next() has none, then stops
+  void run_steps(const std::function<std::optional<LinkStep>()>& next);
+  json link_to_json();
   
 public:
 
-  using Constraints = std::optional<std::tuple<int, int, int, int>>;
+  using Constraints = LinkConstraint;
 
   struct
   {
@@ -93,31 +139,69 @@ public:
   TunnelSocket server;
 
   std::string exp_name;
+  // Session of a SessionGroup, part of the run name when set
+  std::string tag;
 
   std::function<void()> onstart;
   std::function<void()> onstop;
   std::function<void(/*caps*/)> oncapabilities;
 
   std::queue<Constraints> constraints;
+
+  // Deadline of each request to the tunnel ends
+  std::chrono::milliseconds rpc_timeout{10000};
+
+  // Samples per uploadstats message
+  size_t stats_chunk_size = 300;
   
   TunnelMgr(MedoozeMgr& m, PeerconnectionMgr& pc);
   ~TunnelMgr();
 
-  void connect();
+  // False if either end could not be reached
+  bool connect();
   void disconnect();
 
-  void start();
+  // False if the session could not be set up, nothing is left running then
+  bool start();
   void stop();
 
+  // Steps up to the first nullopt
   void run(std::queue<Constraints>& c);
+  // A whole trace file as one run
+  void run_trace(const std::filesystem::path& path, const LinkTrace::Options& options);
+  // Every capability, c repet times
   void run_all(int repet, std::queue<Constraints>& c);
+  // Jobs of an ExperimentMatrix, in order
+  void run_job(const ExperimentJob& job);
+  void run_jobs(const std::vector<ExperimentJob>& jobs);
+
+  const std::vector<Capabilities>& capabilities() const { return _caps.caps; }
 
   void query_capabilities();
-  void get_stats();
-  void upload_stats();
+  std::future<messages::GetStatsReply> get_stats();
+  // Sends full chunks, or everything left and the run summary if final
+  void upload_stats(bool final);
+
+  static json stats_to_json(const StatsSeries& stats, size_t begin, size_t end);
+
+  std::future<messages::Ack> reset_link();
+  std::future<messages::Ack> set_link(int bitrate, int delay, int loss);
+
+  // Logs the failure, returns the reply or nothing
+  template<typename Reply>
+  static std::optional<Reply> wait(std::future<Reply>& reply, std::string_view what)
+  {
+    try {
+      return reply.get();
+    }
+    catch(const std::exception& e) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << what << " : " << e.what();
+      return std::nullopt;
+    }
+  }
 
-  void reset_link();
-  void set_link(int bitrate, int delay, int loss);
+  // exp[_tag]_impl_cc_mode_index of the current run, for per run output files
+  std::string run_name() const;
 };
 
 #endif /* TUNNEL_MGR_H */
@@ -1,6 +1,22 @@
 #include "websocket.h"
 
 #include <sstream>
+#include <unordered_map>
+
+#include <openssl/ssl.h>
+
+namespace
+{
+  // Last session ticket of each endpoint, offered on the next handshake
+  std::mutex                                     sessions_mutex;
+  std::unordered_map<std::string, SSL_SESSION*> sessions;
+
+  int session_owner_index()
+  {
+    static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+  }
+}
 
 void WebSocket::connect(std::string_view host, int port, const std::string& protocol)
 {
@@ -26,6 +42,7 @@ void WebSocketSecure::connect(std::string_view host, int port, const std::string
   std::ostringstream url;
   url << "wss://" << host << ":" << port;
 
+  _endpoint = url.str();
   WebSocketBase::connect(url.str(), protocol);
 }
 
@@ -34,24 +51,63 @@ void WebSocketSecure::connect(std::string_view host, std::string_view port, cons
   std::ostringstream url;
   url << "wss://" << host << ":" << port;
 
+  _endpoint = url.str();
   WebSocketBase::connect(url.str(), protocol);
 }
 
-websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context> WebSocketSecure::on_tls_init(websocketpp::connection_hdl hdl)
+websocketpp::lib::shared_ptr<WebSocketSecure::ssl_context> WebSocketSecure::tls_context()
 {
-  auto ctx = websocketpp::lib::make_shared<asio::ssl::context>(asio::ssl::context::tlsv13_client);
-  try {
-    // Remove support for undesired TLS versions
-    ctx->set_options(asio::ssl::context::default_workarounds |
-                     asio::ssl::context::no_sslv2 |
-                     asio::ssl::context::no_sslv3 |
-                     asio::ssl::context::no_tlsv1 |
-                     asio::ssl::context::single_dh_use);
-  }
-  catch (std::exception& e) {
-    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "on tls init error";
-  }
+  static auto ctx = []() {
+    auto ctx = websocketpp::lib::make_shared<ssl_context>(ssl_context::tlsv13_client);
+    try {
+      // Remove support for undesired TLS versions
+      ctx->set_options(ssl_context::default_workarounds |
+		       ssl_context::no_sslv2 |
+		       ssl_context::no_sslv3 |
+		       ssl_context::no_tlsv1 |
+		       ssl_context::single_dh_use);
+    }
+    catch (std::exception& e) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "on tls init error";
+    }
+
+    // Sessions are kept by us per endpoint, OpenSSL does not resume client side by itself
+    SSL_CTX_set_session_cache_mode(ctx->native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx->native_handle(), &WebSocketSecure::on_new_session);
+
+    return ctx;
+  }();
 
   return ctx;
 }
 
+int WebSocketSecure::on_new_session(SSL* ssl, SSL_SESSION* session)
+{
+  auto owner = static_cast<WebSocketSecure*>(SSL_get_ex_data(ssl, session_owner_index()));
+  if(!owner) return 0;
+
+  std::lock_guard<std::mutex> lock(sessions_mutex);
+  auto& slot = sessions[owner->_endpoint];
+  if(slot) SSL_SESSION_free(slot);
+  slot = session;
+
+  // We keep the reference
+  return 1;
+}
+
+websocketpp::lib::shared_ptr<WebSocketSecure::ssl_context> WebSocketSecure::on_tls_init(websocketpp::connection_hdl hdl)
+{
+  return tls_context();
+}
+
+void WebSocketSecure::on_socket_init(websocketpp::connection_hdl hdl, ssl_socket& socket)
+{
+  SSL* ssl = socket.native_handle();
+  SSL_set_ex_data(ssl, session_owner_index(), this);
+
+  std::lock_guard<std::mutex> lock(sessions_mutex);
+  if(auto it = sessions.find(_endpoint); it != sessions.end()) {
+    TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "Resuming TLS session with " << _endpoint;
+    SSL_set_session(ssl, it->second);
+  }
+}
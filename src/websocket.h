@@ -7,8 +7,10 @@
 #include <thread>
 #include <functional>
 #include <string_view>
+#include <condition_variable>
 
 #include "tunnel_loggin.h"
+#include "event_loop.h"
 
 #define ASIO_STANDALONE
 #define _WEBSOCKETPP_CPP11_STL_
@@ -22,27 +24,98 @@
 #include "websocketpp/config/asio_client.hpp"
 #include "websocketpp/client.hpp"
 
+#ifdef QCLIENT_WS_DEFLATE
+#include "websocketpp/extensions/permessage_deflate/enabled.hpp"
+#endif
+
 #include "nlohmann/json.hpp"
 
+#ifdef QCLIENT_WS_DEFLATE
+
+// Websocketpp client config with the permessage-deflate extension, on top of
+// the plain or TLS asio client config
+template<typename Base, typename Socket>
+struct DeflateClientConfig : public Base
+{
+  using type = DeflateClientConfig;
+  using base = Base;
+
+  using concurrency_type = typename base::concurrency_type;
+  using request_type = typename base::request_type;
+  using response_type = typename base::response_type;
+  using message_type = typename base::message_type;
+  using con_msg_manager_type = typename base::con_msg_manager_type;
+  using endpoint_msg_manager_type = typename base::endpoint_msg_manager_type;
+  using alog_type = typename base::alog_type;
+  using elog_type = typename base::elog_type;
+  using rng_type = typename base::rng_type;
+
+  struct transport_config : public base::transport_config
+  {
+    using concurrency_type = typename type::concurrency_type;
+    using alog_type = typename type::alog_type;
+    using elog_type = typename type::elog_type;
+    using request_type = typename type::request_type;
+    using response_type = typename type::response_type;
+    using socket_type = Socket;
+  };
+
+  using transport_type = websocketpp::transport::asio::endpoint<transport_config>;
+
+  struct permessage_deflate_config {};
+  using permessage_deflate_type = websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config>;
+};
+
+using WssClient = websocketpp::client<DeflateClientConfig<websocketpp::config::asio_tls_client,
+							  websocketpp::transport::asio::tls_socket::endpoint>>;
+using WsClient = websocketpp::client<DeflateClientConfig<websocketpp::config::asio_client,
+							 websocketpp::transport::asio::basic_socket::endpoint>>;
+#else
 using WssClient = websocketpp::client<websocketpp::config::asio_tls_client>;
 using WsClient = websocketpp::client<websocketpp::config::asio_client>;
+#endif
+
 using MessagePtr = websocketpp::config::asio_client::message_type::ptr;
 
+// Wire format of the messages, JSON text unless a binary one was negotiated
+enum class Encoding : uint8_t { JSON, CBOR, MSGPACK };
+
 template<typename Client>
 class WebSocketBase
 {
 protected:
   using json = nlohmann::json;
+  EventLoop&                      _loop;
   Client                          _client;
   typename Client::connection_ptr _connection;
-  std::thread                     _thread;
   std::mutex                      _mutex; // To manage access to send commands.
   std::mutex                      _close_mutex; // To manage access to close status.
   std::atomic_bool                _is_closed{true};
 
+  // Set once the connection is closed or failed, nothing will call us back after
+  std::mutex                      _state_mutex;
+  std::condition_variable         _state_cv;
+  bool                            _terminated = true;
+  std::atomic<Encoding>           _encoding{Encoding::JSON};
+
   void on_message(websocketpp::connection_hdl hdl, MessagePtr frame)
   {
-    auto msg = json::parse(frame->get_payload());
+    json msg;
+
+    try {
+      if(frame->get_opcode() == websocketpp::frame::opcode::binary) {
+	msg = (_encoding == Encoding::CBOR) ? json::from_cbor(frame->get_payload())
+	                                    : json::from_msgpack(frame->get_payload());
+      }
+      else {
+	msg = json::parse(frame->get_payload());
+      }
+    }
+    catch(const json::exception& e) {
+      TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not decode websocket message : " << e.what();
+      return;
+    }
+
     if(onmessage) onmessage(msg);
   }
   
@@ -57,6 +130,34 @@ protected:
   {
     TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "ws on close";
     if(onclose) onclose();
+    set_terminated();
+  }
+
+  void on_failed(websocketpp::connection_hdl hdl)
+  {
+    auto con = _client.get_con_from_hdl(hdl);
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "ws connection failed : " << con->get_ec().message();
+    if(onclose) onclose();
+    set_terminated();
+  }
+
+  void set_terminated()
+  {
+    std::lock_guard<std::mutex> lock(_state_mutex);
+    _is_closed = true;
+    _terminated = true;
+    _state_cv.notify_all();
+  }
+
+  // Handlers run on the loop, waiting there for our own close would deadlock
+  void wait_terminated()
+  {
+    if(_loop.in_loop_thread()) return;
+
+    std::unique_lock<std::mutex> lock(_state_mutex);
+    if(!_state_cv.wait_for(lock, std::chrono::seconds(6), [this]() { return _terminated; })) {
+      TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "Websocket did not close in time";
+    }
   }
   
 public:
@@ -65,14 +166,18 @@ public:
   std::function<void()>            onclose;
   std::function<void(const json&)> onmessage;
 
-  WebSocketBase()
+  explicit WebSocketBase(EventLoop& loop) : _loop(loop)
   {
     _client.set_access_channels(websocketpp::log::alevel::none);
     _client.clear_access_channels(websocketpp::log::alevel::all);
     _client.set_error_channels(websocketpp::log::elevel::all);
-    _client.init_asio();
+    _client.init_asio(&_loop.context());
+  }
+  ~WebSocketBase()
+  {
+    disconnect();
+    wait_terminated();
   }
-  ~WebSocketBase() { disconnect(); }
 
   void connect(const std::string& url, const std::string& protocol)
   {
@@ -96,14 +201,18 @@ public:
       _connection->set_message_handler([this](auto&& hdl, auto&& frame) { on_message(hdl, frame); });
       _connection->set_open_handler([this](auto&& hdl) { on_opened(hdl); });
       _connection->set_close_handler([this](auto&& hdl) { on_closed(hdl); });
-      _connection->set_fail_handler([](auto&& hdl) -> void {});
+      _connection->set_fail_handler([this](auto&& hdl) { on_failed(hdl); });
       _connection->set_http_handler([](auto&&) {});
 
       if(!protocol.empty()) _connection->add_subprotocol(protocol);
-    
-      _client.connect(_connection);
 
-      _thread = std::thread([this]() { _client.run(); });
+      {
+	std::lock_guard<std::mutex> state_lock(_state_mutex);
+	_terminated = false;
+      }
+
+      // Runs on the shared event loop, no thread of our own
+      _client.connect(_connection);
     }
     catch (const std::exception& e) {
       TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Connect exception: " <<  e.what();
@@ -132,8 +241,10 @@ public:
       }
       close_lock.unlock();
 
-      _thread.join();
-      _client.reset();  
+      lock.unlock();
+      wait_terminated();
+      lock.lock();
+
       _connection = nullptr;
     }
     catch (const std::exception& e) {
@@ -141,6 +252,26 @@ public:
     }
   }
 
+  void set_encoding(Encoding encoding) { _encoding = encoding; }
+  Encoding encoding() const { return _encoding; }
+
+  // Serialize with the current encoding, binary frames for CBOR/MessagePack
+  auto send_json(const json& msg)
+  {
+    switch(_encoding) {
+    case Encoding::CBOR: {
+      auto bin = json::to_cbor(msg);
+      return send(bin.data(), bin.size(), websocketpp::frame::opcode::binary);
+    }
+    case Encoding::MSGPACK: {
+      auto bin = json::to_msgpack(msg);
+      return send(bin.data(), bin.size(), websocketpp::frame::opcode::binary);
+    }
+    default:
+      return send(msg.dump());
+    }
+  }
+
   template<typename... Args>
   auto send(Args&& ... args) {
     std::unique_lock<std::mutex> lock(_mutex);
@@ -153,11 +284,23 @@ public:
 
 class WebSocketSecure : public WebSocketBase<WssClient>
 {
-  websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context> on_tls_init(websocketpp::connection_hdl hdl);
+  using ssl_context = websocketpp::lib::asio::ssl::context;
+  using ssl_socket = websocketpp::lib::asio::ssl::stream<websocketpp::lib::asio::ip::tcp::socket>;
+
+  // Server url, TLS sessions are resumed per endpoint
+  std::string _endpoint;
+
+  // One context for every connection, created on first use
+  static websocketpp::lib::shared_ptr<ssl_context> tls_context();
+  static int on_new_session(SSL* ssl, SSL_SESSION* session);
+
+  websocketpp::lib::shared_ptr<ssl_context> on_tls_init(websocketpp::connection_hdl hdl);
+  void on_socket_init(websocketpp::connection_hdl hdl, ssl_socket& socket);
   
 public:
-  WebSocketSecure() {
+  explicit WebSocketSecure(EventLoop& loop = EventLoop::get()) : WebSocketBase(loop) {
     _client.set_tls_init_handler([this](auto&& hdl) { return on_tls_init(hdl); });
+    _client.set_socket_init_handler([this](auto&& hdl, auto&& socket) { on_socket_init(hdl, socket); });
   }
   
   void connect(std::string_view host, int port, const std::string& protocol = "");
@@ -168,6 +311,8 @@ class WebSocket : public WebSocketBase<WsClient>
 {
 
 public:
+  explicit WebSocket(EventLoop& loop = EventLoop::get()) : WebSocketBase(loop) {}
+
   void connect(std::string_view host, int port, const std::string& protocol = "");
   void connect(std::string_view host, std::string_view port, const std::string& protocol);
 };
@@ -0,0 +1,200 @@
+#include "zip_writer.h"
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+  constexpr uint32_t LOCAL_HEADER_SIG    = 0x04034b50;
+  constexpr uint32_t DATA_DESCRIPTOR_SIG = 0x08074b50;
+  constexpr uint32_t CENTRAL_HEADER_SIG  = 0x02014b50;
+  constexpr uint32_t END_OF_CENTRAL_SIG  = 0x06054b50;
+
+  constexpr uint16_t VERSION       = 20;     // 2.0, deflate
+  constexpr uint16_t MADE_BY_UNIX  = 3 << 8;
+  constexpr uint16_t FLAGS         = 0x0808; // data descriptor, utf-8 names
+  constexpr uint16_t METHOD_DEFLATE = 8;
+
+  constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+  // MS-DOS time and date of the file modification, local time
+  std::pair<uint16_t, uint16_t> dos_time(const fs::path& path)
+  {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(path, ec);
+    std::time_t t = ec ? std::time(nullptr)
+      : std::chrono::system_clock::to_time_t(std::chrono::file_clock::to_sys(mtime));
+
+    std::tm tm{};
+    localtime_r(&t, &tm);
+    if(tm.tm_year < 80) return { 0, (1 << 5) | 1 };
+
+    uint16_t time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+    uint16_t date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+
+    return { time, date };
+  }
+}
+
+ZipWriter::ZipWriter(Sink sink, int level)
+  : _sink(std::move(sink)), _level(level), _in(BUFFER_SIZE), _out(BUFFER_SIZE)
+{
+}
+
+void ZipWriter::put16(uint16_t v)
+{
+  _header.push_back(v & 0xff);
+  _header.push_back(v >> 8);
+}
+
+void ZipWriter::put32(uint32_t v)
+{
+  put16(v & 0xffff);
+  put16(v >> 16);
+}
+
+void ZipWriter::emit(const uint8_t* data, size_t size)
+{
+  if(size == 0) return;
+
+  _sink(data, size);
+  _offset += size;
+
+  if(_offset > std::numeric_limits<uint32_t>::max()) throw std::runtime_error("zip archive over 4 GiB");
+}
+
+void ZipWriter::emit_header()
+{
+  emit(_header.data(), _header.size());
+  _header.clear();
+}
+
+void ZipWriter::add_file(const fs::path& path, const std::string& name)
+{
+  if(_finished) throw std::logic_error("zip archive already finished");
+
+  std::ifstream file(path, std::ios::binary);
+  if(!file) throw std::runtime_error("can not read " + path.string());
+
+  Entry entry{};
+  entry.name = name;
+  entry.offset = static_cast<uint32_t>(_offset);
+  std::tie(entry.time, entry.date) = dos_time(path);
+
+  put32(LOCAL_HEADER_SIG);
+  put16(VERSION);
+  put16(FLAGS);
+  put16(METHOD_DEFLATE);
+  put16(entry.time);
+  put16(entry.date);
+  put32(0); // crc, sizes : in the data descriptor
+  put32(0);
+  put32(0);
+  put16(name.size());
+  put16(0);
+  _header.insert(_header.end(), name.begin(), name.end());
+  emit_header();
+
+  z_stream zs{};
+  // Raw deflate, no zlib header
+  if(deflateInit2(&zs, _level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw std::runtime_error("deflateInit2 failed");
+  }
+
+  uLong crc = crc32(0, nullptr, 0);
+  uint64_t size = 0;
+  uint64_t compressed_size = 0;
+
+  try {
+    int flush = Z_NO_FLUSH;
+    do {
+      file.read(reinterpret_cast<char*>(_in.data()), _in.size());
+      auto read = static_cast<size_t>(file.gcount());
+      if(file.bad()) throw std::runtime_error("error reading " + path.string());
+
+      crc = crc32(crc, _in.data(), read);
+      size += read;
+
+      flush = file.eof() ? Z_FINISH : Z_NO_FLUSH;
+      zs.next_in = _in.data();
+      zs.avail_in = read;
+
+      do {
+	zs.next_out = _out.data();
+	zs.avail_out = _out.size();
+	if(deflate(&zs, flush) == Z_STREAM_ERROR) throw std::runtime_error("deflate failed");
+
+	size_t have = _out.size() - zs.avail_out;
+	compressed_size += have;
+	emit(_out.data(), have);
+      } while(zs.avail_out == 0);
+    } while(flush != Z_FINISH);
+  }
+  catch(...) {
+    deflateEnd(&zs);
+    throw;
+  }
+
+  deflateEnd(&zs);
+
+  if(size > std::numeric_limits<uint32_t>::max()) throw std::runtime_error(path.string() + " over 4 GiB");
+
+  entry.crc = crc;
+  entry.size = size;
+  entry.compressed_size = compressed_size;
+
+  put32(DATA_DESCRIPTOR_SIG);
+  put32(entry.crc);
+  put32(entry.compressed_size);
+  put32(entry.size);
+  emit_header();
+
+  _entries.push_back(std::move(entry));
+}
+
+void ZipWriter::finish()
+{
+  if(_finished) return;
+  _finished = true;
+
+  uint32_t central_offset = _offset;
+
+  for(auto& entry : _entries) {
+    put32(CENTRAL_HEADER_SIG);
+    put16(MADE_BY_UNIX | VERSION);
+    put16(VERSION);
+    put16(FLAGS);
+    put16(METHOD_DEFLATE);
+    put16(entry.time);
+    put16(entry.date);
+    put32(entry.crc);
+    put32(entry.compressed_size);
+    put32(entry.size);
+    put16(entry.name.size());
+    put16(0); // extra
+    put16(0); // comment
+    put16(0); // disk
+    put16(0); // internal attributes
+    put32(0100644u << 16); // regular file, rw-r--r--
+    put32(entry.offset);
+    _header.insert(_header.end(), entry.name.begin(), entry.name.end());
+    emit_header();
+  }
+
+  uint32_t central_size = _offset - central_offset;
+
+  put32(END_OF_CENTRAL_SIG);
+  put16(0);
+  put16(0);
+  put16(_entries.size());
+  put16(_entries.size());
+  put32(central_size);
+  put32(central_offset);
+  put16(0);
+  emit_header();
+}
@@ -0,0 +1,65 @@
+#ifndef ZIP_WRITER_H
+#define ZIP_WRITER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <filesystem>
+
+#include <zlib.h>
+
+// Streaming ZIP archive writer. Entries are deflated straight into the
+// sink, their sizes and crc follow the data in a data descriptor so
+// nothing needs to be seeked back nor held in memory. No zip64, entries
+// and the archive must stay under 4 GiB.
+//
+// Errors (unreadable file, zlib failure, sink failure) throw.
+class ZipWriter
+{
+public:
+  // Called with every piece of the archive, in order
+  using Sink = std::function<void(const uint8_t* data, size_t size)>;
+
+  explicit ZipWriter(Sink sink, int level = Z_DEFAULT_COMPRESSION);
+
+  ZipWriter(const ZipWriter&) = delete;
+  ZipWriter& operator=(const ZipWriter&) = delete;
+
+  // Deflates the file as name in the archive
+  void add_file(const std::filesystem::path& path, const std::string& name);
+  // Writes the central directory, nothing can be added afterwards
+  void finish();
+
+  uint64_t size() const { return _offset; }
+
+private:
+  struct Entry
+  {
+    std::string name;
+    uint32_t    crc;
+    uint32_t    compressed_size;
+    uint32_t    size;
+    uint32_t    offset;
+    uint16_t    time;
+    uint16_t    date;
+  };
+
+  Sink               _sink;
+  int                _level;
+  uint64_t           _offset = 0;
+  bool               _finished = false;
+  std::vector<Entry> _entries;
+
+  std::vector<uint8_t> _in;
+  std::vector<uint8_t> _out;
+  std::vector<uint8_t> _header;
+
+  void put16(uint16_t v);
+  void put32(uint32_t v);
+  void emit(const uint8_t* data, size_t size);
+  void emit_header();
+};
+
+#endif /* ZIP_WRITER_H */
@@ -0,0 +1,59 @@
+#include "fault_injector.h"
+
+#include <stdexcept>
+#include <cstdlib>
+
+FaultInjector::FaultInjector(uint64_t seed) : _rng(seed)
+{
+}
+
+void FaultInjector::add_rule(std::string_view spec)
+{
+  auto colon = spec.find(':');
+  if(colon == std::string_view::npos || colon == 0) throw std::invalid_argument("expected cmd:key=value, got " + std::string(spec));
+
+  std::string cmd(spec.substr(0, colon));
+  Rule rule = defaults;
+
+  auto rest = spec.substr(colon + 1);
+  while(!rest.empty()) {
+    auto comma = rest.find(',');
+    auto item = rest.substr(0, comma);
+    rest = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 1);
+
+    auto equal = item.find('=');
+    if(equal == std::string_view::npos) throw std::invalid_argument("expected key=value, got " + std::string(item));
+
+    auto key = item.substr(0, equal);
+    std::string text(item.substr(equal + 1));
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+
+    if(text.empty() || *end != '\0' || value < 0) throw std::invalid_argument("invalid value in " + std::string(item));
+
+    if(key == "latency") rule.latency = std::chrono::milliseconds(static_cast<int64_t>(value));
+    else if(key == "jitter") rule.jitter = std::chrono::milliseconds(static_cast<int64_t>(value));
+    else if(key == "fail" && value <= 1) rule.fail = value;
+    else if(key == "drop" && value <= 1) rule.drop = value;
+    else throw std::invalid_argument("unknown or out of range " + std::string(item));
+  }
+
+  _rules[cmd] = rule;
+}
+
+FaultInjector::Decision FaultInjector::decide(const std::string& cmd)
+{
+  auto it = _rules.find(cmd);
+  const Rule& rule = it != _rules.end() ? it->second : defaults;
+
+  auto delay = rule.latency;
+  if(rule.jitter.count() > 0) {
+    delay += std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(0, rule.jitter.count())(_rng));
+  }
+
+  double draw = std::uniform_real_distribution<double>(0, 1)(_rng);
+
+  if(draw < rule.drop) return { Action::DROP, delay };
+  if(draw < rule.drop + rule.fail) return { Action::FAIL, delay };
+  return { Action::REPLY, delay };
+}
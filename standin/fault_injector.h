@@ -0,0 +1,48 @@
+#ifndef FAULT_INJECTOR_H
+#define FAULT_INJECTOR_H
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// What the stand-ins do with each command they receive : answer after a
+// latency, answer an error or never answer. Rules are per command, the
+// default rule applies to the others. Only used from the io thread.
+class FaultInjector
+{
+public:
+  struct Rule
+  {
+    std::chrono::milliseconds latency{0};
+    std::chrono::milliseconds jitter{0}; // uniform in [0, jitter] added to latency
+    double                    fail = 0;  // probability of an error reply
+    double                    drop = 0;  // probability of no reply at all
+  };
+
+  enum class Action { REPLY, FAIL, DROP };
+
+  struct Decision
+  {
+    Action                    action;
+    std::chrono::milliseconds delay;
+  };
+
+  Rule defaults;
+
+  explicit FaultInjector(uint64_t seed = std::random_device{}());
+
+  // cmd:key=value[,key=value...] with latency and jitter in ms, fail and
+  // drop probabilities, e.g. startserver:latency=800,fail=0.1. Throws
+  // std::invalid_argument on a malformed spec
+  void add_rule(std::string_view spec);
+
+  Decision decide(const std::string& cmd);
+
+private:
+  std::unordered_map<std::string, Rule> _rules;
+  std::mt19937_64                       _rng;
+};
+
+#endif /* FAULT_INJECTOR_H */
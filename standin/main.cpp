@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <asio/signal_set.hpp>
+#include <asio/steady_timer.hpp>
+
+#include "tunnel_loggin.h"
+#include "fault_injector.h"
+#include "tunnel_standin.h"
+#include "medooze_standin.h"
+#include "upload_sink.h"
+
+// Offline stand-in for the lab : the tunnel client and server control
+// websockets, medooze and the results upload server on localhost, so the
+// client can run whole campaigns on one machine with a matrix like
+//
+//   "endpoints": {
+//     "medooze": { "host": "localhost", "port": 8084 },
+//     "client":  { "host": "localhost", "port": 3333 },
+//     "server":  { "host": "localhost", "port": 3334 }
+//   }
+//
+// getstats answers a directory relative to the working directory of the
+// stand-in, which the client uploads from its own : run both from the same
+// directory or give an absolute --results.
+
+namespace
+{
+  std::vector<messages::Capabilities> default_capabilities()
+  {
+    return {
+      { "tcp", false, true, { "cubic", "bbr" } },
+      { "udp", true, false, {} },
+      { "quicgo", true, true, { "newreno" } },
+      { "mvfst", true, true, { "newreno", "cubic", "bbr" } },
+      { "quiche", true, true, { "reno", "cubic" } }
+    };
+  }
+
+  void usage(const char* name)
+  {
+    std::cerr << "Usage : " << name << " [options]\n"
+	      << "  --client-port P      tunnel client control port (3333)\n"
+	      << "  --server-port P      tunnel server control port (3334)\n"
+	      << "  --sessions N         tunnel ports for N sessions, + i * stride (1)\n"
+	      << "  --port-stride S      (2)\n"
+	      << "  --medooze-port P     medooze wss port (8084)\n"
+	      << "  --rtp-port P         first rtp port handed out by medooze (40000)\n"
+	      << "  --legacy-medooze     do not answer the port command on the control channel\n"
+	      << "  --upload-port P      results upload port, 0 for none (4455)\n"
+	      << "  --results DIR        where getstats writes its summaries (standin_results)\n"
+	      << "  --caps FILE          capabilities, a json array like the capabilities reply in_impls\n"
+	      << "  --json-only          refuse the binary encodings\n"
+	      << "  --latency MS         reply latency of every command (0)\n"
+	      << "  --jitter MS          added uniformly in [0, MS] (0)\n"
+	      << "  --fail P             probability of an error reply (0)\n"
+	      << "  --drop P             probability of no reply (0)\n"
+	      << "  --fault SPEC         cmd:key=value,... overriding the above for one command,\n"
+	      << "                       e.g. startserver:latency=800,fail=0.1 (repeatable)\n"
+	      << "  --seed N             fault injection seed\n"
+	      << "  --verbose\n";
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int client_port = 3333;
+  int server_port = 3334;
+  int sessions = 1;
+  int port_stride = 2;
+  int upload_port = 4455;
+  std::vector<std::string> fault_specs;
+  std::optional<uint64_t> seed;
+
+  TunnelStandin::Config tunnel_config{ "", 0, default_capabilities() };
+  MedoozeStandin::Config medooze_config;
+  FaultInjector::Rule defaults;
+
+  try {
+    for(int i = 1; i < argc; ++i) {
+      std::string_view arg{argv[i]};
+      bool has_value = i + 1 < argc;
+
+      if(arg == "--client-port" && has_value) client_port = std::stoi(argv[++i]);
+      else if(arg == "--server-port" && has_value) server_port = std::stoi(argv[++i]);
+      else if(arg == "--sessions" && has_value) sessions = std::max(1, std::stoi(argv[++i]));
+      else if(arg == "--port-stride" && has_value) port_stride = std::stoi(argv[++i]);
+      else if(arg == "--medooze-port" && has_value) medooze_config.port = std::stoi(argv[++i]);
+      else if(arg == "--rtp-port" && has_value) medooze_config.rtp_port = std::stoi(argv[++i]);
+      else if(arg == "--legacy-medooze") medooze_config.legacy = true;
+      else if(arg == "--upload-port" && has_value) upload_port = std::stoi(argv[++i]);
+      else if(arg == "--results" && has_value) tunnel_config.results = argv[++i];
+      else if(arg == "--json-only") tunnel_config.json_only = true;
+      else if(arg == "--caps" && has_value) {
+	std::ifstream file(argv[++i]);
+	if(!file) throw std::runtime_error(std::string("can not open ") + argv[i]);
+	tunnel_config.caps = nlohmann::json::parse(file).get<std::vector<messages::Capabilities>>();
+      }
+      else if(arg == "--latency" && has_value) defaults.latency = std::chrono::milliseconds(std::stoi(argv[++i]));
+      else if(arg == "--jitter" && has_value) defaults.jitter = std::chrono::milliseconds(std::stoi(argv[++i]));
+      else if(arg == "--fail" && has_value) defaults.fail = std::stod(argv[++i]);
+      else if(arg == "--drop" && has_value) defaults.drop = std::stod(argv[++i]);
+      else if(arg == "--fault" && has_value) fault_specs.emplace_back(argv[++i]);
+      else if(arg == "--seed" && has_value) seed = std::stoull(argv[++i]);
+      else if(arg == "--verbose") TunnelLogging::set_min_severity(TunnelLogging::Severity::VERBOSE);
+      else {
+	usage(argv[0]);
+	return EXIT_FAILURE;
+      }
+    }
+  }
+  catch(const std::exception& e) {
+    std::cerr << "Invalid arguments : " << e.what() << "\n";
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FaultInjector faults = seed ? FaultInjector(*seed) : FaultInjector();
+  faults.defaults = defaults;
+
+  try {
+    // After the defaults, rules start from them
+    for(auto& spec : fault_specs) faults.add_rule(spec);
+  }
+  catch(const std::exception& e) {
+    std::cerr << "Invalid --fault : " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  asio::io_context io;
+
+  // Not movable, the servers keep pointers to themselves in their handlers
+  std::list<TunnelStandin> tunnels;
+  std::optional<MedoozeStandin> medooze;
+  std::optional<UploadSink> uploads;
+
+  try {
+    for(int i = 0; i < sessions; ++i) {
+      auto suffix = sessions > 1 ? "#" + std::to_string(i) : std::string{};
+
+      auto client = tunnel_config;
+      client.name = "client" + suffix;
+      client.port = client_port + i * port_stride;
+      tunnels.emplace_back(io, std::move(client), faults).start();
+
+      auto server = tunnel_config;
+      server.name = "server" + suffix;
+      server.port = server_port + i * port_stride;
+      tunnels.emplace_back(io, std::move(server), faults).start();
+    }
+
+    medooze.emplace(io, medooze_config, faults);
+    medooze->start();
+
+    if(upload_port > 0) uploads.emplace(upload_port);
+  }
+  catch(const std::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::ERROR) << "Could not start the stand-ins : " << e.what();
+    TunnelLogging::flush();
+    return EXIT_FAILURE;
+  }
+
+  asio::signal_set signals(io, SIGINT, SIGTERM);
+  asio::steady_timer shutdown(io);
+
+  signals.async_wait([&](const std::error_code& ec, int) {
+    if(ec) return;
+
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "Stopping";
+    for(auto& tunnel : tunnels) tunnel.stop();
+    medooze->stop();
+
+    // Time for the close frames to go out
+    shutdown.expires_after(std::chrono::milliseconds(200));
+    shutdown.async_wait([&io](const std::error_code&) { io.stop(); });
+  });
+
+  io.run();
+
+  TunnelLogging::flush();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+#include "medooze_standin.h"
+
+#include <sstream>
+#include <vector>
+
+#include <asio/steady_timer.hpp>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+#include "tls_cert.h"
+#include "messages.h"
+#include "tunnel_loggin.h"
+
+namespace
+{
+  constexpr const char* CONTROL_PROTOCOL = "quic-relay-loopback";
+  constexpr const char* PORT_PROTOCOL = "port";
+}
+
+MedoozeStandin::MedoozeStandin(asio::io_context& io, Config config, FaultInjector& faults)
+  : _io(io), _config(config), _faults(faults),
+    _tls(std::make_shared<ssl_context>(ssl_context::tls_server)), _next_rtp_port(config.rtp_port)
+{
+  _tls->set_options(ssl_context::default_workarounds | ssl_context::no_sslv2 | ssl_context::no_sslv3 | ssl_context::no_tlsv1);
+  use_ephemeral_certificate(_tls->native_handle());
+
+  _server.clear_access_channels(websocketpp::log::alevel::all);
+  _server.set_error_channels(websocketpp::log::elevel::warn | websocketpp::log::elevel::rerror | websocketpp::log::elevel::fatal);
+  _server.init_asio(&_io);
+  _server.set_reuse_addr(true);
+
+  _server.set_tls_init_handler([this](websocketpp::connection_hdl) { return _tls; });
+  _server.set_validate_handler([this](websocketpp::connection_hdl hdl) { return on_validate(hdl); });
+  _server.set_open_handler([this](websocketpp::connection_hdl hdl) { on_open(hdl); });
+  _server.set_close_handler([this](websocketpp::connection_hdl hdl) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "medooze : connection closed";
+    _connections.erase(hdl);
+  });
+  _server.set_message_handler([this](websocketpp::connection_hdl hdl, WssServer::message_ptr frame) { on_message(hdl, frame); });
+}
+
+void MedoozeStandin::start()
+{
+  _server.listen(_config.port);
+  _server.start_accept();
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "medooze : listening on " << _config.port << (_config.legacy ? " (legacy)" : "");
+}
+
+void MedoozeStandin::stop()
+{
+  websocketpp::lib::error_code ec;
+  _server.stop_listening(ec);
+
+  for(auto& hdl : _connections) _server.close(hdl, websocketpp::close::status::going_away, "stand-in stopping", ec);
+}
+
+bool MedoozeStandin::on_validate(websocketpp::connection_hdl hdl)
+{
+  auto con = _server.get_con_from_hdl(hdl);
+
+  for(auto& protocol : con->get_requested_subprotocols()) {
+    if(protocol == CONTROL_PROTOCOL || protocol == PORT_PROTOCOL) {
+      con->select_subprotocol(protocol);
+      return true;
+    }
+  }
+
+  TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "medooze : refusing a connection without a known subprotocol";
+  return false;
+}
+
+void MedoozeStandin::on_open(websocketpp::connection_hdl hdl)
+{
+  auto protocol = _server.get_con_from_hdl(hdl)->get_subprotocol();
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "medooze : " << protocol << " connection opened";
+
+  _connections.insert(hdl);
+
+  // Legacy port query : the port is sent on open, the client closes
+  if(protocol == PORT_PROTOCOL) {
+    answer(hdl, messages::Port::cmd, [this]() { return std::vector<json>{ messages::PortReply{ rtp_port() } }; });
+  }
+}
+
+void MedoozeStandin::on_message(websocketpp::connection_hdl hdl, WssServer::message_ptr frame)
+{
+  json msg;
+
+  try {
+    msg = decode_frame(frame, WireEncoding::JSON);
+  }
+  catch(const json::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "medooze : could not decode message : " << e.what();
+    return;
+  }
+
+  auto cmd = msg.value("cmd", std::string{});
+  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << "medooze : " << cmd;
+
+  if(cmd == messages::View::cmd) {
+    auto offer = msg.value("offer", std::string{});
+
+    answer(hdl, cmd, [this, offer]() {
+      return std::vector<json>{
+	messages::ViewAnswer{ answer_for(offer) },
+	messages::DumpUrl{ fmt::format("https://localhost/medooze/dump_{}.csv", _views++) }
+      };
+    });
+  }
+  else if(cmd == messages::Port::cmd) {
+    // Never answered, the client gives up after its port timeout
+    if(_config.legacy) return;
+
+    answer(hdl, cmd, [this]() { return std::vector<json>{ messages::PortReply{ rtp_port() } }; });
+  }
+  else if(cmd == messages::Stop::cmd) {
+    answer(hdl, cmd, []() { return std::vector<json>{}; });
+  }
+  else {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "medooze : unknown message " << msg.dump();
+  }
+}
+
+void MedoozeStandin::answer(websocketpp::connection_hdl hdl, const std::string& cmd, std::function<std::vector<json>()> reply)
+{
+  auto decision = _faults.decide(cmd);
+
+  if(decision.action == FaultInjector::Action::DROP) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << "medooze : dropping " << cmd;
+    return;
+  }
+
+  auto timer = std::make_shared<asio::steady_timer>(_io, decision.delay);
+  timer->async_wait([this, timer, hdl, cmd, action = decision.action, reply = std::move(reply)](const std::error_code& ec) {
+    if(ec || !_connections.contains(hdl)) return;
+
+    if(action == FaultInjector::Action::FAIL) {
+      TUNNEL_LOG(TunnelLogging::Severity::INFO) << "medooze : failing " << cmd << ", closing the connection";
+
+      websocketpp::lib::error_code ignored;
+      _server.close(hdl, websocketpp::close::status::internal_endpoint_error, "injected failure", ignored);
+      return;
+    }
+
+    for(auto& msg : reply()) send(hdl, msg);
+  });
+}
+
+void MedoozeStandin::send(websocketpp::connection_hdl hdl, const json& msg)
+{
+  websocketpp::lib::error_code ec;
+  _server.send(hdl, msg.dump(), websocketpp::frame::opcode::text, ec);
+
+  if(ec) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "medooze : could not send : " << ec.message();
+}
+
+int MedoozeStandin::rtp_port()
+{
+  int port = _next_rtp_port++;
+  if(_next_rtp_port >= _config.rtp_port + _config.rtp_ports) _next_rtp_port = _config.rtp_port;
+
+  return port;
+}
+
+std::string MedoozeStandin::answer_for(const std::string& offer)
+{
+  std::istringstream in(offer);
+  std::ostringstream out;
+  std::string line;
+
+  while(std::getline(in, line)) {
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    if(line.empty()) continue;
+
+    // Nothing listens there, the client would only check against itself
+    if(line.starts_with("a=candidate:") || line == "a=end-of-candidates") continue;
+
+    if(line.starts_with("a=setup:")) line = "a=setup:active";
+    else if(line == "a=recvonly") line = "a=sendonly";
+    else if(line == "a=sendonly") line = "a=recvonly";
+
+    out << line << "\r\n";
+  }
+
+  return out.str();
+}
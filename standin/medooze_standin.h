@@ -0,0 +1,61 @@
+#ifndef MEDOOZE_STANDIN_H
+#define MEDOOZE_STANDIN_H
+
+#include <memory>
+#include <set>
+#include <string>
+
+#include "ws_server.h"
+#include "fault_injector.h"
+
+// Local stand-in for medooze, over TLS like the real one. It serves the
+// "quic-relay-loopback" control channel (view, port, stop) and the legacy
+// "port" connection, answering a view with an SDP answer made from the
+// offer : the client can set it as its remote description, no media flows.
+// An injected failure closes the connection, as a crashed medooze would.
+class MedoozeStandin
+{
+public:
+  using json = nlohmann::json;
+
+  struct Config
+  {
+    int  port = 8084;
+    int  rtp_port = 40000; // first port handed out, then the next ones
+    int  rtp_ports = 100;
+    bool legacy = false;   // ignore the port command, clients fall back to a connection per query
+  };
+
+  MedoozeStandin(asio::io_context& io, Config config, FaultInjector& faults);
+
+  // Throws websocketpp::exception if the port can not be bound
+  void start();
+  void stop();
+
+  // Answer with the offer's transports, a=setup:active and the direction reversed
+  static std::string answer_for(const std::string& offer);
+
+private:
+  using ssl_context = websocketpp::lib::asio::ssl::context;
+
+  asio::io_context&            _io;
+  Config                       _config;
+  FaultInjector&               _faults;
+  WssServer                    _server;
+  std::shared_ptr<ssl_context> _tls;
+  int                          _next_rtp_port;
+  int                          _views = 0;
+
+  std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> _connections;
+
+  bool on_validate(websocketpp::connection_hdl hdl);
+  void on_open(websocketpp::connection_hdl hdl);
+  void on_message(websocketpp::connection_hdl hdl, WssServer::message_ptr frame);
+
+  // Applies the fault rule of cmd, then sends what reply() returns if not empty
+  void answer(websocketpp::connection_hdl hdl, const std::string& cmd, std::function<std::vector<json>()> reply);
+  void send(websocketpp::connection_hdl hdl, const json& msg);
+  int rtp_port();
+};
+
+#endif /* MEDOOZE_STANDIN_H */
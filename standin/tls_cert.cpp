@@ -0,0 +1,67 @@
+#include "tls_cert.h"
+
+#include <memory>
+#include <stdexcept>
+
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/x509.h>
+#include <openssl/err.h>
+
+namespace
+{
+  template<typename T, void (*Free)(T*)>
+  struct Deleter
+  {
+    void operator()(T* p) const { Free(p); }
+  };
+
+  using PkeyPtr = std::unique_ptr<EVP_PKEY, Deleter<EVP_PKEY, EVP_PKEY_free>>;
+  using PkeyCtxPtr = std::unique_ptr<EVP_PKEY_CTX, Deleter<EVP_PKEY_CTX, EVP_PKEY_CTX_free>>;
+  using X509Ptr = std::unique_ptr<X509, Deleter<X509, X509_free>>;
+
+  [[noreturn]] void fail(const char* what)
+  {
+    char error[256];
+    ERR_error_string_n(ERR_get_error(), error, sizeof(error));
+    throw std::runtime_error(std::string(what) + " : " + error);
+  }
+
+  PkeyPtr make_key()
+  {
+    PkeyCtxPtr ctx(EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr));
+    EVP_PKEY* key = nullptr;
+
+    if(!ctx
+       || EVP_PKEY_keygen_init(ctx.get()) <= 0
+       || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx.get(), NID_X9_62_prime256v1) <= 0
+       || EVP_PKEY_keygen(ctx.get(), &key) <= 0) {
+      fail("key generation");
+    }
+
+    return PkeyPtr(key);
+  }
+}
+
+void use_ephemeral_certificate(SSL_CTX* ctx)
+{
+  auto key = make_key();
+  X509Ptr cert(X509_new());
+  if(!cert) fail("X509_new");
+
+  // One day is plenty for a stand-in process
+  X509_set_version(cert.get(), 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert.get()), -60);
+  X509_gmtime_adj(X509_getm_notAfter(cert.get()), 24 * 3600);
+  X509_set_pubkey(cert.get(), key.get());
+
+  X509_NAME* name = X509_get_subject_name(cert.get());
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+  X509_set_issuer_name(cert.get(), name);
+
+  if(X509_sign(cert.get(), key.get(), EVP_sha256()) <= 0) fail("X509_sign");
+
+  if(SSL_CTX_use_certificate(ctx, cert.get()) != 1) fail("SSL_CTX_use_certificate");
+  if(SSL_CTX_use_PrivateKey(ctx, key.get()) != 1) fail("SSL_CTX_use_PrivateKey");
+}
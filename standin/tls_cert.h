@@ -0,0 +1,11 @@
+#ifndef TLS_CERT_H
+#define TLS_CERT_H
+
+#include <openssl/ssl.h>
+
+// Self-signed certificate for CN=localhost on a fresh P-256 key, made at
+// startup so the stand-in needs no files. The client does not verify the
+// medooze certificate. Throws std::runtime_error if OpenSSL fails.
+void use_ephemeral_certificate(SSL_CTX* ctx);
+
+#endif /* TLS_CERT_H */
@@ -0,0 +1,248 @@
+#include "tunnel_standin.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <asio/steady_timer.hpp>
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+
+#include "tunnel_loggin.h"
+
+namespace fs = std::filesystem;
+
+TunnelStandin::TunnelStandin(asio::io_context& io, Config config, FaultInjector& faults)
+  : _io(io), _config(std::move(config)), _faults(faults)
+{
+  _server.clear_access_channels(websocketpp::log::alevel::all);
+  _server.set_error_channels(websocketpp::log::elevel::warn | websocketpp::log::elevel::rerror | websocketpp::log::elevel::fatal);
+  _server.init_asio(&_io);
+  _server.set_reuse_addr(true);
+
+  _server.set_open_handler([this](websocketpp::connection_hdl hdl) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : connection opened";
+    _encodings[hdl] = WireEncoding::JSON;
+  });
+  _server.set_close_handler([this](websocketpp::connection_hdl hdl) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : connection closed";
+    _encodings.erase(hdl);
+  });
+  _server.set_message_handler([this](websocketpp::connection_hdl hdl, WsServer::message_ptr frame) { on_message(hdl, frame); });
+}
+
+void TunnelStandin::start()
+{
+  _server.listen(_config.port);
+  _server.start_accept();
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : listening on " << _config.port;
+}
+
+void TunnelStandin::stop()
+{
+  websocketpp::lib::error_code ec;
+  _server.stop_listening(ec);
+
+  for(auto& [hdl, encoding] : _encodings) _server.close(hdl, websocketpp::close::status::going_away, "stand-in stopping", ec);
+}
+
+void TunnelStandin::on_message(websocketpp::connection_hdl hdl, WsServer::message_ptr frame)
+{
+  json msg;
+
+  try {
+    msg = decode_frame(frame, _encodings[hdl]);
+  }
+  catch(const json::exception& e) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << _config.name << " : could not decode message : " << e.what();
+    return;
+  }
+
+  auto trans_id = msg.find("transId");
+  auto cmd = msg.find("cmd");
+
+  if(trans_id == msg.end() || !trans_id->is_number_integer() || cmd == msg.end() || !cmd->is_string()) {
+    TUNNEL_LOG(TunnelLogging::Severity::WARNING) << _config.name << " : not a request " << msg.dump();
+    return;
+  }
+
+  auto name = cmd->get<std::string>();
+  auto decision = _faults.decide(name);
+
+  TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << _config.name << " : " << name << " (" << *trans_id << ")";
+
+  if(decision.action == FaultInjector::Action::DROP) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : dropping " << name;
+    return;
+  }
+
+  json response{ { "transId", *trans_id } };
+  std::optional<WireEncoding> switch_to;
+
+  if(decision.action == FaultInjector::Action::FAIL) {
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : failing " << name;
+    response["type"] = "error";
+    response["data"] = json{ { "message", "injected failure" } };
+  }
+  else {
+    try {
+      response["data"] = handle(name, msg.value("data", json::object()), switch_to);
+      response["type"] = "response";
+    }
+    catch(const std::exception& e) {
+      TUNNEL_LOG(TunnelLogging::Severity::WARNING) << _config.name << " : " << name << " failed : " << e.what();
+      response["type"] = "error";
+      response["data"] = json{ { "message", e.what() } };
+    }
+  }
+
+  // The reply to the encoding query is still in the old encoding
+  auto timer = std::make_shared<asio::steady_timer>(_io, decision.delay);
+  timer->async_wait([this, timer, hdl, response = std::move(response), switch_to](const std::error_code& ec) {
+    if(ec) return;
+
+    send(hdl, response);
+    if(switch_to && _encodings.contains(hdl)) _encodings[hdl] = *switch_to;
+  });
+}
+
+void TunnelStandin::send(websocketpp::connection_hdl hdl, const json& msg)
+{
+  auto it = _encodings.find(hdl);
+  if(it == _encodings.end()) return;
+
+  auto [payload, opcode] = encode_frame(msg, it->second);
+
+  websocketpp::lib::error_code ec;
+  _server.send(hdl, payload, opcode, ec);
+
+  if(ec) TUNNEL_LOG(TunnelLogging::Severity::WARNING) << _config.name << " : could not send reply : " << ec.message();
+}
+
+TunnelStandin::json TunnelStandin::handle(const std::string& cmd, const json& data, std::optional<WireEncoding>& switch_to)
+{
+  using namespace messages;
+
+  if(cmd == EncodingQuery::cmd) {
+    EncodingReply reply;
+
+    for(auto& encoding : data.get<EncodingQuery>().accept) {
+      if(encoding == "json" || (!_config.json_only && (encoding == "msgpack" || encoding == "cbor"))) {
+	reply.encoding = encoding;
+	break;
+      }
+    }
+
+    switch_to = reply.encoding == "msgpack" ? WireEncoding::MSGPACK
+      : reply.encoding == "cbor" ? WireEncoding::CBOR : WireEncoding::JSON;
+    return reply;
+  }
+
+  if(cmd == CapabilitiesQuery::cmd) return CapabilitiesReply{ _config.caps };
+
+  if(cmd == StartServer::cmd) {
+    auto request = data.get<StartServer>();
+    check_capability(request.impl, request.cc);
+
+    _run_start = std::chrono::steady_clock::now();
+    _links = json::array();
+    _next_seq = 0;
+    _samples = 0;
+    _final = false;
+
+    _sessions.insert(_next_id);
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : server " << _next_id << " " << request.impl << " "
+					      << request.cc << (request.datagrams ? " dgram" : " stream") << " -> "
+					      << request.addr_out << ":" << request.port_out;
+    return StartReply{ _next_id++ };
+  }
+
+  if(cmd == StartClient::cmd) {
+    auto request = data.get<StartClient>();
+    check_capability(request.impl, request.cc);
+
+    _sessions.insert(_next_id);
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : client " << _next_id << " " << request.impl << " "
+					      << request.cc << (request.datagrams ? " dgram" : " stream");
+    return StartReply{ _next_id++ };
+  }
+
+  if(cmd == StopServer::cmd || cmd == StopClient::cmd) {
+    int id = data.at("id").get<int>();
+    if(_sessions.erase(id) == 0) throw std::runtime_error(fmt::format("no session {}", id));
+
+    TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : stopped " << id;
+    return Ack{};
+  }
+
+  if(cmd == Link::cmd) {
+    double at = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _run_start).count();
+
+    // Empty : back to no constraint
+    if(data.empty()) {
+      _links.push_back(json{ { "at", at } });
+      return Ack{};
+    }
+
+    auto link = data.get<Link>();
+    _links.push_back(json{ { "at", at }, { "bitrate", link.bitrate }, { "delay", link.delay }, { "loss", link.loss } });
+    TUNNEL_LOG(TunnelLogging::Severity::VERBOSE) << _config.name << " : link " << link.bitrate << " kbps " << link.delay
+						 << " ms " << link.loss << " %";
+    return Ack{};
+  }
+
+  if(cmd == GetStats::cmd) return get_stats(data.get<GetStats>());
+
+  if(cmd == UploadStats::cmd) {
+    int seq = data.at("seq").get<int>();
+    if(seq != _next_seq) {
+      TUNNEL_LOG(TunnelLogging::Severity::WARNING) << _config.name << " : uploadstats seq " << seq << ", expected " << _next_seq;
+    }
+
+    _next_seq = seq + 1;
+    _samples += data.at("stats").size();
+    _final = data.value("final", false);
+
+    if(_final) TUNNEL_LOG(TunnelLogging::Severity::INFO) << _config.name << " : " << _samples << " samples uploaded in " << _next_seq << " chunks";
+    return Ack{};
+  }
+
+  throw std::runtime_error("unknown command " + cmd);
+}
+
+void TunnelStandin::check_capability(const std::string& impl, const std::string& cc) const
+{
+  auto cap = std::ranges::find(_config.caps, impl, &messages::Capabilities::impl);
+  if(cap == _config.caps.end()) throw std::runtime_error("unknown impl " + impl);
+
+  // udp has no cc, the client asks for "none"
+  if(cap->cc.empty() ? cc != "none" : std::ranges::find(cap->cc, cc) == cap->cc.end()) {
+    throw std::runtime_error("unknown cc " + cc + " for " + impl);
+  }
+}
+
+TunnelStandin::json TunnelStandin::get_stats(const messages::GetStats& request)
+{
+  auto name = request.exp_name;
+  std::ranges::replace(name, '/', '_');
+
+  auto directory = _config.results / name;
+  fs::create_directories(directory);
+
+  json summary{
+    { "exp_name", request.exp_name },
+    { "transport", request.transport },
+    { "medooze_dump_url", request.medooze_dump_url },
+    { "links", _links },
+    { "samples", _samples },
+    { "chunks", _next_seq },
+    { "final", _final }
+  };
+
+  std::ofstream(directory / "stats.json") << summary.dump(2) << "\n";
+
+  // The client keeps the path after the host as the directory to upload
+  return messages::GetStatsReply{ fmt::format("https://localhost/{}/stats.json", directory.string()) };
+}
@@ -0,0 +1,69 @@
+#ifndef TUNNEL_STANDIN_H
+#define TUNNEL_STANDIN_H
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ws_server.h"
+#include "fault_injector.h"
+#include "messages.h"
+
+// Local stand-in for a tunnel end (the quic client or server websocket
+// control). It answers every request of the tunnel protocol, see
+// messages.h, without starting anything : sessions are ids, links are
+// recorded, uploaded stats counted, and getstats writes a summary of the
+// run to a local directory whose url the client can post-process.
+class TunnelStandin
+{
+public:
+  using json = nlohmann::json;
+
+  struct Config
+  {
+    std::string                         name;  // for the logs
+    int                                 port;
+    std::vector<messages::Capabilities> caps;
+    std::filesystem::path               results = "standin_results";
+    bool                                json_only = false; // refuse binary encodings
+  };
+
+  TunnelStandin(asio::io_context& io, Config config, FaultInjector& faults);
+
+  // Throws websocketpp::exception if the port can not be bound
+  void start();
+  void stop();
+
+private:
+  asio::io_context& _io;
+  Config            _config;
+  FaultInjector&    _faults;
+  WsServer          _server;
+
+  std::map<websocketpp::connection_hdl, WireEncoding, std::owner_less<websocketpp::connection_hdl>> _encodings;
+
+  int           _next_id = 1;
+  std::set<int> _sessions;
+
+  // Current run, since the last startserver
+  std::chrono::steady_clock::time_point _run_start = std::chrono::steady_clock::now();
+  json                                  _links = json::array();
+  int                                   _next_seq = 0;
+  size_t                                _samples = 0;
+  bool                                  _final = false;
+
+  void on_message(websocketpp::connection_hdl hdl, WsServer::message_ptr frame);
+  // Reply data, throws to answer an error
+  json handle(const std::string& cmd, const json& data, std::optional<WireEncoding>& switch_to);
+  void send(websocketpp::connection_hdl hdl, const json& msg);
+
+  void check_capability(const std::string& impl, const std::string& cc) const;
+  json get_stats(const messages::GetStats& request);
+};
+
+#endif /* TUNNEL_STANDIN_H */
@@ -0,0 +1,88 @@
+#include "upload_sink.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+#include <system_error>
+
+#include <asio/read.hpp>
+#include <asio/read_until.hpp>
+#include <asio/write.hpp>
+#include <asio/buffer.hpp>
+
+#include "tunnel_loggin.h"
+
+using tcp = asio::ip::tcp;
+
+UploadSink::UploadSink(int port)
+  : _acceptor(_io, tcp::endpoint(tcp::v4(), port))
+{
+  accept();
+  _thread = std::thread([this]() { _io.run(); });
+
+  TUNNEL_LOG(TunnelLogging::Severity::INFO) << "uploads : listening on " << port;
+}
+
+UploadSink::~UploadSink()
+{
+  _io.stop();
+  if(_thread.joinable()) _thread.join();
+}
+
+void UploadSink::accept()
+{
+  _acceptor.async_accept([this](const std::error_code& ec, tcp::socket socket) {
+    if(ec) return;
+
+    try {
+      auto bytes = serve(socket);
+      TUNNEL_LOG(TunnelLogging::Severity::INFO) << "uploads : #" << ++_uploads << ", " << bytes << " bytes";
+    }
+    catch(const std::exception& e) {
+      TUNNEL_LOG(TunnelLogging::Severity::WARNING) << "uploads : " << e.what();
+    }
+
+    accept();
+  });
+}
+
+size_t UploadSink::serve(tcp::socket& socket)
+{
+  std::string data;
+  auto buffer = asio::dynamic_buffer(data);
+
+  auto header_end = asio::read_until(socket, buffer, "\r\n\r\n");
+  std::string headers = data.substr(0, header_end);
+  data.erase(0, header_end);
+
+  std::ranges::transform(headers, headers.begin(), [](unsigned char c) { return std::tolower(c); });
+
+  size_t body = 0;
+
+  if(headers.find("transfer-encoding: chunked") != std::string::npos) {
+    while(true) {
+      auto line_end = asio::read_until(socket, buffer, "\r\n");
+      size_t size = std::stoul(data.substr(0, line_end), nullptr, 16);
+      data.erase(0, line_end);
+
+      // Last chunk, then the empty trailer
+      if(size == 0) {
+	asio::read_until(socket, buffer, "\r\n");
+	break;
+      }
+
+      if(data.size() < size + 2) asio::read(socket, buffer, asio::transfer_exactly(size + 2 - data.size()));
+      data.erase(0, size + 2);
+      body += size;
+    }
+  }
+  else if(auto pos = headers.find("content-length:"); pos != std::string::npos) {
+    body = std::stoul(headers.substr(pos + 15));
+    if(data.size() < body) asio::read(socket, buffer, asio::transfer_exactly(body - data.size()));
+  }
+
+  constexpr std::string_view response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  asio::write(socket, asio::buffer(response.data(), response.size()));
+
+  return body;
+}
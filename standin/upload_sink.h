@@ -0,0 +1,37 @@
+#ifndef UPLOAD_SINK_H
+#define UPLOAD_SINK_H
+
+#include <string>
+#include <thread>
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+
+// Accepts the results POSTs of ResultUploader, chunked or not, and answers
+// 200 after reading the whole body, which is discarded. Connections are
+// served one at a time on a thread of its own.
+class UploadSink
+{
+  asio::io_context        _io;
+  asio::ip::tcp::acceptor _acceptor;
+  std::thread             _thread;
+  size_t                  _uploads = 0;
+
+  void accept();
+  // Bytes of body read, throws std::system_error
+  size_t serve(asio::ip::tcp::socket& socket);
+
+public:
+  // Throws std::system_error if the port can not be bound
+  explicit UploadSink(int port);
+  ~UploadSink();
+
+  UploadSink(const UploadSink&) = delete;
+  UploadSink& operator=(const UploadSink&) = delete;
+};
+
+#endif /* UPLOAD_SINK_H */
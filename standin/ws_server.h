@@ -0,0 +1,58 @@
+#ifndef WS_SERVER_H
+#define WS_SERVER_H
+
+#include <string>
+#include <utility>
+
+#define ASIO_STANDALONE
+#define _WEBSOCKETPP_CPP11_STL_
+#define _WEBSOCKETPP_CPP11_THREAD_
+#define _WEBSOCKETPP_CPP11_FUNCTIONAL_
+#define _WEBSOCKETPP_CPP11_SYSTEM_ERROR_
+#define _WEBSOCKETPP_CPP11_RANDOM_DEVICE_
+#define _WEBSOCKETPP_CPP11_MEMORY_
+
+#include "websocketpp/config/asio.hpp"
+#include "websocketpp/server.hpp"
+
+#include "nlohmann/json.hpp"
+
+using WsServer = websocketpp::server<websocketpp::config::asio>;
+using WssServer = websocketpp::server<websocketpp::config::asio_tls>;
+
+// Same wire formats as the client websockets : JSON text, or CBOR /
+// MessagePack binary frames once negotiated
+enum class WireEncoding : uint8_t { JSON, CBOR, MSGPACK };
+
+// Throws json::exception
+template<typename MessagePtr>
+nlohmann::json decode_frame(const MessagePtr& frame, WireEncoding encoding)
+{
+  using json = nlohmann::json;
+
+  if(frame->get_opcode() == websocketpp::frame::opcode::binary) {
+    return (encoding == WireEncoding::CBOR) ? json::from_cbor(frame->get_payload()) : json::from_msgpack(frame->get_payload());
+  }
+
+  return json::parse(frame->get_payload());
+}
+
+inline std::pair<std::string, websocketpp::frame::opcode::value> encode_frame(const nlohmann::json& msg, WireEncoding encoding)
+{
+  using json = nlohmann::json;
+
+  switch(encoding) {
+  case WireEncoding::CBOR: {
+    auto bin = json::to_cbor(msg);
+    return { std::string(bin.begin(), bin.end()), websocketpp::frame::opcode::binary };
+  }
+  case WireEncoding::MSGPACK: {
+    auto bin = json::to_msgpack(msg);
+    return { std::string(bin.begin(), bin.end()), websocketpp::frame::opcode::binary };
+  }
+  default:
+    return { msg.dump(), websocketpp::frame::opcode::text };
+  }
+}
+
+#endif /* WS_SERVER_H */